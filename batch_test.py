@@ -0,0 +1,50 @@
+import os
+import sys
+import subprocess
+import tempfile
+import judge
+
+# usage: python batch_test.py solver.exe
+# solves a batch with a missing file and a truncated level between valid ones,
+# every level has to get its own line, BRAK for the unreadable ones
+
+def solve(args, input=None):
+    result = subprocess.run(args, input=input, stdout=subprocess.PIPE, timeout=60)
+    return result.returncode, result.stdout.decode().split()
+
+def check_valid(filename, line):
+    level = judge.readDane(filename)
+    return judge.spr(level, line) == 'OK'
+
+def main():
+    solvername = sys.argv[1]
+    valid = ['input/6x6_0.txt', 'input/6x6_1.txt']
+    failures = []
+
+    with tempfile.TemporaryDirectory() as directory:
+        truncated = os.path.join(directory, 'truncated.txt')
+        with open(valid[0]) as source, open(truncated, 'w') as file:
+            file.write(source.read()[:30])
+        missing = os.path.join(directory, 'missing.txt')
+
+        code, lines = solve([solvername, '--batch', '--time', '1', valid[0], missing, truncated, valid[1]])
+        if code != 0 or len(lines) != 4:
+            failures.append('batch of files: exit code {}, {} lines'.format(code, len(lines)))
+        else:
+            if lines[1] != 'BRAK' or lines[2] != 'BRAK':
+                failures.append('batch of files: unreadable levels got {} and {}'.format(lines[1], lines[2]))
+            for filename, line in [(valid[0], lines[0]), (valid[1], lines[3])]:
+                if not check_valid(filename, line):
+                    failures.append('batch of files: wrong solution for {}'.format(filename))
+
+        with open(valid[0], 'rb') as source:
+            code, lines = solve([solvername, '--time', '1'], source.read()[:30])
+        if code != 0 or lines != ['BRAK']:
+            failures.append('truncated level on stdin: exit code {}, output {}'.format(code, lines))
+
+    for failure in failures:
+        print(failure)
+    print('OK' if not failures else 'FAILED')
+    sys.exit(1 if failures else 0)
+
+main()
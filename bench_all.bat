@@ -0,0 +1,11 @@
+solver.exe --bench --time 10 --list input/6x6_list.txt --baseline bench/6x6_min_10s.txt --report 6x6_min_10s.json > 6x6_min_10s.txt
+solver.exe --bench --time 10 --list input/10x8_list.txt --baseline bench/10x8_min_10s.txt --report 10x8_min_10s.json > 10x8_min_10s.txt
+solver.exe --bench --time 10 --list input/12x10_list.txt --baseline bench/12x10_min_10s.txt --report 12x10_min_10s.json > 12x10_min_10s.txt
+solver.exe --bench --time 10 --list input/17x14_list.txt --baseline bench/17x14_min_10s.txt --report 17x14_min_10s.json > 17x14_min_10s.txt
+solver.exe --bench --time 10 --list input/22x18_list.txt --baseline bench/22x18_min_10s.txt --report 22x18_min_10s.json > 22x18_min_10s.txt
+solver.exe --bench --time 10 --list input/32x32_list.txt --baseline bench/32x32_min_10s.txt --report 32x32_min_10s.json > 32x32_min_10s.txt
+solver.exe --bench --time 10 --list input/52x52_list.txt --baseline bench/52x52_min_10s.txt --report 52x52_min_10s.json > 52x52_min_10s.txt
+solver.exe --bench --time 10 --list input/64x64_list.txt --baseline bench/64x64_min_10s.txt --report 64x64_min_10s.json > 64x64_min_10s.txt
+solver.exe --bench --time 10 --list input/96x64_list.txt --baseline bench/96x64_min_10s.txt --report 96x64_min_10s.json > 96x64_min_10s.txt
+solver.exe --bench --time 10 --list input/96x96_list.txt --baseline bench/96x96_min_10s.txt --report 96x96_min_10s.json > 96x96_min_10s.txt
+solver.exe --bench --time 10 --list input/128x128_list.txt --baseline bench/128x128_min_10s.txt --report 128x128_min_10s.json > 128x128_min_10s.txt
\ No newline at end of file
@@ -1 +1 @@
-g++ solver.cpp -o solver.exe -std=c++17
\ No newline at end of file
+g++ solver.cpp -o solver.exe -std=c++17 -pthread
\ No newline at end of file
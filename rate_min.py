@@ -111,7 +111,7 @@ def check(problem_filename, solution, max_moves):
     pr["N"] = max_moves
     return judge.spr(pr, solution.strip())
 
-def min_moves(solvername, name, timeout, a):
+def min_moves(solvername, name, timeout, a, cache):
     best = 9999
     r = 'BRAK'
     while True:
@@ -120,7 +120,11 @@ def min_moves(solvername, name, timeout, a):
         start = time.time()
         max_moves = best - 1
         try:
-            result = subprocess.run([solvername, str(max_moves)], stdout=subprocess.PIPE, stdin=open(infile), timeout=timeout)
+            # the solver stops by itself within the time limit, the timeout is only a safeguard
+            args = [solvername, str(max_moves), '--time', str(timeout)]
+            if cache:
+                args += ['--cache', cache]
+            result = subprocess.run(args, stdout=subprocess.PIPE, stdin=open(infile), timeout=timeout + 1)
         except subprocess.SubprocessError:
             break
         end = time.time()
@@ -153,10 +157,12 @@ def main():
     filename = sys.argv[2]
     timeout = int(sys.argv[3]) # seconds
     a = bool(sys.argv[4])
+    # optional directory for the solver's preprocessing cache, so only the first run on each level preprocesses it
+    cache = sys.argv[5] if len(sys.argv) > 5 else None
     total = 0
     with open(filename) as file:
         for line in file:
-            total += min_moves(solvername, line.strip(), timeout, a)
+            total += min_moves(solvername, line.strip(), timeout, a, cache)
             print('')
 
     print('Total: {}'.format(total))
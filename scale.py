@@ -0,0 +1,83 @@
+import os
+import sys
+import json
+import subprocess
+import tempfile
+
+# usage: python scale.py solver.exe time_per_level [sizes...]
+# generates one board for each size, solves it once and reports
+# time of each phase and peak memory against the board size
+# writes scale.csv and, if matplotlib is available, scale.png
+
+default_sizes = [16, 32, 64, 96, 128, 160, 192, 256, 384, 512, 768, 1024]
+phases = ['moves', 'distances', 'sccs', 'cah', 'potential', 'search']
+
+def generate(solvername, size, filename):
+    with open(filename, 'w') as file:
+        subprocess.run([solvername, '--generate', str(size), str(size), '--seed', str(size)], stdout=file, check=True)
+
+def run(args):
+    # returns peak memory of the process in MiB, None if it can't be measured
+    process = subprocess.Popen(args, stdout=subprocess.DEVNULL)
+    if hasattr(os, 'wait4'):
+        _, _, usage = os.wait4(process.pid, 0)
+        # ru_maxrss is in KiB on linux
+        return usage.ru_maxrss / 1024
+    process.wait()
+    return None
+
+def measure(solvername, size, timeout, directory):
+    level_filename = os.path.join(directory, '{}x{}.txt'.format(size, size))
+    report_filename = os.path.join(directory, '{}x{}.json'.format(size, size))
+    generate(solvername, size, level_filename)
+    memory = run([solvername, '--bench', '--attempts', '1', '--time', str(timeout), '--report', report_filename, level_filename])
+    with open(report_filename) as file:
+        level = json.load(file)['levels'][0]
+    return level, memory
+
+def plot(rows):
+    try:
+        import matplotlib
+        matplotlib.use('Agg')
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print('matplotlib not available, skipping plot')
+        return
+
+    sizes = [row['size'] for row in rows]
+    fig, (time_axes, memory_axes) = plt.subplots(1, 2, figsize=(12, 5))
+    for phase in phases:
+        time_axes.plot(sizes, [row['phases'].get(phase, 0.0) for row in rows], marker='o', label=phase)
+    time_axes.set_xlabel('board size')
+    time_axes.set_ylabel('time [s]')
+    time_axes.set_yscale('log')
+    time_axes.legend()
+    memory_axes.plot(sizes, [row['memory'] or 0.0 for row in rows], marker='o')
+    memory_axes.set_xlabel('board size')
+    memory_axes.set_ylabel('peak memory [MiB]')
+    fig.savefig('scale.png')
+
+def main():
+    solvername = sys.argv[1]
+    timeout = float(sys.argv[2])
+    sizes = [int(s) for s in sys.argv[3:]] or default_sizes
+
+    rows = []
+    with tempfile.TemporaryDirectory() as directory:
+        with open('scale.csv', 'w') as csv:
+            csv.write('size,status,moves,wall_time,' + ','.join(phase + '_time' for phase in phases) + ',memory_mib\n')
+            for size in sizes:
+                level, memory = measure(solvername, size, timeout, directory)
+                row = { 'size': size, 'phases': level['phases'], 'memory': memory }
+                rows.append(row)
+                line = '{},{},{},{:.3f},{},{}'.format(
+                    size, level['status'], level['moves'], level['wallTime'],
+                    ','.join('{:.3f}'.format(level['phases'].get(phase, 0.0)) for phase in phases),
+                    '' if memory is None else '{:.1f}'.format(memory))
+                csv.write(line + '\n')
+                csv.flush()
+                print(line)
+
+    plot(rows)
+
+main()
@@ -14,22 +14,69 @@
 #include <set>
 #include <cstdlib>
 #include <numeric>
+#include <bitset>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <deque>
+#include <map>
+#include <optional>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <tuple>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace apto
 {
     using PotentialType = std::uint8_t;
     using TotalPotentialType = std::uint32_t;
     using DistanceType = std::uint16_t;
-    using NodeId = std::int16_t;
-    using JewelId = std::int16_t;
-    using SccId = std::int16_t;
-    using MoveId = std::int16_t;
     using CoordsValueType = std::int16_t;
 
-    constexpr NodeId invalidNodeId = -1;
-    constexpr JewelId invalidJewelId = -1;
-    constexpr SccId invalidSccId = -1;
-    constexpr MoveId invalidMoveId = -1;
+    // integer types of the identifiers of graph elements, the solver is instantiated with one of them.
+    // narrow ids keep the per node, per move and per jewel tables small and are enough
+    // for all but huge open levels, see Solver::fitsNarrowIndices
+    struct NarrowIndexPolicy
+    {
+        using NodeId = std::int16_t;
+        using JewelId = std::int16_t;
+        using SccId = std::int16_t;
+        using MoveId = std::int16_t;
+
+        static constexpr NodeId invalidNodeId = -1;
+        static constexpr JewelId invalidJewelId = -1;
+        static constexpr SccId invalidSccId = -1;
+        static constexpr MoveId invalidMoveId = -1;
+    };
+
+    struct WideIndexPolicy
+    {
+        using NodeId = std::int32_t;
+        using JewelId = std::int32_t;
+        using SccId = std::int32_t;
+        using MoveId = std::int32_t;
+
+        static constexpr NodeId invalidNodeId = -1;
+        static constexpr JewelId invalidJewelId = -1;
+        static constexpr SccId invalidSccId = -1;
+        static constexpr MoveId invalidMoveId = -1;
+    };
 
     constexpr int abs(int v)
     {
@@ -601,6 +648,12 @@ namespace apto
             return fromId((toId(dir) + 4) % 8);
         }
 
+        // mirror image across the north-south axis
+        static Direction mirrored(Direction dir)
+        {
+            return fromId((8 - toId(dir)) % 8);
+        }
+
         static bool areOpposite(Direction d1, Direction d2)
         {
             const int diff = toId(d1) - toId(d2);
@@ -733,6 +786,23 @@ namespace apto
             return true;
         }
 
+        // FNV-1a over the dimensions and all cells, vehicle included
+        std::uint64_t hash() const
+        {
+            std::uint64_t h = 14695981039346656037ull;
+            auto combine = [&h](std::uint64_t v) {
+                h ^= v;
+                h *= 1099511628211ull;
+            };
+
+            combine(width());
+            combine(height());
+            forEach([&combine](const CellType& cell, int x, int y) {
+                combine(static_cast<std::uint64_t>(cell));
+                });
+            return h;
+        }
+
         Coords2 vehicleCoords() const
         {
             Coords2 coords(-1, -1);
@@ -834,18 +904,33 @@ namespace apto
     template <typename T>
     T read(std::istream & in);
 
+    // sets failbit on a malformed header or a truncated board, the level returned then is empty
     template <>
     Level read(std::istream & in)
     {
-        int width, height, maxMoves;
+        int width = 0;
+        int height = 0;
+        int maxMoves = 0;
         in >> height >> width >> maxMoves;
+        if (!in || width <= 0 || height <= 0)
+        {
+            in.setstate(std::ios::failbit);
+            return Level(Board(0, 0), 0);
+        }
+
         Board board(width, height);
 
         for (int y = 0; y < height; ++y)
         {
             for (int x = 0; x < width;)
             {
-                char c = in.get();
+                const int c = in.get();
+                if (c == std::char_traits<char>::eof())
+                {
+                    in.setstate(std::ios::failbit);
+                    return Level(Board(0, 0), 0);
+                }
+
                 CellType cell = CellTypeHelper::fromChar(c);
                 if (cell == CellType::Invalid)
                 {
@@ -865,7 +950,7 @@ namespace apto
         const int width = level.width();
         const int height = level.height();
 
-        out << height << ' ' << width << ' ' << level.maxMoves() << '\n';
+        out << height << ' ' << width << '\n' << level.maxMoves() << '\n';
         for (int y = 0; y < height; ++y)
         {
             for (int x = 0; x < width; ++x)
@@ -963,6 +1048,18 @@ namespace apto
             return !other.exists() || size() < other.size();
         }
 
+        // FNV-1a over the directions
+        std::uint64_t hash() const
+        {
+            std::uint64_t h = 14695981039346656037ull;
+            for (Direction dir : m_moves)
+            {
+                h ^= static_cast<std::uint64_t>(dir);
+                h *= 1099511628211ull;
+            }
+            return h;
+        }
+
         // replacement must not be longer than length
         void replace(int start, int length, const std::vector<Direction>& replacement)
         {
@@ -1003,12 +1100,138 @@ namespace apto
         }
     }
 
-    struct JewelState
+    enum struct SolutionStatus : std::uint8_t
+    {
+        Ok,
+        TooLong,
+        Mine,
+        JewelsLeft
+    };
+
+    struct SolutionStatusHelper
+    {
+        // same names as used by rate_min.py
+        static const char* toString(SolutionStatus status)
+        {
+            switch (status)
+            {
+            case SolutionStatus::Ok:
+                return "OK";
+            case SolutionStatus::TooLong:
+                return "TOO_LONG";
+            case SolutionStatus::Mine:
+                return "MINE";
+            case SolutionStatus::JewelsLeft:
+                return "JEWELS_LEFT";
+            }
+            return "";
+        }
+    };
+
+    int popcount(std::uint64_t v)
+    {
+        return static_cast<int>(std::bitset<64>(v).count());
+    }
+
+    // index of the only set bit of v
+    int bitIndex(std::uint64_t v)
+    {
+        return popcount(v - 1);
+    }
+
+    // packed set of jewels, only the 64 bit words with at least one jewel are stored
+    // so a move that crosses a few jewels of a huge level stays small.
+    // The lowest word is kept inline, so masks of levels with up to 64 jewels never allocate
+    struct JewelMask
+    {
+        static constexpr int bitsPerWord = 64;
+
+        struct Word
+        {
+            int index;
+            std::uint64_t bits;
+        };
+
+        JewelMask() :
+            m_first{ 0, 0 },
+            m_rest{}
+        {
+        }
+
+        template <typename JewelIdT>
+        JewelMask(const std::vector<JewelIdT>& jewels) :
+            JewelMask()
+        {
+            for (const int jewelId : jewels)
+            {
+                add(jewelId);
+            }
+        }
+
+        void add(int jewelId)
+        {
+            const int index = jewelId / bitsPerWord;
+            const std::uint64_t bit = std::uint64_t(1) << (jewelId % bitsPerWord);
+
+            if (m_first.bits == 0 || m_first.index == index)
+            {
+                m_first.index = index;
+                m_first.bits |= bit;
+                return;
+            }
+
+            Word word{ index, bit };
+            if (index < m_first.index)
+            {
+                std::swap(word, m_first);
+            }
+
+            auto it = std::lower_bound(std::begin(m_rest), std::end(m_rest), word.index, [](const Word& other, int index) {
+                return other.index < index;
+                });
+            if (it != std::end(m_rest) && it->index == word.index)
+            {
+                it->bits |= word.bits;
+            }
+            else
+            {
+                m_rest.insert(it, word);
+            }
+        }
+
+        // func(const Word&) for the stored words in increasing order of index
+        template <typename FuncT>
+        void forEachWord(FuncT&& func) const
+        {
+            if (m_first.bits == 0)
+            {
+                return;
+            }
+
+            func(m_first);
+            for (const Word& word : m_rest)
+            {
+                func(word);
+            }
+        }
+
+    private:
+        Word m_first;
+        std::vector<Word> m_rest;
+    };
+
+    template <typename IndexPolicyT>
+    struct BasicJewelState
     {
-        JewelState(int numJewels) :
+        using JewelId = typename IndexPolicyT::JewelId;
+        using MoveId = typename IndexPolicyT::MoveId;
+
+        BasicJewelState(int numJewels) :
             m_numCollected(numJewels, 0),
-            m_isCollectible(numJewels, true),
-            m_numLeft(numJewels)
+            m_isCollected((numJewels + JewelMask::bitsPerWord - 1) / JewelMask::bitsPerWord, 0),
+            m_numLeft(numJewels),
+            m_isJournaling(false),
+            m_journal{}
         {
         }
 
@@ -1022,13 +1245,52 @@ namespace apto
             return m_numCollected[i] > 0;
         }
 
+        int numUncollected(const JewelMask& mask) const
+        {
+            int n = 0;
+            mask.forEachWord([&](const JewelMask::Word& word) {
+                n += popcount(word.bits & ~m_isCollected[word.index]);
+                });
+            return n;
+        }
+
+        // smallest id >= i of a jewel that is not collected, numJewels() if there is none
+        int nextUncollected(int i) const
+        {
+            const int numWords = m_isCollected.size();
+
+            int index = i / JewelMask::bitsPerWord;
+            if (index >= numWords)
+            {
+                return numJewels();
+            }
+
+            // bits past the last jewel are never set so they look uncollected, hence the min at the end
+            std::uint64_t bits = ~m_isCollected[index] & (~std::uint64_t(0) << (i % JewelMask::bitsPerWord));
+            while (bits == 0)
+            {
+                if (++index == numWords)
+                {
+                    return numJewels();
+                }
+                bits = ~m_isCollected[index];
+            }
+
+            return std::min(index * JewelMask::bitsPerWord + bitIndex(bits & (~bits + 1)), numJewels());
+        }
+
         // returns true only of the real collected/uncollected state changed
         bool addToCollected(int i)
         {
+            if (m_isJournaling)
+            {
+                m_journal.push_back(Change{ static_cast<JewelId>(i), true });
+            }
+
             m_numCollected[i] += 1;
             if (m_numCollected[i] == 1)
             {
-                m_isCollectible[i] = false;
+                m_isCollected[i / JewelMask::bitsPerWord] |= bit(i);
                 --m_numLeft;
                 return true;
             }
@@ -1038,10 +1300,15 @@ namespace apto
         // returns true only of the real collected/uncollected state changed
         bool removeFromCollected(int i)
         {
+            if (m_isJournaling)
+            {
+                m_journal.push_back(Change{ static_cast<JewelId>(i), false });
+            }
+
             m_numCollected[i] -= 1;
             if (m_numCollected[i] == 0)
             {
-                m_isCollectible[i] = true;
+                m_isCollected[i / JewelMask::bitsPerWord] &= ~bit(i);
                 ++m_numLeft;
                 return true;
             }
@@ -1059,12 +1326,52 @@ namespace apto
 
             for (int i = 0; i < numJewels; ++i)
             {
+                if (m_isJournaling)
+                {
+                    for (int j = 0; j < m_numCollected[i]; ++j)
+                    {
+                        m_journal.push_back(Change{ static_cast<JewelId>(i), false });
+                    }
+                }
+
                 m_numCollected[i] = 0;
-                m_isCollectible[i] = true;
             }
+            std::fill(std::begin(m_isCollected), std::end(m_isCollected), 0);
             m_numLeft = numJewels;
         }
 
+        // from now on all changes are recorded so they can be undone in time proportional to their number
+        void beginJournal()
+        {
+            m_isJournaling = true;
+            m_journal.clear();
+        }
+
+        // keeps the changes made since beginJournal
+        void commitJournal()
+        {
+            m_isJournaling = false;
+            m_journal.clear();
+        }
+
+        // undoes the changes made since beginJournal
+        void rollbackJournal()
+        {
+            m_isJournaling = false;
+            for (auto it = m_journal.rbegin(); it != m_journal.rend(); ++it)
+            {
+                if (it->isAdded)
+                {
+                    removeFromCollected(it->jewelId);
+                }
+                else
+                {
+                    addToCollected(it->jewelId);
+                }
+            }
+            m_journal.clear();
+        }
+
         int numJewels() const
         {
             return m_numCollected.size();
@@ -1073,27 +1380,48 @@ namespace apto
     private:
         // one move can only pick up one jewel so MoveId type gives us enough storage space
         std::vector<MoveId> m_numCollected;
-        std::vector<std::uint8_t> m_isCollectible;
+        // bit per jewel, set when its count is positive
+        std::vector<std::uint64_t> m_isCollected;
         int m_numLeft;
+
+        static std::uint64_t bit(int i)
+        {
+            return std::uint64_t(1) << (i % JewelMask::bitsPerWord);
+        }
+
+        struct Change
+        {
+            JewelId jewelId;
+            bool isAdded;
+        };
+
+        bool m_isJournaling;
+        std::vector<Change> m_journal;
     };
 
-    struct Move
+    template <typename IndexPolicyT>
+    struct BasicMove
     {
-        Move() = default;
+        using JewelId = typename IndexPolicyT::JewelId;
+        using MoveId = typename IndexPolicyT::MoveId;
+        using JewelState = BasicJewelState<IndexPolicyT>;
+
+        BasicMove() = default;
 
-        Move(int id, const Coords2& start, const Coords2& end, std::vector<JewelId> jewels) :
+        BasicMove(int id, const Coords2& start, const Coords2& end, std::vector<JewelId> jewels) :
             m_id(id),
             m_start(start),
             m_end(end),
-            m_jewels(std::move(jewels))
+            m_jewels(std::move(jewels)),
+            m_jewelMask(m_jewels)
         {
         }
 
-        Move(const Move&) = default;
-        Move(Move&&) = default;
+        BasicMove(const BasicMove&) = default;
+        BasicMove(BasicMove&&) = default;
 
-        Move& operator=(const Move&) = default;
-        Move& operator=(Move&&) = default;
+        BasicMove& operator=(const BasicMove&) = default;
+        BasicMove& operator=(BasicMove&&) = default;
 
         int id() const
         {
@@ -1115,17 +1443,14 @@ namespace apto
             return m_jewels;
         }
 
+        const JewelMask& jewelMask() const
+        {
+            return m_jewelMask;
+        }
+
         int numUncollectedJewelsOnTheWay(const JewelState& jewelState) const
         {
-            int i = 0;
-            for (int jewel : m_jewels)
-            {
-                if (!jewelState.isCollected(jewel))
-                {
-                    ++i;
-                }
-            }
-            return i;
+            return jewelState.numUncollected(m_jewelMask);
         }
 
         Direction direction() const
@@ -1138,20 +1463,30 @@ namespace apto
             m_id = id;
         }
 
+        void setJewels(std::vector<JewelId> jewels)
+        {
+            m_jewels = std::move(jewels);
+            m_jewelMask = JewelMask(m_jewels);
+        }
+
     private:
         Coords2 m_start;
         Coords2 m_end;
         MoveId m_id;
         std::vector<JewelId> m_jewels;
+        JewelMask m_jewelMask;
     };
 
-    struct Moves
+    template <typename IndexPolicyT>
+    struct BasicMoves
     {
-        Moves() = default;
+        using Move = BasicMove<IndexPolicyT>;
+
+        BasicMoves() = default;
 
-        Moves(const Coords2& source)
+        BasicMoves(const Coords2& source)
         {
-            std::fill(std::begin(m_ends), std::end(m_ends), Move(invalidMoveId, source, source, {}));
+            std::fill(std::begin(m_ends), std::end(m_ends), Move(IndexPolicyT::invalidMoveId, source, source, {}));
         }
 
         Move& operator[](Direction dir)
@@ -1168,2438 +1503,7699 @@ namespace apto
         std::array<Move, 8> m_ends;
     };
 
-    struct Bench
+    // peak resident memory of the process so far in KiB, 0 if it can't be queried
+    std::uint64_t peakMemoryUsage()
     {
-        using time_point = typename std::chrono::high_resolution_clock::time_point;
-        using duration = typename time_point::duration;
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return counters.PeakWorkingSetSize / 1024;
+        }
+        return 0;
+#elif defined(__APPLE__)
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss / 1024;
+#elif defined(__unix__)
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+#else
+        return 0;
+#endif
+    }
 
-        Bench() :
-            m_numNodes(0),
-            m_start{},
-            m_end{}
+    // read only view of a whole file, empty if the file can't be opened or mapped
+    struct MappedFile
+    {
+        MappedFile(const std::string& filename) :
+            m_data(nullptr),
+            m_size(0)
         {
+#if defined(_WIN32)
+            m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            m_mapping = nullptr;
+            LARGE_INTEGER size;
+            if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+            {
+                return;
+            }
 
-        }
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (m_mapping == nullptr)
+            {
+                return;
+            }
 
-        void start()
-        {
-            m_start = std::chrono::high_resolution_clock::now();
-        }
+            m_data = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+            if (m_data != nullptr)
+            {
+                m_size = static_cast<std::size_t>(size.QuadPart);
+            }
+#elif defined(__unix__) || defined(__APPLE__)
+            const int fd = open(filename.c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                return;
+            }
 
-        void end()
-        {
-            m_end = std::chrono::high_resolution_clock::now();
-        }
+            struct stat status;
+            if (fstat(fd, &status) == 0 && status.st_size > 0)
+            {
+                void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED)
+                {
+                    m_data = static_cast<const char*>(data);
+                    m_size = status.st_size;
+                }
+            }
 
-        void node()
-        {
-            ++m_numNodes;
+            // the mapping stays valid after the descriptor is closed
+            close(fd);
+#endif
         }
 
-        duration elapsed() const
-        {
-            return m_end - m_start;
-        }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
 
-        duration elapsedToNow() const
+        ~MappedFile()
         {
-            return std::chrono::high_resolution_clock::now() - m_start;
+#if defined(_WIN32)
+            if (m_data != nullptr)
+            {
+                UnmapViewOfFile(m_data);
+            }
+            if (m_mapping != nullptr)
+            {
+                CloseHandle(m_mapping);
+            }
+            if (m_file != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(m_file);
+            }
+#elif defined(__unix__) || defined(__APPLE__)
+            if (m_data != nullptr)
+            {
+                munmap(const_cast<char*>(m_data), m_size);
+            }
+#endif
         }
 
-        std::uint64_t nodes() const
+        const char* data() const
         {
-            return m_numNodes;
+            return m_data;
         }
 
-        double nodesPerSecond() const
+        std::size_t size() const
         {
-            return m_numNodes / static_cast<double>(elapsed().count()) * 1e9;
+            return m_size;
         }
 
     private:
-        std::uint64_t m_numNodes;
-        time_point m_start;
-        time_point m_end;
+        const char* m_data;
+        std::size_t m_size;
+#if defined(_WIN32)
+        HANDLE m_file;
+        HANDLE m_mapping;
+#endif
     };
 
-    bool isPerfectSquare(int n)
+    // the preprocessed graph of a board is stored as this header followed by
+    // the distance matrix and the cah insertion candidates (before, then after), in native byte order.
+    // bump the version whenever the layout or the way any of them is computed changes
+    struct PreprocessingCacheHeader
     {
-        if (n == 0 || n == 1)
-        {
-            return true;
+        static constexpr std::uint32_t currentVersion = 2;
+
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t indexWidth;
+        std::uint64_t boardHash;
+        std::int32_t width;
+        std::int32_t height;
+        std::int32_t numNodes;
+        std::int32_t numDistanceColumns;
+        std::int32_t numCandidates;
+
+        bool operator==(const PreprocessingCacheHeader& other) const
+        {
+            return std::memcmp(magic, other.magic, sizeof(magic)) == 0
+                && version == other.version
+                && indexWidth == other.indexWidth
+                && boardHash == other.boardHash
+                && width == other.width
+                && height == other.height
+                && numNodes == other.numNodes
+                && numDistanceColumns == other.numDistanceColumns
+                && numCandidates == other.numCandidates;
         }
+    };
 
-        for (int i = 0; i < n / 2; ++i)
+    enum struct Counter : std::uint8_t
+    {
+        CahIterations,
+        ValidCahSolutions,
+        Opt3Improvements,
+        OrOptImprovements,
+        TwoOptImprovements,
+        VariableDepthImprovements,
+        RunRemovals,
+        MemeticGenerations,
+        MemeticImprovements,
+        LnsIterations,
+        LnsImprovements,
+        Count
+    };
+
+    struct CounterHelper
+    {
+        static const char* toString(Counter counter)
         {
-            int x = i * i;
-            if (x == n)
-            {
-                return true;
-            }
-            else if (n < x)
+            switch (counter)
             {
-                return false;
+            case Counter::CahIterations:
+                return "cahIterations";
+            case Counter::ValidCahSolutions:
+                return "validCahSolutions";
+            case Counter::Opt3Improvements:
+                return "opt3Improvements";
+            case Counter::OrOptImprovements:
+                return "orOptImprovements";
+            case Counter::TwoOptImprovements:
+                return "twoOptImprovements";
+            case Counter::VariableDepthImprovements:
+                return "variableDepthImprovements";
+            case Counter::RunRemovals:
+                return "runRemovals";
+            case Counter::MemeticGenerations:
+                return "memeticGenerations";
+            case Counter::MemeticImprovements:
+                return "memeticImprovements";
+            case Counter::LnsIterations:
+                return "lnsIterations";
+            case Counter::LnsImprovements:
+                return "lnsImprovements";
+            case Counter::Count:
+                break;
             }
+            return "";
         }
+    };
 
-        return false;
-    }
+    // how moves are picked for removal from a jewel tour
+    enum struct TourRuin : std::uint8_t
+    {
+        // a random sample
+        Random,
+        // consecutive moves
+        Segment,
+        // the ones making the longest detours
+        WorstCost,
+        // the ones starting closest to a random one
+        Spatial,
+        // a random sample starting in the scc of a random one
+        Scc,
+        Count
+    };
 
-    struct Logger
+    enum struct Cutoff : std::uint8_t
     {
-        static constexpr bool enabled = false;
+        // potential below pruningFactor of the best move
+        Pruning,
+        // no progress since the last visit of the move end
+        Revisit,
+        // probabilistic skip
+        Skip,
+        // the move leads to an scc from which some jewel is unreachable
+        Scc,
+        // out of moves
+        Horizon,
+        Count
+    };
 
-        template <typename ArgT, typename... ArgTs>
-        void log(ArgT&& arg, ArgTs&& ... args)
+    struct CutoffHelper
+    {
+        static const char* toString(Cutoff cutoff)
         {
-            if (!enabled)
+            switch (cutoff)
             {
-                return;
+            case Cutoff::Pruning:
+                return "pruning";
+            case Cutoff::Revisit:
+                return "revisit";
+            case Cutoff::Skip:
+                return "skip";
+            case Cutoff::Scc:
+                return "scc";
+            case Cutoff::Horizon:
+                return "horizon";
+            case Cutoff::Count:
+                break;
             }
-
-            (*m_stream) << arg;
-            log(std::forward<ArgTs>(args)...);
+            return "";
         }
+    };
 
-        template <typename ArgT>
-        void log(ArgT&& arg)
+    // per depth statistics of the backtracking search
+    struct SearchStatistics
+    {
+        // depths are grouped so the histogram has at most this many rows
+        static constexpr int maxHistogramRows = 64;
+
+        SearchStatistics() :
+            m_atDepth{},
+            m_numFallbacks(0)
         {
-            if (!enabled)
-            {
-                return;
-            }
+        }
 
-            (*m_stream) << arg;
+        void node(int depth, int numBranches)
+        {
+            AtDepth& atDepth = at(depth);
+            atDepth.numNodes += 1;
+            atDepth.numBranches += numBranches;
         }
 
-    private:
-        std::ostream* m_stream = &std::cout;
-    };
+        void cutoff(int depth, Cutoff reason, int n = 1)
+        {
+            at(depth).numCutoffs[static_cast<int>(reason)] += n;
+        }
 
-    Logger g_logger;
-
-    struct Solver
-    {
-    private:
-
-        struct Scc
+        // the search jumped to the nearest uncollected jewel because the potential was uncertain
+        void fallback()
         {
-            SccId id;
-            std::vector<Coords2> nodes;
-            std::vector<const Move*> bridges;
-            std::vector<SccId> neighbours;
-            std::vector<SccId> predecessors;
-            std::vector<JewelId> jewels;
-        };
+            m_numFallbacks += 1;
+        }
 
-    public:
+        void writeHistogram(std::ostream& out) const
+        {
+            const int numDepths = static_cast<int>(m_atDepth.size());
+            const int bucketSize = std::max(1, (numDepths + maxHistogramRows - 1) / maxHistogramRows);
 
-        using RandomNumberGeneratorType = std::mt19937_64;
+            out << std::setw(11) << "depth" << std::setw(12) << "nodes" << std::setw(10) << "branching";
+            for (int i = 0; i < static_cast<int>(Cutoff::Count); ++i)
+            {
+                out << std::setw(12) << CutoffHelper::toString(static_cast<Cutoff>(i));
+            }
+            out << '\n';
 
-        // enable/disable checks for solution validity before commiting to it
-        static constexpr bool assumeCorrect = true;
+            AtDepth total{};
+            for (int first = 0; first < numDepths; first += bucketSize)
+            {
+                const int last = std::min(numDepths, first + bucketSize) - 1;
+                AtDepth bucket{};
+                for (int depth = first; depth <= last; ++depth)
+                {
+                    bucket += m_atDepth[depth];
+                }
+                total += bucket;
 
-        // there are two variants possible, either we can stop there later too or not
-        static constexpr bool isVehicleSpotAHole = false;
+                std::ostringstream range;
+                range << first;
+                if (last != first)
+                {
+                    range << '-' << last;
+                }
+                writeRow(out, range.str(), bucket);
+            }
+            writeRow(out, "total", total);
 
-        // how much the search space for opt3 moves increases with each iteration
-        static constexpr float opt3WindowIncreaseFactor = 4.0f;
+            out << "fallbacks to the nearest jewel: " << m_numFallbacks << '\n';
+        }
 
-        static constexpr int minimalOpt3WindowSize = 16;
+    private:
+        struct AtDepth
+        {
+            std::uint64_t numNodes;
+            std::uint64_t numBranches;
+            std::array<std::uint64_t, static_cast<int>(Cutoff::Count)> numCutoffs;
 
-        static constexpr auto maxTimeForStochasticHeuristic = std::chrono::seconds{ 1 };
+            AtDepth& operator+=(const AtDepth& rhs)
+            {
+                numNodes += rhs.numNodes;
+                numBranches += rhs.numBranches;
+                for (int i = 0; i < numCutoffs.size(); ++i)
+                {
+                    numCutoffs[i] += rhs.numCutoffs[i];
+                }
+                return *this;
+            }
+        };
 
-        static constexpr auto maxTimeForOpt3 = std::chrono::seconds{ 1 };
+        std::vector<AtDepth> m_atDepth;
+        std::uint64_t m_numFallbacks;
 
-        static constexpr std::uint64_t rngSeed = 12345;
+        AtDepth& at(int depth)
+        {
+            if (depth >= m_atDepth.size())
+            {
+                m_atDepth.resize(depth + 1, AtDepth{});
+            }
+            return m_atDepth[depth];
+        }
 
-        // starting potential of one jewel on one edge
-        static constexpr PotentialType maxPotential = std::numeric_limits<PotentialType>::max();
+        static void writeRow(std::ostream& out, const std::string& depth, const AtDepth& row)
+        {
+            const double branching = row.numNodes ? static_cast<double>(row.numBranches) / row.numNodes : 0.0;
+            out << std::setw(11) << depth << std::setw(12) << row.numNodes
+                << std::setw(10) << std::fixed << std::setprecision(2) << branching;
+            for (const std::uint64_t n : row.numCutoffs)
+            {
+                out << std::setw(12) << n;
+            }
+            out << '\n';
+        }
+    };
 
-        // if the best move has potential below this and we made a cycle during search
-        // then try going to the nearest jewel instead
-        static constexpr TotalPotentialType uncertainPotentialThreshold = 256;
+    struct Bench
+    {
+        using time_point = typename std::chrono::high_resolution_clock::time_point;
+        using duration = typename time_point::duration;
 
-        // we use probabilistic skipping in backtracking, this sets the minimal depth to use this strategy
-        static constexpr int minDepthToAllowSkip = 10;
+        // times one (possibly nested) part of the solving process while in scope
+        // does nothing when profiling is disabled
+        struct ScopedTimer
+        {
+            ScopedTimer(Bench* bench, int recordId) :
+                m_bench(bench),
+                m_recordId(recordId),
+                m_start(bench ? std::chrono::high_resolution_clock::now() : time_point{})
+            {
+            }
 
-        // we keep looking for solutions of length up to maxMoves * additionalMovesFactor
-        // but try to shorten ones longer than maxMoves before emmiting them as solutions
-        static constexpr float additionalMovesFactor = 0.3f;
+            ScopedTimer(const ScopedTimer&) = delete;
+            ScopedTimer& operator=(const ScopedTimer&) = delete;
 
-        // should be more than any possible distance on a valid board
-        static constexpr DistanceType infiniteDistance = std::numeric_limits<DistanceType>::max();
+            ~ScopedTimer()
+            {
+                if (m_bench)
+                {
+                    m_bench->endTimer(m_recordId, std::chrono::high_resolution_clock::now() - m_start);
+                }
+            }
 
-        // let a be the best potential of the best edge from a node
-        // if potential of the next edge is < a * pruningFactor then skip this edge
-        // should be kept in [0.5, 1]
-        // 0.5 means no pruning because the potential propagates with 0.5 saturation
-        static constexpr float pruningFactor = 0.5f;
+        private:
+            Bench* m_bench;
+            int m_recordId;
+            time_point m_start;
+        };
 
-        Solver(Level level, Bench& bench) :
-            m_rng(rngSeed),
-            m_level(std::move(level)),
-            m_jewelState(countJewels()),
-            m_bench(&bench),
+        Bench() :
+            m_numNodes(0),
+            m_start{},
+            m_end{},
+            m_phases{},
+            m_phaseStart{},
+            m_isInPhase(false),
+            m_isProfiling(false),
+            m_timerStack{},
+            m_timerRecords{},
+            m_counters{},
+            m_searchStatistics{},
+            m_lowerBound(-1)
+        {
 
-            m_vehicleCoords(m_level.vehicleCoords()),
-            m_jewelIdByPosition(m_level.width(), m_level.height(), invalidJewelId),
+        }
 
-            m_movesByPosition(m_level.width(), m_level.height()),
-            m_movesByEndPosition(m_level.width(), m_level.height()),
-            m_allMoves{},
-            m_movesCollectingJewel(numJewels()),
+        void start()
+        {
+            m_start = std::chrono::high_resolution_clock::now();
+        }
 
-            m_nodeIdByPosition(m_level.width(), m_level.height(), invalidNodeId),
-            m_nodePositionById{},
+        void end()
+        {
+            m_end = std::chrono::high_resolution_clock::now();
+            endPhase(m_end);
+        }
 
-            m_sccs{},
-            m_lastSccWithJewel{},
-            m_sccIdAt(m_level.width(), m_level.height(), invalidSccId),
-            m_numSccsWithJewel{}
+        // phases are consecutive, each one lasts until the next one begins or end() is called
+        void beginPhase(const char* name)
         {
+            const time_point now = std::chrono::high_resolution_clock::now();
+            endPhase(now);
+            m_phases.emplace_back(name, duration::zero());
+            m_phaseStart = now;
+            m_isInPhase = true;
         }
 
-        Solution solve()
+        const std::vector<std::pair<const char*, duration>>& phases() const
         {
-            if (numJewels() == 0)
-            {
-                m_bench->end();
-                return Solution::empty();
-            }
+            return m_phases;
+        }
 
-            identifyJewels();
-            g_logger.log("Recognized features\n");
+        void setProfiling(bool isProfiling)
+        {
+            m_isProfiling = isProfiling;
+        }
 
-            generateAllMoves();
-            g_logger.log("Generated moves\n");
+        bool isProfiling() const
+        {
+            return m_isProfiling;
+        }
 
-            if (!areAllJewelsReachable())
+        // adds timers and counters of a bench used by a helper thread,
+        // its top level timers become children of the currently running timer
+        void merge(const Bench& other)
+        {
+            for (int i = 0; i < static_cast<int>(Counter::Count); ++i)
             {
-                m_bench->end();
-                return Solution::invalid();
+                m_counters[i] += other.m_counters[i];
             }
 
-            computePairwiseNodeDistances();
-            g_logger.log("Characterized vertices\n");
-
-            identifySccs();
-            g_logger.log("Sccs identified\n");
-
-            assignJewelsToSccs();
-            g_logger.log("Jewels assigned to sccs\n");
-
-            fillSccConditionalUnreachability();
-            g_logger.log("Scc unreachability filled\n");
+            if (!m_isProfiling)
+            {
+                return;
+            }
 
-            printSccs();
+            const int parentId = m_timerStack.empty() ? -1 : m_timerStack.back();
+            std::vector<int> recordIds;
+            for (const TimerRecord& otherRecord : other.m_timerRecords)
+            {
+                // parents always come before their children
+                const int recordId = timerRecord(otherRecord.name, otherRecord.parentId < 0 ? parentId : recordIds[otherRecord.parentId]);
+                TimerRecord& record = m_timerRecords[recordId];
+                record.numCalls += otherRecord.numCalls;
+                record.time += otherRecord.time;
+                record.peakMemory = std::max(record.peakMemory, otherRecord.peakMemory);
+                recordIds.emplace_back(recordId);
+            }
+        }
 
-            if (!mayBeSolvable())
+        void setCollectingSearchStatistics(bool isCollecting)
+        {
+            if (isCollecting && !m_searchStatistics)
             {
-                m_bench->end();
-                g_logger.log("Unsolvable\n");
-                return Solution::invalid();
+                m_searchStatistics = std::make_unique<SearchStatistics>();
+            }
+            else if (!isCollecting)
+            {
+                m_searchStatistics.reset();
             }
+        }
 
-            m_bench->start();
+        // nullptr when not collected
+        SearchStatistics* searchStatistics()
+        {
+            return m_searchStatistics.get();
+        }
 
-            // https://www.researchgate.net/publication/307583744_The_Traveling_Purchaser_Problem_and_its_Variants p. 14
-            // http://www.fsa.ulaval.ca/personnel/renaudj/pdf/Recherche/tpp(purchaser)%20COR.pdf general
-            Solution cahSolution = lookForBestSolutionUsingCahHeuristicForTime(maxTimeForStochasticHeuristic);
-            g_logger.log("CAH: ", cahSolution.size(), '\n');
-            if (g_logger.enabled) write(cahSolution, std::cout);
-            g_logger.log("\n\n");
-            if (cahSolution.exists() && cahSolution.size() <= m_level.maxMoves())
+        // the name must outlive the bench, calls with the same name inside the same timer are summed
+        ScopedTimer scopedTimer(const char* name)
+        {
+            if (!m_isProfiling)
             {
-                m_bench->end();
-                return cahSolution;
+                return ScopedTimer(nullptr, -1);
             }
 
-            initializeSkipProbability();
+            return ScopedTimer(this, beginTimer(name));
+        }
 
-            initializeMovePotential();
-            g_logger.log("Initialized potential\n");
+        void count(Counter counter, std::uint64_t n = 1)
+        {
+            m_counters[static_cast<int>(counter)] += n;
+        }
 
-            fillInitialMovePotential();
-            g_logger.log("Filled initial potential\n");
+        std::uint64_t counter(Counter counter) const
+        {
+            return m_counters[static_cast<int>(counter)];
+        }
 
-            propagateMovePotential();
-            g_logger.log("Potential propagated\n");
+        // no solution of the level is shorter, -1 if it wasn't computed
+        void setLowerBound(int lowerBound)
+        {
+            m_lowerBound = lowerBound;
+        }
 
-            summarizeMovePotential();
-            g_logger.log("Potential summarized\n");
+        int lowerBound() const
+        {
+            return m_lowerBound;
+        }
 
-            // potential field guided search with backtracking
-            m_numJewelsLeftWhenSolvingAt = Array2<JewelId>(m_level.width(), m_level.height(), numJewels() + 1);
-            Solution solution = solveUsingSearchWithBacktracking(m_vehicleCoords, m_level.maxMoves() - 1, 0, m_level.maxMoves() * additionalMovesFactor);
-            if (solution.exists() && solution.size() <= m_level.maxMoves())
+        void writeProfile(std::ostream& out) const
+        {
+            out << "{\n  \"timers\": [";
+            for (int i = 0; i < m_timerRecords.size(); ++i)
             {
-                m_bench->end();
-                return solution;
+                const TimerRecord& record = m_timerRecords[i];
+                out << (i == 0 ? "\n" : ",\n")
+                    << "    {\"name\": \"" << record.name << "\""
+                    << ", \"parent\": \"" << (record.parentId < 0 ? "" : m_timerRecords[record.parentId].name) << "\""
+                    << ", \"calls\": " << record.numCalls
+                    << ", \"time\": " << std::fixed << std::setprecision(6) << std::chrono::duration<double>(record.time).count()
+                    << ", \"peakMemoryKiB\": " << record.peakMemory << "}";
             }
+            out << "\n  ],\n  \"counters\": {";
+            for (int i = 0; i < static_cast<int>(Counter::Count); ++i)
+            {
+                out << "\"" << CounterHelper::toString(static_cast<Counter>(i)) << "\": " << m_counters[i] << ", ";
+            }
+            out << "\"backtrackingNodes\": " << m_numNodes << "},\n"
+                << "  \"lowerBound\": " << m_lowerBound << ",\n"
+                << "  \"nodesPerSecond\": " << std::setprecision(0) << nodesPerSecond() << "\n}\n";
+        }
 
-            m_bench->end();
-
-            return Solution::invalid();
+        void node()
+        {
+            ++m_numNodes;
         }
 
-    private:
-        RandomNumberGeneratorType m_rng;
-        Level m_level;
-        JewelState m_jewelState;
-        Bench* m_bench;
+        duration elapsed() const
+        {
+            return m_end - m_start;
+        }
 
-        Coords2 m_vehicleCoords;
-        Array2<JewelId> m_jewelIdByPosition;
+        duration elapsedToNow() const
+        {
+            return std::chrono::high_resolution_clock::now() - m_start;
+        }
 
-        Array2<Moves> m_movesByPosition;
-        Array2<std::vector<const Move*>> m_movesByEndPosition;
-        std::vector<const Move*> m_allMoves;
-        std::vector<std::vector<const Move*>> m_movesCollectingJewel;
+        std::uint64_t nodes() const
+        {
+            return m_numNodes;
+        }
 
-        Array2<NodeId> m_nodeIdByPosition;
-        std::vector<Coords2> m_nodePositionById;
+        double nodesPerSecond() const
+        {
+            return m_numNodes / static_cast<double>(elapsed().count()) * 1e9;
+        }
 
-        Array2<DistanceType> m_distanceFromTo;
+    private:
+        std::uint64_t m_numNodes;
+        time_point m_start;
+        time_point m_end;
+        std::vector<std::pair<const char*, duration>> m_phases;
+        time_point m_phaseStart;
+        bool m_isInPhase;
+
+        struct TimerRecord
+        {
+            const char* name;
+            int parentId;
+            int numCalls;
+            duration time;
+            // process high-water mark when the timer last ended
+            std::uint64_t peakMemory;
+        };
 
-        std::vector<Scc> m_sccs;
-        std::vector<SccId> m_lastSccWithJewel; // topologically
-        Array2<SccId> m_sccIdAt;
-        Array2<bool> m_ifSccTraversedThenSccUnreachable;
-        std::vector<SccId> m_numSccsWithJewel;
+        bool m_isProfiling;
+        std::vector<int> m_timerStack;
+        std::vector<TimerRecord> m_timerRecords;
+        std::array<std::uint64_t, static_cast<int>(Counter::Count)> m_counters;
+        std::unique_ptr<SearchStatistics> m_searchStatistics;
+        int m_lowerBound;
 
-        Array2<JewelId> m_numJewelsLeftWhenSolvingAt;
+        int timerRecord(const char* name, int parentId)
+        {
+            for (int i = 0; i < m_timerRecords.size(); ++i)
+            {
+                if (m_timerRecords[i].parentId == parentId && std::string(m_timerRecords[i].name) == name)
+                {
+                    return i;
+                }
+            }
 
-        std::vector<float> m_skipProbabilityAtDepth;
+            m_timerRecords.push_back(TimerRecord{ name, parentId, 0, duration::zero(), 0 });
+            return static_cast<int>(m_timerRecords.size()) - 1;
+        }
 
-        // m_potential[jewelId][edgeId]
-        Array2<PotentialType> m_potentialOfJewelAtEdge;
+        int beginTimer(const char* name)
+        {
+            const int parentId = m_timerStack.empty() ? -1 : m_timerStack.back();
+            const int recordId = timerRecord(name, parentId);
+            m_timerStack.emplace_back(recordId);
+            return recordId;
+        }
 
-        // m_totalPotential[edgeId]
-        std::vector<TotalPotentialType> m_totalPotentialAtEdge;
+        void endTimer(int recordId, duration time)
+        {
+            m_timerStack.pop_back();
+            TimerRecord& record = m_timerRecords[recordId];
+            record.numCalls += 1;
+            record.time += time;
+            record.peakMemory = peakMemoryUsage();
+        }
 
-        // IMPORTANT:
-        // there seems to be a bug somewhere and not all solutions are correct
-        // thought it doesn't come up with any local test
-        // FIX LATER
-        bool isSolutionValid(const Solution& solution)
+        void endPhase(const time_point& now)
         {
-            if (assumeCorrect)
+            if (m_isInPhase)
             {
-                return true;
+                m_phases.back().second = now - m_phaseStart;
+                m_isInPhase = false;
             }
+        }
+    };
 
-            std::vector<std::uint8_t> isJewelCollected(numJewels(), false);
-            Coords2 pos = m_vehicleCoords;
-
-            for (Direction dir : solution)
+    bool isPerfectSquare(int n)
+    {
+        if (n == 0 || n == 1)
+        {
+            return true;
+        }
+
+        for (int i = 0; i < n / 2; ++i)
+        {
+            int x = i * i;
+            if (x == n)
+            {
+                return true;
+            }
+            else if (n < x)
             {
-                const Coords2 dpos = DirectionHelper::offset(dir);
+                return false;
+            }
+        }
 
-                for (;;)
-                {
-                    const Coords2 nextPos = pos + dpos;
+        return false;
+    }
 
-                    if (m_level[pos] == CellType::Invalid)
-                    {
-                        return false;
-                    }
+    struct Logger
+    {
+        static constexpr bool enabled = false;
 
-                    if (m_level[pos] == CellType::Jewel)
-                    {
-                        isJewelCollected[m_jewelIdByPosition[pos]] = true;
-                    }
+        template <typename ArgT, typename... ArgTs>
+        void log(ArgT&& arg, ArgTs&& ... args)
+        {
+            if (!enabled)
+            {
+                return;
+            }
 
-                    if (m_level[pos] == CellType::Mine)
-                    {
-                        return false;
-                    }
+            (*m_stream) << arg;
+            log(std::forward<ArgTs>(args)...);
+        }
 
-                    if (m_level[nextPos] == CellType::Wall)
-                    {
-                        break;
-                    }
+        template <typename ArgT>
+        void log(ArgT&& arg)
+        {
+            if (!enabled)
+            {
+                return;
+            }
 
-                    pos = nextPos;
+            (*m_stream) << arg;
+        }
 
-                    if (m_level[pos] == CellType::Hole || (m_level[pos] == CellType::Vehicle && isVehicleSpotAHole))
-                    {
-                        break;
-                    }
-                }
-            }
+    private:
+        std::ostream* m_stream = &std::cout;
+    };
+
+    Logger g_logger;
 
-            return std::all_of(std::begin(isJewelCollected), std::end(isJewelCollected), [](std::uint8_t v) {return v; });
+    // splits the total time available for solving among the parts of the solver.
+    // Cah, the memetic search and lns hand the rest of their time on once they stop improving,
+    // without a time limit every part gets a fixed time and the backtracking is unbounded
+    struct Scheduler
+    {
+        using clock = std::chrono::high_resolution_clock;
+        using time_point = clock::time_point;
+        using duration = clock::duration;
+
+        // kept free before the deadline for writing the output and releasing memory
+        static constexpr float safetyMarginFactor = 0.02f;
+        static constexpr auto minSafetyMargin = std::chrono::milliseconds{ 50 };
+        static constexpr auto maxSafetyMargin = std::chrono::milliseconds{ 200 };
+
+        // releasing the distance matrix of a huge board alone takes about 0.1 s per GB
+        static constexpr double releaseNanosecondsPerByte = 0.15;
+
+        // fractions of the time left after preprocessing
+        static constexpr float maxCahShare = 0.5f;
+        static constexpr float minCahShare = 0.15f;
+
+        // fractions of the time left when the memetic search, lns, annealing and opt3 start
+        static constexpr float maxMemeticShare = 0.5f;
+        static constexpr float minMemeticShare = 0.15f;
+        static constexpr float maxLnsShare = 0.4f;
+        static constexpr float minLnsShare = 0.1f;
+
+        // annealing cools down over its whole share and opt3 ends by itself once the pool is optimized
+        static constexpr float annealingShare = 0.3f;
+        static constexpr float opt3Share = 0.4f;
+
+        // the memetic search and lns measure their improvement per second over windows of this fraction of their max time.
+        // After the min share they stop once a window falls below this fraction of their rate since the start
+        static constexpr float improvementWindowShare = 0.1f;
+        static constexpr float minRelativeImprovementRate = 0.25f;
+
+        // cah stops after min share if it hasn't improved for
+        // this many times the time it took to find the last improvement
+        static constexpr float stagnationFactor = 1.0f;
+
+        // empirical cost of potential initialization and propagation per jewel per edge
+        static constexpr double potentialNanosecondsPerJewelEdge = 8.0;
+
+        // empirical costs of the cah candidate precompute and of the first cah construction per pair of nodes
+        static constexpr double cahCandidatesNanosecondsPerNodePair = 10.0;
+        static constexpr double cahConstructionNanosecondsPerNodePair = 8.0;
+
+        Scheduler(std::chrono::milliseconds timeLimit, duration unlimitedCahTime, duration unlimitedMemeticTime, duration unlimitedLnsTime, duration unlimitedAnnealingTime, duration unlimitedOpt3Time) :
+            m_isLimited(timeLimit != std::chrono::milliseconds::max()),
+            m_deadline(time_point::max()),
+            m_unlimitedCahTime(unlimitedCahTime),
+            m_unlimitedMemeticTime(unlimitedMemeticTime),
+            m_unlimitedLnsTime(unlimitedLnsTime),
+            m_unlimitedAnnealingTime(unlimitedAnnealingTime),
+            m_unlimitedOpt3Time(unlimitedOpt3Time),
+            m_cahStart{},
+            m_cahMinEnd{},
+            m_cahEnd{},
+            m_memetic{},
+            m_lns{},
+            m_annealingTime(duration::zero()),
+            m_annealingEnd{},
+            m_opt3End{}
+        {
+            if (m_isLimited)
+            {
+                const duration margin = std::clamp<duration>(
+                    std::chrono::duration_cast<duration>(timeLimit * safetyMarginFactor),
+                    minSafetyMargin,
+                    maxSafetyMargin);
+                m_deadline = clock::now() + timeLimit - margin;
+            }
         }
 
-        template <typename FuncT>
-        void forEachMoveInSolution(const Solution& solution, FuncT&& func) const
+        bool isLimited() const
         {
-            Coords2 start = m_vehicleCoords;
-            forEachMoveInSolution(std::begin(solution), std::end(solution), start, std::forward<FuncT>(func));
+            return m_isLimited;
         }
 
-        template <typename FuncT>
-        void forEachMoveInSolution(const std::vector<Direction>& solution, Coords2& start, FuncT&& func) const
+        // everything has to be done by now
+        const time_point& deadline() const
         {
-            forEachMoveInSolution(std::begin(solution), std::end(solution), start, std::forward<FuncT>(func));
+            return m_deadline;
         }
 
-        template <typename IterT, typename FuncT>
-        void forEachMoveInSolution(IterT begin, IterT end, Coords2& start, FuncT&& func) const
+        // called when the preprocessing is done and cah starts
+        void beginCah()
         {
-            while(begin != end)
+            m_cahStart = clock::now();
+            if (!m_isLimited)
             {
-                const auto& move = m_movesByPosition[start][*begin];
-
-                func(move, start);
-
-                start = move.endPos();
-                ++begin;
+                m_cahMinEnd = m_cahEnd = m_cahStart + m_unlimitedCahTime;
+                return;
             }
+
+            const duration left = remaining(m_cahStart);
+            m_cahMinEnd = m_cahStart + std::chrono::duration_cast<duration>(left * minCahShare);
+            m_cahEnd = m_cahStart + std::chrono::duration_cast<duration>(left * maxCahShare);
         }
 
-        bool opt3(std::vector<NodeId>& nodesInPath, std::vector<int>& successors, const std::vector<std::uint8_t>& isAnyImportantJewelOnThisEdge, int window) const
+        bool shouldStopCah(const time_point& lastImprovement) const
         {
-            // window parameter specifies the upper bound on how far the nodes being exchanged can be located to each other
-
-            // tries to lower the overall path length by trying out all possible non path reversing
-            // 3-opt moves http://akira.ruc.dk/~keld/research/LKH/LKH-2.0/DOC/LKH_REPORT.pdf p. 9
-
-            // we have to preserve order of traversing single moves so there is always one possibility
-            //   i    j    k
-            // 0 -> 1 -> 2 -> 3
-            // into
-            // 0 -> 2 -> 1 -> 3
-            //   i    j    k
-
-            const int totalLength = solutionThroughNodes(nodesInPath, successors).size();
-            int savedLength = 0;
-            bool anyImprovement = false;
-            for (int i0 = 0, i = 0; i0 + 5 < nodesInPath.size(); ++i0, i = successors[i])
+            const time_point now = clock::now();
+            if (now > m_cahEnd)
             {
-                if (totalLength - savedLength <= m_level.maxMoves())
-                {
-                    break;
-                }
+                return true;
+            }
 
-                if (isAnyImportantJewelOnThisEdge[i]) continue;
-                const int iStart = nodesInPath[i];
-                const int iEnd = nodesInPath[successors[i]];
-                const int iCost = m_distanceFromTo[iStart][iEnd];
+            return m_isLimited
+                && now > m_cahMinEnd
+                && now - lastImprovement > std::chrono::duration_cast<duration>((lastImprovement - m_cahStart) * stagnationFactor);
+        }
 
-                for (int j0 = i0 + 2, j = successors[successors[i]]; j0 + 3 < nodesInPath.size() && j0 < i0 + window; ++j0, j = successors[j])
-                {
-                    if (isAnyImportantJewelOnThisEdge[j]) continue;
-                    const int jStart = nodesInPath[j];
-                    const int jEnd = nodesInPath[successors[j]];
-                    const int jCost = m_distanceFromTo[jStart][jEnd];
+        // only on boards large enough for it, after cah
+        void beginMemetic()
+        {
+            m_memetic = beginAdaptive(minMemeticShare, maxMemeticShare, m_unlimitedMemeticTime);
+        }
 
-                    bool anyChange = false;
-                    for (int k0 = j0 + 2, k = successors[successors[j]]; k0 + 1 < nodesInPath.size() && k0 < j0 + window; ++k0, k = successors[k])
-                    {
-                        if (isAnyImportantJewelOnThisEdge[k]) continue;
+        // bestLength is the length of the best solution of the memetic search so far, max if there is none yet
+        bool shouldStopMemetic(int bestLength)
+        {
+            return shouldStopAdaptive(m_memetic, bestLength);
+        }
 
-                        const int kStart = nodesInPath[k];
-                        const int kEnd = nodesInPath[successors[k]];
-                        const int kCost = m_distanceFromTo[kStart][kEnd];
+        // also only on large boards, after the memetic search
+        void beginLns()
+        {
+            m_lns = beginAdaptive(minLnsShare, maxLnsShare, m_unlimitedLnsTime);
+        }
 
-                        const int iStartNew = iStart;
-                        const int iEndNew = jEnd;
-                        const int jStartNew = kStart;
-                        const int jEndNew = iEnd;
-                        const int kStartNew = jStart;
-                        const int kEndNew = kEnd;
+        bool shouldStopLns(int bestLength)
+        {
+            return shouldStopAdaptive(m_lns, bestLength);
+        }
 
-                        const int iCostNew = m_distanceFromTo[iStartNew][iEndNew];
-                        const int jCostNew = m_distanceFromTo[jStartNew][jEndNew];
-                        const int kCostNew = m_distanceFromTo[kStartNew][kEndNew];
-                        if (iCostNew == infiniteDistance || jCostNew == infiniteDistance || kCostNew == infiniteDistance)
-                        {
-                            continue;
-                        }
+        void beginAnnealing()
+        {
+            const time_point now = clock::now();
+            m_annealingTime = m_isLimited
+                ? std::chrono::duration_cast<duration>(remaining(now) * annealingShare)
+                : m_unlimitedAnnealingTime;
+            m_annealingEnd = now + m_annealingTime;
+        }
 
-                        const int cost = iCost + jCost + kCost;
-                        const int costNew = iCostNew + jCostNew + kCostNew;
-                        if (costNew < cost)
-                        {
-                            // exchange
-                            //g_logger.log(iStart, ' ', iEnd, ' ', jStart, ' ', jEnd, ' ', kStart, ' ', kEnd, ' ', cost, ' ', iCost, ' ', jCost, ' ', kCost, '\n');
-                            //g_logger.log(iStartNew, ' ', iEndNew, ' ', jStartNew, ' ', jEndNew, ' ', kStartNew, ' ', kEndNew, ' ', costNew, ' ', iCostNew, ' ', jCostNew, ' ', kCostNew, '\n');
-                            //g_logger.log(successors[i], ' ', successors[j], ' ', successors[k], '\n');
+        const time_point& annealingEnd() const
+        {
+            return m_annealingEnd;
+        }
 
-                            const int sj = successors[j];
-                            successors[j] = successors[k];
-                            successors[k] = successors[i];
-                            successors[i] = sj;
+        // the time saved by cah is given to opt3 and backtracking
+        void beginOpt3()
+        {
+            const time_point now = clock::now();
+            if (!m_isLimited)
+            {
+                m_opt3End = m_cahStart + m_unlimitedCahTime + (m_memetic.end - m_memetic.start) + (m_lns.end - m_lns.start) + m_annealingTime + m_unlimitedOpt3Time;
+                return;
+            }
 
-                            savedLength += cost - costNew;
-                            g_logger.log("opt3 ", i, ": ", totalLength - savedLength, '\n');
+            m_opt3End = now + std::chrono::duration_cast<duration>(remaining(now) * opt3Share);
+        }
 
-                            anyImprovement = true;
-                            anyChange = true;
-                            break;
-                        }
-                    }
-                    // we have to break to the outermost loop when a change is made
-                    // because it breaks for some reason otherwise
-                    // it's complex so invalidations happen when changing order of edges which causes problems
-                    if (anyChange) break;
-                }
+        const time_point& opt3End() const
+        {
+            return m_opt3End;
+        }
+
+        // moves the deadline earlier by the time it takes to free a large allocation
+        void reserveForRelease(std::size_t numBytes)
+        {
+            if (!m_isLimited)
+            {
+                return;
             }
 
-            return anyImprovement;
+            m_deadline -= std::chrono::duration_cast<duration>(std::chrono::nanoseconds(
+                static_cast<std::int64_t>(releaseNanosecondsPerByte * numBytes)));
         }
 
-        Solution solutionThroughNodes(const std::vector<NodeId>& nodes, const std::vector<int>& successors) const
+        // cah has nothing to return before its first construction is done,
+        // which on a cold cache comes after the candidate precompute
+        bool isWorthStartingCah(int numNodes, bool areCandidatesCached) const
         {
-            Solution solution = Solution::empty();
-            std::vector<Direction> pathBuffer;
-            for (int i = 0, j = 0; j + 1 < nodes.size(); ++j)
+            if (!m_isLimited)
             {
-                const int startNodeId = nodes[i];
-                const int endNodeId = nodes[successors[i]];
-                pathBuffer.clear();
-                shortestPathFromTo(m_nodePositionById[startNodeId], m_nodePositionById[endNodeId], pathBuffer);
-                solution.append(pathBuffer);
-                i = successors[i];
+                return true;
             }
-            return solution;
+
+            const double numNodePairs = static_cast<double>(numNodes) * numNodes;
+            const double nanosecondsPerNodePair = cahConstructionNanosecondsPerNodePair
+                + (areCandidatesCached ? 0.0 : cahCandidatesNanosecondsPerNodePair);
+            const auto estimatedTime = std::chrono::nanoseconds(
+                static_cast<std::int64_t>(nanosecondsPerNodePair * numNodePairs));
+            return remaining(clock::now()) > estimatedTime;
         }
 
-        Solution solutionThroughNodes(const std::vector<NodeId>& nodes) const
+        // backtracking needs the potential to be computed first
+        // there is no point starting it if there is no time left for the search itself
+        bool isWorthStartingBacktracking(int numJewels, int numEdges) const
         {
-            Solution solution = Solution::empty();
-            std::vector<Direction> pathBuffer;
-            for (int i = 0; i + 1 < nodes.size(); ++i)
+            if (!m_isLimited)
             {
-                const int startNodeId = nodes[i];
-                const int endNodeId = nodes[i + 1];
-                pathBuffer.clear();
-                shortestPathFromTo(m_nodePositionById[startNodeId], m_nodePositionById[endNodeId], pathBuffer);
-                solution.append(pathBuffer);
+                return true;
             }
-            return solution;
+
+            const auto estimatedPotentialTime = std::chrono::nanoseconds(
+                static_cast<std::int64_t>(potentialNanosecondsPerJewelEdge * numJewels * numEdges));
+            return remaining(clock::now()) > estimatedPotentialTime * 2;
         }
 
-        void solutionToNodeList(const Solution& solution, std::vector<NodeId>& nodesInPath, std::vector<std::uint8_t>& isAnyImportantJewelOnThisEdge) const
-        {
-            Coords2 c = m_vehicleCoords;
-            nodesInPath.emplace_back(m_nodeIdByPosition[c]);
-            std::vector<std::uint8_t> isJewelCollected(numJewels(), false);
-            forEachMoveInSolution(solution, [&](const Move & move, const Coords2 & pos) {
-                bool anyNewJewels = false;
-                for (const int jewelId : move.jewels())
-                {
-                    if (!isJewelCollected[jewelId])
-                    {
-                        isJewelCollected[jewelId] = true;
-                        anyNewJewels = true;
-                    }
-                }
+    private:
+        // time of an engine that stops early once its improvements slow down
+        struct AdaptiveBudget
+        {
+            time_point start;
+            time_point minEnd;
+            time_point end;
+
+            // the rate is measured from the first solution of the engine
+            time_point rateStart;
+            int rateStartLength;
+            time_point windowStart;
+            int windowStartLength;
+            bool isSlowingDown;
+        };
 
-                const int endNodeId = m_nodeIdByPosition[move.endPos()];
+        bool m_isLimited;
+        time_point m_deadline;
+        duration m_unlimitedCahTime;
+        duration m_unlimitedMemeticTime;
+        duration m_unlimitedLnsTime;
+        duration m_unlimitedAnnealingTime;
+        duration m_unlimitedOpt3Time;
+        time_point m_cahStart;
+        time_point m_cahMinEnd;
+        time_point m_cahEnd;
+        AdaptiveBudget m_memetic;
+        AdaptiveBudget m_lns;
+        duration m_annealingTime;
+        time_point m_annealingEnd;
+        time_point m_opt3End;
 
-                nodesInPath.emplace_back(endNodeId);
-                isAnyImportantJewelOnThisEdge.emplace_back(anyNewJewels);
-            });
+        duration remaining(const time_point& now) const
+        {
+            return std::max(duration::zero(), m_deadline - now);
         }
 
-        void solutionToCoalescedNodeList(const Solution& solution, std::vector<NodeId>& nodesInPathCoalesced, std::vector<std::uint8_t>& isAnyImportantJewelOnThisEdgeCoalesced) const
+        AdaptiveBudget beginAdaptive(float minShare, float maxShare, duration unlimitedTime) const
         {
-            std::vector<NodeId> nodesInPath;
-            std::vector<std::uint8_t> isAnyImportantJewelOnThisEdge;
-            solutionToNodeList(solution, nodesInPath, isAnyImportantJewelOnThisEdge);
-
-            nodesInPathCoalesced.emplace_back(m_nodeIdByPosition[m_vehicleCoords]);
-            for (int i = 0; i + 1 < isAnyImportantJewelOnThisEdge.size(); ++i)
+            AdaptiveBudget budget{};
+            budget.start = clock::now();
+            if (m_isLimited)
             {
-                if (isAnyImportantJewelOnThisEdge[i] || isAnyImportantJewelOnThisEdge[i + 1])
-                {
-                    nodesInPathCoalesced.emplace_back(nodesInPath[i + 1]);
-                    isAnyImportantJewelOnThisEdgeCoalesced.emplace_back(isAnyImportantJewelOnThisEdge[i]);
-                }
+                const duration left = remaining(budget.start);
+                budget.minEnd = budget.start + std::chrono::duration_cast<duration>(left * minShare);
+                budget.end = budget.start + std::chrono::duration_cast<duration>(left * maxShare);
             }
-            nodesInPathCoalesced.emplace_back(nodesInPath.back());
-            isAnyImportantJewelOnThisEdgeCoalesced.emplace_back(isAnyImportantJewelOnThisEdge.back());
+            else
+            {
+                budget.minEnd = budget.end = budget.start + unlimitedTime;
+            }
+            budget.rateStartLength = std::numeric_limits<int>::max();
+            budget.isSlowingDown = false;
+            return budget;
         }
 
-        void opt3(Solution & solution) const
+        static bool shouldStopAdaptive(AdaptiveBudget& budget, int bestLength)
         {
-            // prepares the date structure
-            // does 3-opt moves until the solution is good enough or no improvement can be made
-            // uses ever increasing window size of searching to converge faster to nearly
-            // maximally improved solution. Gives an advantage on very big boards (>100x100) where one whole iteration takes too long.
-
-            std::vector<NodeId> nodesInPathCoalesced;
-            std::vector<std::uint8_t> isAnyImportantJewelOnThisEdgeCoalesced;
-            solutionToCoalescedNodeList(solution, nodesInPathCoalesced, isAnyImportantJewelOnThisEdgeCoalesced);
-
-            std::vector<int> successors(nodesInPathCoalesced.size());
-            std::iota(std::begin(successors), std::end(successors), 1);
+            using seconds = std::chrono::duration<double>;
 
-            int window = std::max(minimalOpt3WindowSize, static_cast<int>(std::sqrt(nodesInPathCoalesced.size())));
-            int tries = 0;
-            while (solution.size() > m_level.maxMoves())
+            const time_point now = clock::now();
+            if (now > budget.end)
             {
-                if (!opt3(nodesInPathCoalesced, successors, isAnyImportantJewelOnThisEdgeCoalesced, window))
-                {
+                return true;
+            }
+
+            if (bestLength == std::numeric_limits<int>::max())
+            {
+                return false;
+            }
+
+            if (budget.rateStartLength == std::numeric_limits<int>::max())
+            {
+                budget.rateStart = budget.windowStart = now;
+                budget.rateStartLength = budget.windowStartLength = bestLength;
+                return false;
+            }
+
+            if (now - budget.windowStart >= std::chrono::duration_cast<duration>((budget.end - budget.start) * improvementWindowShare))
+            {
+                const double windowRate = (budget.windowStartLength - bestLength) / seconds(now - budget.windowStart).count();
+                const double rate = (budget.rateStartLength - bestLength) / seconds(now - budget.rateStart).count();
+                budget.isSlowingDown = windowRate <= 0.0 || windowRate < rate * minRelativeImprovementRate;
+                budget.windowStart = now;
+                budget.windowStartLength = bestLength;
+            }
+
+            return now > budget.minEnd && budget.isSlowingDown;
+        }
+    };
+
+    // shared by the post-optimizers working on the same level, possibly on different threads
+    // each thread has its own bench, they are merged when the threads finish
+    struct PostOptimizationContext
+    {
+        Bench& bench;
+        Bench::time_point until;
+        const std::atomic<bool>& isCancelled;
+
+        // how many threads one post-optimizer can use
+        int numThreads;
+
+        // either out of time or some other thread found a short enough solution
+        bool shouldStop() const
+        {
+            return isCancelled.load(std::memory_order_relaxed) || std::chrono::high_resolution_clock::now() > until;
+        }
+    };
+
+    template <typename IndexPolicyT>
+    struct BasicSolver
+    {
+    public:
+        using NodeId = typename IndexPolicyT::NodeId;
+        using JewelId = typename IndexPolicyT::JewelId;
+        using SccId = typename IndexPolicyT::SccId;
+        using MoveId = typename IndexPolicyT::MoveId;
+
+        using JewelState = BasicJewelState<IndexPolicyT>;
+        using Move = BasicMove<IndexPolicyT>;
+        using Moves = BasicMoves<IndexPolicyT>;
+
+        static constexpr NodeId invalidNodeId = IndexPolicyT::invalidNodeId;
+        static constexpr JewelId invalidJewelId = IndexPolicyT::invalidJewelId;
+        static constexpr SccId invalidSccId = IndexPolicyT::invalidSccId;
+        static constexpr MoveId invalidMoveId = IndexPolicyT::invalidMoveId;
+
+    private:
+
+        struct Scc
+        {
+            SccId id;
+            std::vector<Coords2> nodes;
+            std::vector<const Move*> bridges;
+            std::vector<SccId> neighbours;
+            std::vector<SccId> predecessors;
+            std::vector<JewelId> jewels;
+        };
+
+        // coalesced node list split into blocks, chains of nodes joined by edges that collect new jewels.
+        // these edges have to stay as they are, the blocks can be reordered freely (except the first one)
+        // and are joined by shortest paths. Blocks are never reversed internally.
+        struct BlockRoute
+        {
+            std::vector<NodeId> nodes;
+            std::vector<int> blockFirst;
+            std::vector<int> blockLast;
+
+            // blocks in the order of traversal and the inverse
+            std::vector<int> order;
+            std::vector<int> position;
+
+            // nearest blocks that can precede and follow each block
+            std::vector<std::vector<int>> nearestPredecessors;
+            std::vector<std::vector<int>> nearestSuccessors;
+
+            int length;
+
+            int numBlocks() const
+            {
+                return order.size();
+            }
+        };
+
+        // an individual of the memetic search: the moves that collect some jewel for the first time,
+        // in the order of traversal, joined by shortest paths. solution is the route they decode to
+        struct JewelTour
+        {
+            std::vector<const Move*> moves;
+            Solution solution = Solution::invalid();
+        };
+
+        // a node entered by exactly one move can only be reached through the start of that move.
+        // Following these forced moves backwards ends in a hub, a node with more incoming moves
+        // (or the vehicle), so these nodes form trees hanging off the hubs and only the hubs
+        // get a column in the distance matrix. first and last delimit the subtree in a preorder
+        // numbering of all the trees, so the node is on the forced chain to another node
+        // if the other one is inside its range
+        struct DistanceColumn
+        {
+            NodeId hub;
+            DistanceType depth;
+            NodeId first;
+            NodeId last;
+        };
+
+        // sccs a route goes through in the order of traversal, the bridges between them
+        // and the jewels to collect inside each of them
+        struct SccRoute
+        {
+            std::vector<SccId> sccs;
+
+            // bridges[i] leads from sccs[i] to sccs[i + 1]
+            std::vector<const Move*> bridges;
+
+            std::vector<std::vector<JewelId>> jewels;
+        };
+
+    public:
+
+        using RandomNumberGeneratorType = std::mt19937_64;
+
+        // enable/disable checks for solution validity before commiting to it
+        static constexpr bool verifySolutions = true;
+
+        // there are two variants possible, either we can stop there later too or not
+        static constexpr bool isVehicleSpotAHole = false;
+
+        // how much the search space for opt3 moves increases with each iteration
+        static constexpr float opt3WindowIncreaseFactor = 4.0f;
+
+        static constexpr int minimalOpt3WindowSize = 16;
+
+        // paths shorter than this times the number of threads are optimized by opt3 on one thread
+        static constexpr int minNodesPerOpt3Part = 256;
+
+        // how many nearest blocks are considered as neighbours in or-opt and 2h-opt
+        static constexpr int numLocalSearchCandidates = 8;
+
+        // longest chain of blocks relocated at once by or-opt
+        static constexpr int maxOrOptSegmentLength = 3;
+
+        // longest chain of segment exchanges in the variable depth search
+        static constexpr int maxVariableSearchDepth = 8;
+
+        // how many nearest path nodes are considered for inserting a move into the cah path
+        static constexpr int numCahInsertionCandidates = 32;
+
+        // how many of them that are already in the path are tried, on each side of the move
+        static constexpr int numCahInsertionCandidatesInPath = 8;
+
+        // shorter cah paths are searched whole for the best insertion
+        static constexpr int minCahPathSizeForCandidates = 64;
+
+        // the route is planned separately in each scc only if jewels are collected in at least that many of them
+        static constexpr int minSccsForDecomposition = 2;
+
+        // the memetic search runs after cah on levels with at least that many jewels (after the reduction)
+        static constexpr int minJewelsForMemeticSearch = 256;
+
+        static constexpr int memeticPopulationSize = 8;
+
+        // ruin and recreate steps applied to each child
+        static constexpr int numMemeticLocalSearchSteps = 8;
+
+        // at most this fraction of the moves of a tour (but at least 2) is removed by one ruin step
+        static constexpr float maxMemeticRuinFraction = 0.1f;
+
+        // lns runs after the memetic search on levels with at least that many jewels (after the reduction)
+        static constexpr int minJewelsForLns = 256;
+
+        // one lns ruin removes at most this fraction of the moves of the tour, but at least 2 and at most maxLnsRuinSize
+        static constexpr float maxLnsRuinFraction = 0.1f;
+        static constexpr int maxLnsRuinSize = 8;
+
+        // lns repairs by regret-k insertion with k up to this, k = 1 is cheapest insertion in random order
+        static constexpr int maxLnsRegret = 3;
+
+        // record-to-record travel accepts tours longer than the record by at most this many moves
+        static constexpr int lnsRecordDeviation = 1;
+
+        // the annealing temperature falls exponentially from the first to the second over its time, in moves
+        static constexpr double annealingStartTemperature = 0.3;
+        static constexpr double annealingEndTemperature = 0.02;
+
+        // how far a move can be moved along the tour by one annealing step
+        static constexpr int maxAnnealingShift = 32;
+
+        // annealing steps between deadline checks, must be 2^n - 1
+        static constexpr std::uint64_t annealingTimeCheckInterval = 255;
+
+        // distance matrices of at least that many bytes store only the columns of hubs, see DistanceColumn
+        static constexpr std::size_t minDistanceMatrixSizeForContraction = std::size_t(128) << 20;
+
+        static constexpr auto maxTimeForStochasticHeuristic = std::chrono::seconds{ 1 };
+
+        static constexpr auto maxTimeForMemetic = std::chrono::seconds{ 1 };
+
+        static constexpr auto maxTimeForLns = std::chrono::seconds{ 1 };
+
+        static constexpr auto maxTimeForAnnealing = std::chrono::seconds{ 1 };
+
+        static constexpr auto maxTimeForOpt3 = std::chrono::seconds{ 1 };
+
+        // used when no time budget is given, the solver runs until it finishes
+        static constexpr auto noTimeLimit = std::chrono::milliseconds::max();
+
+        // how many backtracking nodes are visited between deadline checks, must be 2^n - 1
+        static constexpr std::uint64_t deadlineCheckInterval = 1023;
+
+        // same for path positions in opt3
+        static constexpr int opt3TimeCheckInterval = 63;
+
+        // and for nodes in distance computation, a single node takes over a millisecond on the largest boards
+        static constexpr int distancesDeadlineCheckInterval = 7;
+
+        // and for path nodes in the cah candidate precompute, each of them is paired with all the others
+        static constexpr int cahCandidatesDeadlineCheckInterval = 15;
+
+        static constexpr std::uint64_t rngSeed = 12345;
+
+        // starting potential of one jewel on one edge
+        static constexpr PotentialType maxPotential = std::numeric_limits<PotentialType>::max();
+
+        // if the best move has potential below this and we made a cycle during search
+        // then try going to the nearest jewel instead
+        static constexpr TotalPotentialType uncertainPotentialThreshold = 256;
+
+        // we use probabilistic skipping in backtracking, this sets the minimal depth to use this strategy
+        static constexpr int minDepthToAllowSkip = 10;
+
+        // we keep looking for solutions of length up to maxMoves * additionalMovesFactor
+        // but try to shorten ones longer than maxMoves before emmiting them as solutions
+        static constexpr float additionalMovesFactor = 0.3f;
+
+        // should be more than any possible distance on a valid board
+        static constexpr DistanceType infiniteDistance = std::numeric_limits<DistanceType>::max();
+
+        // let a be the best potential of the best edge from a node
+        // if potential of the next edge is < a * pruningFactor then skip this edge
+        // should be kept in [0.5, 1]
+        // 0.5 means no pruning because the potential propagates with 0.5 saturation
+        static constexpr float pruningFactor = 0.5f;
+
+        BasicSolver(Level level, Bench& bench, std::chrono::milliseconds timeLimit = noTimeLimit, int numThreads = 1, std::string cacheDirectory = {}) :
+            m_rng(rngSeed),
+            m_level(std::move(level)),
+            m_jewelState(countJewels()),
+            m_bench(&bench),
+            m_scheduler(timeLimit, maxTimeForStochasticHeuristic, maxTimeForMemetic, maxTimeForLns, maxTimeForAnnealing, maxTimeForOpt3),
+            m_isOutOfTime(false),
+            m_searchStatistics(bench.searchStatistics()),
+            m_numThreads(std::max(1, numThreads)),
+            m_cacheDirectory(std::move(cacheDirectory)),
+            m_isPreprocessingCached(false),
+
+            m_vehicleCoords(m_level.vehicleCoords()),
+            m_jewelIdByPosition(m_level.width(), m_level.height(), invalidJewelId),
+            m_keptJewelIdByOriginalJewelId{},
+
+            m_movesByPosition(m_level.width(), m_level.height()),
+            m_movesByEndPosition(m_level.width(), m_level.height()),
+            m_allMoves{},
+            m_movesCollectingJewel(numJewels()),
+
+            m_nodeIdByPosition(m_level.width(), m_level.height(), invalidNodeId),
+            m_nodePositionById{},
+            m_numHubs(0),
+
+            m_sccs{},
+            m_lastSccWithJewel{},
+            m_sccIdAt(m_level.width(), m_level.height(), invalidSccId),
+            m_numSccsWithJewel{}
+        {
+        }
+
+        Solution solve()
+        {
+            if (numJewels() == 0)
+            {
+                m_bench->end();
+                return Solution::empty();
+            }
+
+            m_bench->beginPhase("moves");
+
+            identifyJewels();
+            g_logger.log("Recognized features\n");
+
+            generateAllMoves();
+            g_logger.log("Generated moves\n");
+
+            if (!areAllJewelsReachable())
+            {
+                m_bench->end();
+                return Solution::invalid();
+            }
+
+            reduceDominatedJewels();
+            g_logger.log("Reduced jewels\n");
+
+            // every engine returns as soon as its solution fits into maxMoves, so once it
+            // gets down to the bound there is nothing left to improve
+            const int lowerBound = computeLowerBound();
+            m_bench->setLowerBound(lowerBound);
+            g_logger.log("Lower bound: ", lowerBound, '\n');
+            if (m_level.maxMoves() < lowerBound)
+            {
+                m_bench->end();
+                return Solution::invalid();
+            }
+
+            m_bench->beginPhase("distances");
+
+            computePairwiseNodeDistances();
+            g_logger.log("Characterized vertices\n");
+
+            if (m_isOutOfTime)
+            {
+                m_bench->end();
+                return Solution::invalid();
+            }
+
+            m_bench->beginPhase("sccs");
+
+            identifySccs();
+            g_logger.log("Sccs identified\n");
+
+            assignJewelsToSccs();
+            g_logger.log("Jewels assigned to sccs\n");
+
+            fillSccConditionalUnreachability();
+            g_logger.log("Scc unreachability filled\n");
+
+            printSccs();
+
+            if (!mayBeSolvable())
+            {
+                m_bench->end();
+                g_logger.log("Unsolvable\n");
+                return Solution::invalid();
+            }
+
+            // on huge boards the distances can leave too little time for even one cah solution
+            if (!m_scheduler.isWorthStartingCah(m_nodePositionById.size(), m_isPreprocessingCached))
+            {
+                m_bench->end();
+                return Solution::invalid();
+            }
+
+            m_bench->beginPhase("cah");
+            m_bench->start();
+
+            // https://www.researchgate.net/publication/307583744_The_Traveling_Purchaser_Problem_and_its_Variants p. 14
+            // http://www.fsa.ulaval.ca/personnel/renaudj/pdf/Recherche/tpp(purchaser)%20COR.pdf general
+            Solution cahSolution = lookForBestSolutionUsingCahHeuristic();
+            g_logger.log("CAH: ", cahSolution.size(), '\n');
+            if (g_logger.enabled) write(cahSolution, std::cout);
+            g_logger.log("\n\n");
+            if (cahSolution.exists() && cahSolution.size() <= m_level.maxMoves())
+            {
+                m_bench->end();
+                return verified(std::move(cahSolution));
+            }
+
+            if (m_isOutOfTime || !m_scheduler.isWorthStartingBacktracking(numJewels(), m_allMoves.size()))
+            {
+                m_bench->end();
+                return Solution::invalid();
+            }
+
+            m_bench->beginPhase("potential");
+
+            {
+                const auto timer = m_bench->scopedTimer("potential");
+
+                initializeSkipProbability();
+
+                initializeMovePotential();
+                g_logger.log("Initialized potential\n");
+
+                fillInitialMovePotential();
+                g_logger.log("Filled initial potential\n");
+
+                propagateMovePotential();
+                g_logger.log("Potential propagated\n");
+
+                summarizeMovePotential();
+                g_logger.log("Potential summarized\n");
+            }
+
+            m_bench->beginPhase("search");
+
+            // potential field guided search with backtracking
+            m_numJewelsLeftWhenSolvingAt = Array2<JewelId>(m_level.width(), m_level.height(), numJewels() + 1);
+            Solution solution = solveUsingSearchWithBacktracking(m_vehicleCoords, m_level.maxMoves() - 1, 0, m_level.maxMoves() * additionalMovesFactor);
+            if (solution.exists() && solution.size() <= m_level.maxMoves())
+            {
+                m_bench->end();
+                return verified(std::move(solution));
+            }
+
+            m_bench->end();
+
+            return Solution::invalid();
+        }
+
+    private:
+        RandomNumberGeneratorType m_rng;
+        Level m_level;
+        JewelState m_jewelState;
+        Bench* m_bench;
+        Scheduler m_scheduler;
+        mutable bool m_isOutOfTime;
+        SearchStatistics* m_searchStatistics;
+        int m_numThreads;
+
+        // empty if the preprocessing cache is not used
+        std::string m_cacheDirectory;
+        bool m_isPreprocessingCached;
+
+        Coords2 m_vehicleCoords;
+        Array2<JewelId> m_jewelIdByPosition;
+
+        // jewels dominated by others are dropped after the moves are generated, see reduceDominatedJewels
+        std::vector<JewelId> m_keptJewelIdByOriginalJewelId;
+
+        Array2<Moves> m_movesByPosition;
+        Array2<std::vector<const Move*>> m_movesByEndPosition;
+        std::vector<const Move*> m_allMoves;
+        std::vector<std::vector<const Move*>> m_movesCollectingJewel;
+
+        Array2<NodeId> m_nodeIdByPosition;
+        std::vector<Coords2> m_nodePositionById;
+
+        // m_distanceFromTo[nodeId][hubId], read through distanceFromTo.
+        // hubs get the first m_numHubs node ids
+        Array2<DistanceType> m_distanceFromTo;
+        std::vector<DistanceColumn> m_distanceColumnByNodeId;
+        int m_numHubs;
+
+        // m_nearestNodesBefore[nodeId][k], nearest first, only between starts and ends of moves collecting jewels
+        Array2<NodeId> m_nearestNodesBefore;
+        Array2<NodeId> m_nearestNodesAfter;
+
+        std::vector<Scc> m_sccs;
+        std::vector<SccId> m_lastSccWithJewel; // topologically
+        Array2<SccId> m_sccIdAt;
+        Array2<bool> m_ifSccTraversedThenSccUnreachable;
+        std::vector<SccId> m_numSccsWithJewel;
+
+        Array2<JewelId> m_numJewelsLeftWhenSolvingAt;
+
+        std::vector<float> m_skipProbabilityAtDepth;
+
+        // m_potential[jewelId][edgeId]
+        Array2<PotentialType> m_potentialOfJewelAtEdge;
+
+        // m_totalPotential[edgeId]
+        std::vector<TotalPotentialType> m_totalPotentialAtEdge;
+
+        DistanceType distanceFromTo(int fromNodeId, int toNodeId) const
+        {
+            if (toNodeId < m_numHubs)
+            {
+                return m_distanceFromTo[fromNodeId][toNodeId];
+            }
+
+            const DistanceColumn& from = m_distanceColumnByNodeId[fromNodeId];
+            const DistanceColumn& to = m_distanceColumnByNodeId[toNodeId];
+            if (from.first <= to.first && to.first <= from.last)
+            {
+                // the forced chain to the target goes through the source
+                return to.depth - from.depth;
+            }
+
+            const DistanceType distanceToHub = m_distanceFromTo[fromNodeId][to.hub];
+            return distanceToHub == infiniteDistance ? infiniteDistance : distanceToHub + to.depth;
+        }
+
+        bool isPastDeadline() const
+        {
+            if (!m_isOutOfTime && std::chrono::high_resolution_clock::now() > m_scheduler.deadline())
+            {
+                m_isOutOfTime = true;
+            }
+
+            return m_isOutOfTime;
+        }
+
+        // replays the solution using the move table, jewels are tracked in a bitset
+        // a move that doesn't change the position is either blocked by an adjacent wall or hits a mine
+        SolutionStatus verifySolution(const Solution& solution) const
+        {
+            constexpr int bitsPerWord = JewelMask::bitsPerWord;
+
+            std::vector<std::uint64_t> isJewelCollected((numJewels() + bitsPerWord - 1) / bitsPerWord, 0);
+            Coords2 pos = m_vehicleCoords;
+
+            for (Direction dir : solution)
+            {
+                const Move& move = m_movesByPosition[pos][dir];
+                if (move.id() < 0 && m_level[pos + DirectionHelper::offset(dir)] != CellType::Wall)
+                {
+                    return SolutionStatus::Mine;
+                }
+
+                move.jewelMask().forEachWord([&](const JewelMask::Word& word) {
+                    isJewelCollected[word.index] |= word.bits;
+                    });
+
+                pos = move.endPos();
+            }
+
+            int numCollected = 0;
+            for (const std::uint64_t word : isJewelCollected)
+            {
+                numCollected += popcount(word);
+            }
+
+            if (numCollected != numJewels())
+            {
+                return SolutionStatus::JewelsLeft;
+            }
+
+            if (solution.size() > m_level.maxMoves())
+            {
+                return SolutionStatus::TooLong;
+            }
+
+            return SolutionStatus::Ok;
+        }
+
+        // valid solutions collect all jewels, but may be too long
+        bool isSolutionValid(const Solution& solution) const
+        {
+            if (!verifySolutions)
+            {
+                return true;
+            }
+
+            const SolutionStatus status = verifySolution(solution);
+            if (status != SolutionStatus::Ok && status != SolutionStatus::TooLong)
+            {
+                g_logger.log("Rejected solution: ", SolutionStatusHelper::toString(status), '\n');
+                return false;
+            }
+
+            return true;
+        }
+
+        // the last check before the solution is emmited
+        Solution verified(Solution solution) const
+        {
+            if (solution.exists() && verifySolutions && verifySolution(solution) != SolutionStatus::Ok)
+            {
+                return Solution::invalid();
+            }
+
+            return solution;
+        }
+
+        template <typename FuncT>
+        void forEachMoveInSolution(const Solution& solution, FuncT&& func) const
+        {
+            Coords2 start = m_vehicleCoords;
+            forEachMoveInSolution(std::begin(solution), std::end(solution), start, std::forward<FuncT>(func));
+        }
+
+        template <typename FuncT>
+        void forEachMoveInSolution(const std::vector<Direction>& solution, Coords2& start, FuncT&& func) const
+        {
+            forEachMoveInSolution(std::begin(solution), std::end(solution), start, std::forward<FuncT>(func));
+        }
+
+        template <typename IterT, typename FuncT>
+        void forEachMoveInSolution(IterT begin, IterT end, Coords2& start, FuncT&& func) const
+        {
+            while(begin != end)
+            {
+                const auto& move = m_movesByPosition[start][*begin];
+
+                func(move, start);
+
+                start = move.endPos();
+                ++begin;
+            }
+        }
+
+        bool opt3(std::vector<NodeId>& nodesInPath, std::vector<int>& successors, const std::vector<std::uint8_t>& isAnyImportantJewelOnThisEdge, int window, int targetLength, const PostOptimizationContext& context) const
+        {
+            // window parameter specifies the upper bound on how far the nodes being exchanged can be located to each other
+            // stops when the path is not longer than targetLength
+
+            // tries to lower the overall path length by trying out all possible non path reversing
+            // 3-opt moves http://akira.ruc.dk/~keld/research/LKH/LKH-2.0/DOC/LKH_REPORT.pdf p. 9
+
+            // we have to preserve order of traversing single moves so there is always one possibility
+            //   i    j    k
+            // 0 -> 1 -> 2 -> 3
+            // into
+            // 0 -> 2 -> 1 -> 3
+            //   i    j    k
+
+            const int totalLength = solutionThroughNodes(nodesInPath, successors).size();
+            int savedLength = 0;
+            bool anyImprovement = false;
+            for (int i0 = 0, i = 0; i0 + 5 < nodesInPath.size(); ++i0, i = successors[i])
+            {
+                if (totalLength - savedLength <= targetLength)
+                {
+                    break;
+                }
+
+                if ((i0 & opt3TimeCheckInterval) == 0 && context.shouldStop())
+                {
+                    break;
+                }
+
+                if (isAnyImportantJewelOnThisEdge[i]) continue;
+                const int iStart = nodesInPath[i];
+                const int iEnd = nodesInPath[successors[i]];
+                const int iCost = distanceFromTo(iStart, iEnd);
+
+                for (int j0 = i0 + 2, j = successors[successors[i]]; j0 + 3 < nodesInPath.size() && j0 < i0 + window; ++j0, j = successors[j])
+                {
+                    if (isAnyImportantJewelOnThisEdge[j]) continue;
+                    const int jStart = nodesInPath[j];
+                    const int jEnd = nodesInPath[successors[j]];
+                    const int jCost = distanceFromTo(jStart, jEnd);
+
+                    bool anyChange = false;
+                    for (int k0 = j0 + 2, k = successors[successors[j]]; k0 + 1 < nodesInPath.size() && k0 < j0 + window; ++k0, k = successors[k])
+                    {
+                        if (isAnyImportantJewelOnThisEdge[k]) continue;
+
+                        const int kStart = nodesInPath[k];
+                        const int kEnd = nodesInPath[successors[k]];
+                        const int kCost = distanceFromTo(kStart, kEnd);
+
+                        const int iStartNew = iStart;
+                        const int iEndNew = jEnd;
+                        const int jStartNew = kStart;
+                        const int jEndNew = iEnd;
+                        const int kStartNew = jStart;
+                        const int kEndNew = kEnd;
+
+                        const int iCostNew = distanceFromTo(iStartNew, iEndNew);
+                        const int jCostNew = distanceFromTo(jStartNew, jEndNew);
+                        const int kCostNew = distanceFromTo(kStartNew, kEndNew);
+                        if (iCostNew == infiniteDistance || jCostNew == infiniteDistance || kCostNew == infiniteDistance)
+                        {
+                            continue;
+                        }
+
+                        const int cost = iCost + jCost + kCost;
+                        const int costNew = iCostNew + jCostNew + kCostNew;
+                        if (costNew < cost)
+                        {
+                            // exchange
+                            //g_logger.log(iStart, ' ', iEnd, ' ', jStart, ' ', jEnd, ' ', kStart, ' ', kEnd, ' ', cost, ' ', iCost, ' ', jCost, ' ', kCost, '\n');
+                            //g_logger.log(iStartNew, ' ', iEndNew, ' ', jStartNew, ' ', jEndNew, ' ', kStartNew, ' ', kEndNew, ' ', costNew, ' ', iCostNew, ' ', jCostNew, ' ', kCostNew, '\n');
+                            //g_logger.log(successors[i], ' ', successors[j], ' ', successors[k], '\n');
+
+                            const int sj = successors[j];
+                            successors[j] = successors[k];
+                            successors[k] = successors[i];
+                            successors[i] = sj;
+
+                            savedLength += cost - costNew;
+                            context.bench.count(Counter::Opt3Improvements);
+                            g_logger.log("opt3 ", i, ": ", totalLength - savedLength, '\n');
+
+                            anyImprovement = true;
+                            anyChange = true;
+                            break;
+                        }
+                    }
+                    // we have to break to the outermost loop when a change is made
+                    // because it breaks for some reason otherwise
+                    // it's complex so invalidations happen when changing order of edges which causes problems
+                    if (anyChange) break;
+                }
+            }
+
+            return anyImprovement;
+        }
+
+        Solution solutionThroughNodes(const std::vector<NodeId>& nodes, const std::vector<int>& successors) const
+        {
+            Solution solution = Solution::empty();
+            std::vector<Direction> pathBuffer;
+            for (int i = 0, j = 0; j + 1 < nodes.size(); ++j)
+            {
+                const int startNodeId = nodes[i];
+                const int endNodeId = nodes[successors[i]];
+                pathBuffer.clear();
+                shortestPathFromTo(m_nodePositionById[startNodeId], m_nodePositionById[endNodeId], pathBuffer);
+                solution.append(pathBuffer);
+                i = successors[i];
+            }
+            return solution;
+        }
+
+        Solution solutionThroughNodes(const std::vector<NodeId>& nodes) const
+        {
+            Solution solution = Solution::empty();
+            std::vector<Direction> pathBuffer;
+            for (int i = 0; i + 1 < nodes.size(); ++i)
+            {
+                const int startNodeId = nodes[i];
+                const int endNodeId = nodes[i + 1];
+                pathBuffer.clear();
+                shortestPathFromTo(m_nodePositionById[startNodeId], m_nodePositionById[endNodeId], pathBuffer);
+                solution.append(pathBuffer);
+            }
+            return solution;
+        }
+
+        void solutionToNodeList(const Solution& solution, std::vector<NodeId>& nodesInPath, std::vector<std::uint8_t>& isAnyImportantJewelOnThisEdge) const
+        {
+            Coords2 c = m_vehicleCoords;
+            nodesInPath.emplace_back(m_nodeIdByPosition[c]);
+            std::vector<std::uint8_t> isJewelCollected(numJewels(), false);
+            forEachMoveInSolution(solution, [&](const Move & move, const Coords2 & pos) {
+                bool anyNewJewels = false;
+                for (const int jewelId : move.jewels())
+                {
+                    if (!isJewelCollected[jewelId])
+                    {
+                        isJewelCollected[jewelId] = true;
+                        anyNewJewels = true;
+                    }
+                }
+
+                const int endNodeId = m_nodeIdByPosition[move.endPos()];
+
+                nodesInPath.emplace_back(endNodeId);
+                isAnyImportantJewelOnThisEdge.emplace_back(anyNewJewels);
+            });
+        }
+
+        void solutionToCoalescedNodeList(const Solution& solution, std::vector<NodeId>& nodesInPathCoalesced, std::vector<std::uint8_t>& isAnyImportantJewelOnThisEdgeCoalesced) const
+        {
+            std::vector<NodeId> nodesInPath;
+            std::vector<std::uint8_t> isAnyImportantJewelOnThisEdge;
+            solutionToNodeList(solution, nodesInPath, isAnyImportantJewelOnThisEdge);
+
+            nodesInPathCoalesced.emplace_back(m_nodeIdByPosition[m_vehicleCoords]);
+            for (int i = 0; i + 1 < isAnyImportantJewelOnThisEdge.size(); ++i)
+            {
+                if (isAnyImportantJewelOnThisEdge[i] || isAnyImportantJewelOnThisEdge[i + 1])
+                {
+                    nodesInPathCoalesced.emplace_back(nodesInPath[i + 1]);
+                    isAnyImportantJewelOnThisEdgeCoalesced.emplace_back(isAnyImportantJewelOnThisEdge[i]);
+                }
+            }
+            nodesInPathCoalesced.emplace_back(nodesInPath.back());
+            isAnyImportantJewelOnThisEdgeCoalesced.emplace_back(isAnyImportantJewelOnThisEdge.back());
+        }
+
+        int pathLength(const std::vector<NodeId>& nodes) const
+        {
+            int length = 0;
+            for (int i = 0; i + 1 < nodes.size(); ++i)
+            {
+                length += distanceFromTo(nodes[i], nodes[i + 1]);
+            }
+            return length;
+        }
+
+        bool opt3InParts(std::vector<NodeId>& nodesInPath, std::vector<std::uint8_t>& isAnyImportantJewelOnThisEdge, int window, bool isShifted, const PostOptimizationContext& context) const
+        {
+            // splits the path into context.numThreads disjoint parts and optimizes each one on its own thread
+            // 3-opt moves never change the first and the last node of a part so the results can be put back in place.
+            // parts are shifted by half of their size every other round so moves across the boundaries are found too
+
+            const int numNodes = nodesInPath.size();
+            const int numParts = context.numThreads;
+            const int partSize = (numNodes + numParts - 1) / numParts;
+            const int offset = isShifted ? partSize / 2 : 0;
+            const int excessLength = pathLength(nodesInPath) - m_level.maxMoves();
+
+            std::vector<int> boundaries{ 0 };
+            for (int i = offset == 0 ? 1 : 0; i < numParts; ++i)
+            {
+                const int boundary = offset + i * partSize;
+                if (boundary > 0 && boundary < numNodes - 1)
+                {
+                    boundaries.emplace_back(boundary);
+                }
+            }
+            boundaries.emplace_back(numNodes - 1);
+
+            const int numActualParts = static_cast<int>(boundaries.size()) - 1;
+            std::vector<Bench> benches(numActualParts);
+            std::vector<std::uint8_t> anyImprovement(numActualParts, false);
+            auto optimizePart = [&](int part) {
+                const int begin = boundaries[part];
+                const int end = boundaries[part + 1];
+                std::vector<NodeId> nodes(std::begin(nodesInPath) + begin, std::begin(nodesInPath) + end + 1);
+                std::vector<std::uint8_t> isImportant(std::begin(isAnyImportantJewelOnThisEdge) + begin, std::begin(isAnyImportantJewelOnThisEdge) + end);
+                std::vector<int> successors(nodes.size());
+                std::iota(std::begin(successors), std::end(successors), 1);
+
+                benches[part].setProfiling(context.bench.isProfiling());
+                const PostOptimizationContext partContext{ benches[part], context.until, context.isCancelled, 1 };
+                if (!opt3(nodes, successors, isImportant, window, pathLength(nodes) - excessLength, partContext))
+                {
+                    return;
+                }
+
+                // the ends stay in place and are shared with the neighbouring parts
+                for (int k = 0, i = 0; k + 1 < nodes.size(); ++k, i = successors[i])
+                {
+                    if (k > 0)
+                    {
+                        nodesInPath[begin + k] = nodes[i];
+                    }
+                    isAnyImportantJewelOnThisEdge[begin + k] = isImportant[i];
+                }
+                anyImprovement[part] = true;
+            };
+
+            std::vector<std::thread> threads;
+            for (int part = 1; part < numActualParts; ++part)
+            {
+                threads.emplace_back(optimizePart, part);
+            }
+            optimizePart(0);
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            for (const Bench& bench : benches)
+            {
+                context.bench.merge(bench);
+            }
+
+            return std::find(std::begin(anyImprovement), std::end(anyImprovement), true) != std::end(anyImprovement);
+        }
+
+        void opt3(Solution & solution, const PostOptimizationContext& context) const
+        {
+            const auto timer = context.bench.scopedTimer("opt3");
+
+            // prepares the date structure
+            // does 3-opt moves until the solution is good enough or no improvement can be made
+            // uses ever increasing window size of searching to converge faster to nearly
+            // maximally improved solution. Gives an advantage on very big boards (>100x100) where one whole iteration takes too long.
+            // with more threads available long paths are first optimized in parts in parallel
+            // stops at the given time, the solution stays valid
+
+            std::vector<NodeId> nodesInPathCoalesced;
+            std::vector<std::uint8_t> isAnyImportantJewelOnThisEdgeCoalesced;
+            solutionToCoalescedNodeList(solution, nodesInPathCoalesced, isAnyImportantJewelOnThisEdgeCoalesced);
+
+            if (context.numThreads > 1 && nodesInPathCoalesced.size() >= minNodesPerOpt3Part * context.numThreads)
+            {
+                const int partSize = nodesInPathCoalesced.size() / context.numThreads;
+                int window = std::max(minimalOpt3WindowSize, static_cast<int>(std::sqrt(partSize)));
+                int numRoundsWithoutImprovement = 0;
+                for (int round = 0; numRoundsWithoutImprovement < 2 && solution.size() > m_level.maxMoves() && !context.shouldStop(); ++round)
+                {
+                    if (opt3InParts(nodesInPathCoalesced, isAnyImportantJewelOnThisEdgeCoalesced, window, round % 2 == 1, context))
+                    {
+                        solution = solutionThroughNodes(nodesInPathCoalesced);
+                        numRoundsWithoutImprovement = 0;
+                    }
+                    else
+                    {
+                        ++numRoundsWithoutImprovement;
+                    }
+
+                    if (round % 2 == 1)
+                    {
+                        window = std::min(static_cast<int>(window * opt3WindowIncreaseFactor), partSize);
+                    }
+                }
+            }
+
+            std::vector<int> successors(nodesInPathCoalesced.size());
+            std::iota(std::begin(successors), std::end(successors), 1);
+
+            int window = std::max(minimalOpt3WindowSize, static_cast<int>(std::sqrt(nodesInPathCoalesced.size())));
+            while (solution.size() > m_level.maxMoves() && !context.shouldStop())
+            {
+                const bool anyImprovement = opt3(nodesInPathCoalesced, successors, isAnyImportantJewelOnThisEdgeCoalesced, window, m_level.maxMoves(), context);
+                if (!anyImprovement || context.shouldStop())
+                {
+                    if (anyImprovement)
+                    {
+                        solution = solutionThroughNodes(nodesInPathCoalesced, successors);
+                    }
+                    break;
+                }
+
+                solution = solutionThroughNodes(nodesInPathCoalesced, successors);
+
+                window = std::min(static_cast<int>(window * opt3WindowIncreaseFactor), static_cast<int>(nodesInPathCoalesced.size()));
+            }
+        }
+
+        int blockConnection(const BlockRoute& route, int from, int to) const
+        {
+            return distanceFromTo(route.nodes[route.blockLast[from]], route.nodes[route.blockFirst[to]]);
+        }
+
+        bool makeBlockRoute(const Solution& solution, BlockRoute& route, const PostOptimizationContext& context) const
+        {
+            // returns false if there is nothing to reorder or no time to prepare the candidate lists
+
+            std::vector<std::uint8_t> isAnyImportantJewelOnThisEdge;
+            solutionToCoalescedNodeList(solution, route.nodes, isAnyImportantJewelOnThisEdge);
+
+            route.blockFirst.assign(1, 0);
+            route.blockLast.clear();
+            route.length = 0;
+            for (int i = 0; i < isAnyImportantJewelOnThisEdge.size(); ++i)
+            {
+                route.length += distanceFromTo(route.nodes[i], route.nodes[i + 1]);
+                if (!isAnyImportantJewelOnThisEdge[i])
+                {
+                    route.blockLast.emplace_back(i);
+                    route.blockFirst.emplace_back(i + 1);
+                }
+            }
+            route.blockLast.emplace_back(static_cast<int>(route.nodes.size()) - 1);
+
+            const int numBlocks = route.blockFirst.size();
+            route.order.resize(numBlocks);
+            std::iota(std::begin(route.order), std::end(route.order), 0);
+            route.position = route.order;
+            if (numBlocks < 3)
+            {
+                return false;
+            }
+
+            route.nearestPredecessors.assign(numBlocks, {});
+            route.nearestSuccessors.assign(numBlocks, {});
+            std::vector<std::pair<int, int>> predecessors;
+            std::vector<std::pair<int, int>> successors;
+            auto nearest = [](std::vector<std::pair<int, int>>& candidates, std::vector<int>& out) {
+                const int numCandidates = std::min(numLocalSearchCandidates, static_cast<int>(candidates.size()));
+                std::partial_sort(std::begin(candidates), std::begin(candidates) + numCandidates, std::end(candidates));
+                for (int i = 0; i < numCandidates; ++i)
+                {
+                    out.emplace_back(candidates[i].second);
+                }
+            };
+
+            for (int b = 0; b < numBlocks; ++b)
+            {
+                if ((b & opt3TimeCheckInterval) == 0 && context.shouldStop())
+                {
+                    return false;
+                }
+
+                // the first block can't be moved so it's nobody's successor
+                predecessors.clear();
+                successors.clear();
+                for (int other = 0; other < numBlocks; ++other)
+                {
+                    if (other == b) continue;
+
+                    const int from = blockConnection(route, other, b);
+                    if (from != infiniteDistance && b != 0) predecessors.emplace_back(from, other);
+
+                    const int to = blockConnection(route, b, other);
+                    if (to != infiniteDistance && other != 0) successors.emplace_back(to, other);
+                }
+                nearest(predecessors, route.nearestPredecessors[b]);
+                nearest(successors, route.nearestSuccessors[b]);
+            }
+
+            return true;
+        }
+
+        Solution solutionThroughBlocks(const BlockRoute& route) const
+        {
+            std::vector<NodeId> nodesInPath;
+            for (const int block : route.order)
+            {
+                nodesInPath.insert(std::end(nodesInPath), std::begin(route.nodes) + route.blockFirst[block], std::begin(route.nodes) + route.blockLast[block] + 1);
+            }
+            return solutionThroughNodes(nodesInPath);
+        }
+
+        void localSearch(Solution& solution, const PostOptimizationContext& context) const
+        {
+            const auto timer = context.bench.scopedTimer("localSearch");
+
+            // or-opt and 2h-opt on the blocks of the coalesced node list
+            // 2h-opt is 2-opt (reversing the order of a run of blocks) together with relocating a single block,
+            // or-opt relocates runs of up to maxOrOptSegmentLength blocks.
+            // only moves that create an edge to one of the nearest blocks are evaluated and
+            // blocks that can't be improved are not looked at again until their neighbourhood changes (don't-look bits).
+            // stops at the given time, the solution stays valid
+
+            BlockRoute route;
+            if (solution.size() <= m_level.maxMoves() || !makeBlockRoute(solution, route, context))
+            {
+                return;
+            }
+
+            const int numBlocks = route.numBlocks();
+            std::vector<int>& order = route.order;
+            std::vector<int>& position = route.position;
+            auto connection = [&](int from, int to) {
+                return blockConnection(route, from, to);
+            };
+
+            // prefix sums of connections along the route and against it, for evaluating 2-opt in constant time
+            // infinite connections against the route are counted separately
+            std::vector<int> forwardLength(numBlocks, 0);
+            std::vector<int> backwardLength(numBlocks, 0);
+            std::vector<int> numBackwardInfinite(numBlocks, 0);
+            bool arePrefixSumsValid = false;
+            auto updatePrefixSums = [&]() {
+                if (arePrefixSumsValid) return;
+
+                for (int i = 0; i + 1 < numBlocks; ++i)
+                {
+                    const int backward = connection(order[i + 1], order[i]);
+                    forwardLength[i + 1] = forwardLength[i] + connection(order[i], order[i + 1]);
+                    backwardLength[i + 1] = backwardLength[i] + (backward == infiniteDistance ? 0 : backward);
+                    numBackwardInfinite[i + 1] = numBackwardInfinite[i] + (backward == infiniteDistance);
+                }
+                arePrefixSumsValid = true;
+            };
+
+            std::deque<int> activeBlocks(std::begin(order), std::end(order));
+            std::vector<std::uint8_t> isActive(numBlocks, true);
+            auto activate = [&](int block) {
+                if (!isActive[block])
+                {
+                    isActive[block] = true;
+                    activeBlocks.emplace_back(block);
+                }
+            };
+
+            auto activateAround = [&](int pos) {
+                for (int i = std::max(pos - 1, 0); i <= std::min(pos + 1, numBlocks - 1); ++i)
+                {
+                    activate(order[i]);
+                }
+            };
+
+            auto updatePositions = [&](int begin, int end) {
+                for (int i = begin; i < end; ++i)
+                {
+                    position[order[i]] = i;
+                }
+                arePrefixSumsValid = false;
+            };
+
+            // reverses the order of blocks [i, j] if it shortens the route
+            auto tryTwoOpt = [&](int i, int j) {
+                if (i < 1 || j <= i) return false;
+
+                updatePrefixSums();
+                if (numBackwardInfinite[j] - numBackwardInfinite[i] != 0) return false;
+
+                const int before = order[i - 1];
+                const int after = j + 1 < numBlocks ? order[j + 1] : -1;
+                const int newFirst = connection(before, order[j]);
+                const int newLast = after >= 0 ? connection(order[i], after) : 0;
+                if (newFirst == infiniteDistance || newLast == infiniteDistance) return false;
+
+                const int oldCost = connection(before, order[i]) + (after >= 0 ? connection(order[j], after) : 0) + forwardLength[j] - forwardLength[i];
+                const int newCost = newFirst + newLast + backwardLength[j] - backwardLength[i];
+                if (newCost >= oldCost) return false;
+
+                std::reverse(std::begin(order) + i, std::begin(order) + j + 1);
+                updatePositions(i, j + 1);
+                activateAround(i);
+                activateAround(j);
+                route.length -= oldCost - newCost;
+                context.bench.count(Counter::TwoOptImprovements);
+                return true;
+            };
+
+            // moves the blocks [i, j] between the blocks at q and q + 1 if it shortens the route
+            auto tryOrOpt = [&](int i, int j, int q) {
+                if (q >= i - 1 && q <= j) return false;
+
+                const int first = order[i];
+                const int last = order[j];
+                const int before = order[i - 1];
+                const int after = j + 1 < numBlocks ? order[j + 1] : -1;
+                const int newBefore = order[q];
+                const int newAfter = q + 1 < numBlocks ? order[q + 1] : -1;
+
+                const int closing = after >= 0 ? connection(before, after) : 0;
+                const int newFirst = connection(newBefore, first);
+                const int newLast = newAfter >= 0 ? connection(last, newAfter) : 0;
+                if (closing == infiniteDistance || newFirst == infiniteDistance || newLast == infiniteDistance) return false;
+
+                const int oldCost = connection(before, first) + (after >= 0 ? connection(last, after) : 0) + (newAfter >= 0 ? connection(newBefore, newAfter) : 0);
+                const int newCost = closing + newFirst + newLast;
+                if (newCost >= oldCost) return false;
+
+                if (q > j)
+                {
+                    std::rotate(std::begin(order) + i, std::begin(order) + j + 1, std::begin(order) + q + 1);
+                    updatePositions(i, q + 1);
+                }
+                else
+                {
+                    std::rotate(std::begin(order) + q + 1, std::begin(order) + i, std::begin(order) + j + 1);
+                    updatePositions(q + 1, j + 1);
+                }
+                activate(before);
+                if (after >= 0) activate(after);
+                activate(newBefore);
+                if (newAfter >= 0) activate(newAfter);
+                activate(first);
+                activate(last);
+                route.length -= oldCost - newCost;
+                context.bench.count(Counter::OrOptImprovements);
+                return true;
+            };
+
+            auto tryImprove = [&](int block) {
+                const int p = position[block];
+
+                // 2-opt creating an edge from this block to a near one, or from a near one to this block
+                for (const int successor : route.nearestSuccessors[block])
+                {
+                    if (tryTwoOpt(p + 1, position[successor])) return true;
+                }
+                for (const int predecessor : route.nearestPredecessors[block])
+                {
+                    if (tryTwoOpt(position[predecessor] + 1, p)) return true;
+                }
+
+                // relocate a run starting at this block next to a near block
+                if (p == 0) return false;
+                for (int j = p; j < std::min(p + maxOrOptSegmentLength, numBlocks); ++j)
+                {
+                    for (const int predecessor : route.nearestPredecessors[block])
+                    {
+                        if (tryOrOpt(p, j, position[predecessor])) return true;
+                    }
+                    for (const int successor : route.nearestSuccessors[order[j]])
+                    {
+                        if (tryOrOpt(p, j, position[successor] - 1)) return true;
+                    }
+                }
+
+                return false;
+            };
+
+            bool anyImprovement = false;
+            for (int iteration = 0; !activeBlocks.empty() && route.length > m_level.maxMoves(); ++iteration)
+            {
+                if ((iteration & opt3TimeCheckInterval) == 0 && context.shouldStop())
+                {
+                    break;
+                }
+
+                const int block = activeBlocks.front();
+                activeBlocks.pop_front();
+                isActive[block] = false;
+
+                if (tryImprove(block))
+                {
+                    anyImprovement = true;
+                    activate(block);
+                }
+            }
+
+            if (!anyImprovement)
+            {
+                return;
+            }
+
+            g_logger.log("local search: ", route.length, '\n');
+            solution = solutionThroughBlocks(route);
+        }
+
+        void variableDepthSearch(Solution& solution, const PostOptimizationContext& context) const
+        {
+            const auto timer = context.bench.scopedTimer("variableDepthSearch");
+
+            // Lin-Kernighan style chains of segment exchanges on the blocks of the coalesced node list
+            // the basic step is the only reconnection of 3 removed edges that keeps the direction of the route
+            //         i-1   i    j-1   j    k-1   k
+            // A ... a -> b ... c -> d ... e -> f ...
+            // into
+            // A ... a -> d ... e -> b ... c -> f ...
+            // a -> d and e -> b are kept for the rest of the chain, c -> f is closing the route
+            // and the next step starts by removing it again. Each step takes the best exchange
+            // (even a worsening one) as long as the total gain of the chain stays positive.
+            // the chain is rolled back to its best prefix at the end.
+            // stops at the given time, the solution stays valid
+
+            BlockRoute route;
+            if (solution.size() <= m_level.maxMoves() || !makeBlockRoute(solution, route, context))
+            {
+                return;
+            }
+
+            const int numBlocks = route.numBlocks();
+            std::vector<int>& order = route.order;
+            std::vector<int>& position = route.position;
+            auto connection = [&](int from, int to) {
+                return blockConnection(route, from, to);
+            };
+
+            // blocks with an outgoing edge added in the current chain
+            std::vector<std::uint8_t> isOutgoingFixed(numBlocks, false);
+
+            struct Exchange
+            {
+                int gain;
+                int i;
+                int j;
+                int k;
+            };
+
+            auto exchangeGain = [&](int i, int j, int k) {
+                // returns lowest int when not allowed
+                constexpr int notAllowed = std::numeric_limits<int>::min();
+                if (i < 1 || j <= i || k <= j || k > numBlocks) return notAllowed;
+
+                const int a = order[i - 1];
+                const int c = order[j - 1];
+                const int e = order[k - 1];
+                if (isOutgoingFixed[a] || isOutgoingFixed[c] || isOutgoingFixed[e]) return notAllowed;
+
+                const int ad = connection(a, order[j]);
+                const int eb = connection(e, order[i]);
+                const int cf = k < numBlocks ? connection(c, order[k]) : 0;
+                if (ad == infiniteDistance || eb == infiniteDistance || cf == infiniteDistance) return notAllowed;
+
+                const int oldCost = connection(a, order[i]) + connection(c, order[j]) + (k < numBlocks ? connection(e, order[k]) : 0);
+                return oldCost - (ad + eb + cf);
+            };
+
+            auto applyExchange = [&](int i, int j, int k) {
+                std::rotate(std::begin(order) + i, std::begin(order) + j, std::begin(order) + k);
+                for (int p = i; p < k; ++p)
+                {
+                    position[order[p]] = p;
+                }
+            };
+
+            auto consider = [&](Exchange& best, int i, int j, int k) {
+                const int gain = exchangeGain(i, j, k);
+                if (gain > best.gain)
+                {
+                    best = Exchange{ gain, i, j, k };
+                }
+            };
+
+            // best exchange that removes the outgoing edge of the block
+            // the new edges lead to near blocks
+            auto bestExchange = [&](int block) {
+                Exchange best{ std::numeric_limits<int>::min(), 0, 0, 0 };
+                const int p = position[block];
+                for (const int successor : route.nearestSuccessors[block])
+                {
+                    const int q = position[successor];
+                    if (q > p + 1)
+                    {
+                        // block -> successor is a -> d
+                        const int i = p + 1;
+                        const int j = q;
+                        consider(best, i, j, numBlocks);
+                        for (const int predecessor : route.nearestPredecessors[order[i]])
+                        {
+                            consider(best, i, j, position[predecessor] + 1);
+                        }
+                        for (const int next : route.nearestSuccessors[order[j - 1]])
+                        {
+                            consider(best, i, j, position[next]);
+                        }
+                    }
+                    else if (q < p)
+                    {
+                        // block -> successor is e -> b
+                        const int i = q;
+                        const int k = p + 1;
+                        for (const int next : route.nearestSuccessors[order[i - 1]])
+                        {
+                            consider(best, i, position[next], k);
+                        }
+                        if (k < numBlocks)
+                        {
+                            for (const int predecessor : route.nearestPredecessors[order[k]])
+                            {
+                                consider(best, i, position[predecessor] + 1, k);
+                            }
+                        }
+                    }
+                }
+                return best;
+            };
+
+            std::deque<int> activeBlocks(std::begin(order), std::end(order));
+            std::vector<std::uint8_t> isActive(numBlocks, true);
+            auto activate = [&](int block) {
+                if (!isActive[block])
+                {
+                    isActive[block] = true;
+                    activeBlocks.emplace_back(block);
+                }
+            };
+
+            std::vector<Exchange> chain;
+            std::vector<int> fixedBlocks;
+            bool anyImprovement = false;
+            for (int iteration = 0; !activeBlocks.empty() && route.length > m_level.maxMoves(); ++iteration)
+            {
+                if ((iteration & opt3TimeCheckInterval) == 0 && context.shouldStop())
+                {
+                    break;
+                }
+
+                const int start = activeBlocks.front();
+                activeBlocks.pop_front();
+                isActive[start] = false;
+
+                chain.clear();
+                int totalGain = 0;
+                int bestGain = 0;
+                int bestDepth = 0;
+                for (int block = start; chain.size() < maxVariableSearchDepth;)
+                {
+                    const Exchange exchange = bestExchange(block);
+                    if (exchange.i == 0 || totalGain + exchange.gain <= 0)
+                    {
+                        break;
+                    }
+
+                    const int a = order[exchange.i - 1];
+                    const int c = order[exchange.j - 1];
+                    const int e = order[exchange.k - 1];
+                    applyExchange(exchange.i, exchange.j, exchange.k);
+                    chain.emplace_back(exchange);
+                    totalGain += exchange.gain;
+                    isOutgoingFixed[a] = true;
+                    isOutgoingFixed[e] = true;
+                    fixedBlocks.emplace_back(a);
+                    fixedBlocks.emplace_back(e);
+                    if (totalGain > bestGain)
+                    {
+                        bestGain = totalGain;
+                        bestDepth = chain.size();
+                    }
+
+                    block = c;
+                }
+
+                // roll back to the best prefix, the inverse of rotating [i, k) by j - i is rotating by k - j
+                while (chain.size() > bestDepth)
+                {
+                    const Exchange& exchange = chain.back();
+                    applyExchange(exchange.i, exchange.i + exchange.k - exchange.j, exchange.k);
+                    chain.pop_back();
+                }
+
+                for (const int block : fixedBlocks)
+                {
+                    isOutgoingFixed[block] = false;
+                }
+                fixedBlocks.clear();
+
+                if (bestGain > 0)
+                {
+                    for (const Exchange& exchange : chain)
+                    {
+                        for (const int p : { exchange.i - 1, exchange.i, exchange.j - 1, exchange.j, exchange.k - 1 })
+                        {
+                            activate(order[p]);
+                        }
+                    }
+                    activate(start);
+                    route.length -= bestGain;
+                    anyImprovement = true;
+                    context.bench.count(Counter::VariableDepthImprovements);
+                }
+            }
+
+            if (!anyImprovement)
+            {
+                return;
+            }
+
+            g_logger.log("variable depth search: ", route.length, '\n');
+            solution = solutionThroughBlocks(route);
+        }
+
+        int numJewels() const
+        {
+            return m_jewelState.numJewels();
+        }
+
+        // gives up with all the lists empty when out of time, insertions then scan the whole path.
+        // returns false in that case
+        bool computeCahInsertionCandidates()
+        {
+            const auto timer = m_bench->scopedTimer("cahCandidates");
+
+            // for each node that starts a move collecting a jewel the nearest nodes from which it can be reached
+            // and for each node that ends such a move the nearest nodes reachable from it.
+            // Only nodes that can appear in the cah path are considered,
+            // that is the start and the ends of moves collecting jewels.
+            // kept sorted by distance
+
+            const int numNodes = m_nodePositionById.size();
+            m_nearestNodesBefore = Array2<NodeId>(numNodes, numCahInsertionCandidates, invalidNodeId);
+            m_nearestNodesAfter = Array2<NodeId>(numNodes, numCahInsertionCandidates, invalidNodeId);
+
+            std::vector<std::uint8_t> isPathNode(numNodes, false);
+            isPathNode[m_nodeIdByPosition[m_vehicleCoords]] = true;
+            for (const auto& moves : m_movesCollectingJewel)
+            {
+                for (const Move* move : moves)
+                {
+                    isPathNode[m_nodeIdByPosition[move->startPos()]] = true;
+                    isPathNode[m_nodeIdByPosition[move->endPos()]] = true;
+                }
+            }
+
+            std::vector<NodeId> pathNodes;
+            for (int nodeId = 0; nodeId < numNodes; ++nodeId)
+            {
+                if (isPathNode[nodeId])
+                {
+                    pathNodes.emplace_back(nodeId);
+                }
+            }
+
+            Array2<DistanceType> beforeDistances(numNodes, numCahInsertionCandidates, infiniteDistance);
+            Array2<DistanceType> afterDistances(numNodes, numCahInsertionCandidates, infiniteDistance);
+            auto insert = [](DistanceType* distances, NodeId* nodes, DistanceType distance, NodeId nodeId) {
+                int i = numCahInsertionCandidates - 1;
+                if (distance >= distances[i])
+                {
+                    return;
+                }
+
+                for (; i > 0 && distances[i - 1] > distance; --i)
+                {
+                    distances[i] = distances[i - 1];
+                    nodes[i] = nodes[i - 1];
+                }
+                distances[i] = distance;
+                nodes[i] = nodeId;
+            };
+
+            for (int i = 0; i < pathNodes.size(); ++i)
+            {
+                if ((i & cahCandidatesDeadlineCheckInterval) == 0 && isPastDeadline())
+                {
+                    m_nearestNodesBefore = Array2<NodeId>(numNodes, numCahInsertionCandidates, invalidNodeId);
+                    m_nearestNodesAfter = Array2<NodeId>(numNodes, numCahInsertionCandidates, invalidNodeId);
+                    return false;
+                }
+
+                const NodeId from = pathNodes[i];
+                for (const NodeId to : pathNodes)
+                {
+                    const DistanceType distance = distanceFromTo(from, to);
+                    if (distance == infiniteDistance)
+                    {
+                        continue;
+                    }
+
+                    insert(afterDistances[from], m_nearestNodesAfter[from], distance, to);
+                    insert(beforeDistances[to], m_nearestNodesBefore[to], distance, from);
+                }
+            }
+
+            return true;
+        }
+
+        // the scc with the vehicle, all sccs with the only instances of some jewel and between them
+        // the paths in the condensation dag through the most jewels not covered yet.
+        // returns false if not every jewel can be covered this way
+        bool chooseSccsForRoute(std::vector<SccId>& route) const
+        {
+            const int numSccs = m_sccs.size();
+            std::vector<std::uint8_t> isCovered(numJewels(), false);
+            auto cover = [&](int sccId) {
+                for (const int jewelId : m_sccs[sccId].jewels)
+                {
+                    isCovered[jewelId] = true;
+                }
+            };
+            auto numUncovered = [&](int sccId) {
+                int n = 0;
+                for (const int jewelId : m_sccs[sccId].jewels)
+                {
+                    n += !isCovered[jewelId];
+                }
+                return n;
+            };
+
+            std::vector<SccId> waypoints{ m_sccIdAt[m_vehicleCoords] };
+            for (const Scc& scc : m_sccs)
+            {
+                const bool isRequired = std::any_of(std::begin(scc.jewels), std::end(scc.jewels), [this](int jewelId) {
+                    return m_numSccsWithJewel[jewelId] == 1;
+                    });
+                if (!isRequired || scc.id == waypoints.front())
+                {
+                    continue;
+                }
+
+                // sccs are in topological order so the new one must be reachable from the previous one
+                if (scc.id < waypoints.back() || m_ifSccTraversedThenSccUnreachable[waypoints.back()][scc.id])
+                {
+                    return false;
+                }
+
+                waypoints.emplace_back(scc.id);
+            }
+
+            for (const int sccId : waypoints)
+            {
+                cover(sccId);
+            }
+
+            // longest path by the number of uncovered jewels from `from` to `to`, or to any scc if `to` is invalid
+            std::vector<int> best(numSccs);
+            std::vector<int> previous(numSccs);
+            auto appendPath = [&](int from, int to) {
+                std::fill(std::begin(best), std::end(best), -1);
+                best[from] = 0;
+                int end = from;
+                for (int id = from + 1; id < numSccs && (to == invalidSccId || id <= to); ++id)
+                {
+                    if (to != invalidSccId && m_ifSccTraversedThenSccUnreachable[id][to])
+                    {
+                        continue;
+                    }
+
+                    for (const int p : m_sccs[id].predecessors)
+                    {
+                        if (best[p] >= 0 && best[p] >= best[id])
+                        {
+                            best[id] = best[p];
+                            previous[id] = p;
+                        }
+                    }
+
+                    if (best[id] < 0)
+                    {
+                        continue;
+                    }
+
+                    best[id] += numUncovered(id);
+                    if (to == invalidSccId && best[id] > best[end])
+                    {
+                        end = id;
+                    }
+                }
+
+                if (to != invalidSccId)
+                {
+                    end = to;
+                }
+
+                const int pathBegin = route.size();
+                for (int id = end; id != from; id = previous[id])
+                {
+                    route.emplace_back(id);
+                    cover(id);
+                }
+                std::reverse(std::begin(route) + pathBegin, std::end(route));
+            };
+
+            route.emplace_back(waypoints.front());
+            for (int i = 1; i < waypoints.size(); ++i)
+            {
+                appendPath(waypoints[i - 1], waypoints[i]);
+            }
+
+            if (std::find(std::begin(isCovered), std::end(isCovered), false) != std::end(isCovered))
+            {
+                appendPath(waypoints.back(), invalidSccId);
+            }
+
+            return std::find(std::begin(isCovered), std::end(isCovered), false) == std::end(isCovered);
+        }
+
+        // bridges are chosen greedily, the one with the start nearest to where the previous one ended.
+        // each jewel not on a bridge is collected in the first scc of the route where a move inside it can take it
+        bool planSccRoute(SccRoute& route) const
+        {
+            if (!chooseSccsForRoute(route.sccs))
+            {
+                return false;
+            }
+
+            const int numSccsInRoute = route.sccs.size();
+            std::vector<std::uint8_t> isCollected(numJewels(), false);
+            int entryNodeId = m_nodeIdByPosition[m_vehicleCoords];
+            for (int i = 0; i + 1 < numSccsInRoute; ++i)
+            {
+                const Move* bestBridge = nullptr;
+                int bestDistance = std::numeric_limits<int>::max();
+                for (const Move* bridge : m_sccs[route.sccs[i]].bridges)
+                {
+                    if (m_sccIdAt[bridge->endPos()] != route.sccs[i + 1])
+                    {
+                        continue;
+                    }
+
+                    const int distance = distanceFromTo(entryNodeId, m_nodeIdByPosition[bridge->startPos()]);
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        bestBridge = bridge;
+                    }
+                }
+
+                if (bestBridge == nullptr)
+                {
+                    return false;
+                }
+
+                for (const int jewelId : bestBridge->jewels())
+                {
+                    isCollected[jewelId] = true;
+                }
+
+                route.bridges.emplace_back(bestBridge);
+                entryNodeId = m_nodeIdByPosition[bestBridge->endPos()];
+            }
+
+            std::vector<int> positionInRoute(m_sccs.size(), -1);
+            for (int i = 0; i < numSccsInRoute; ++i)
+            {
+                positionInRoute[route.sccs[i]] = i;
+            }
+
+            route.jewels.resize(numSccsInRoute);
+            for (int jewelId = 0; jewelId < numJewels(); ++jewelId)
+            {
+                if (isCollected[jewelId])
+                {
+                    continue;
+                }
+
+                int first = numSccsInRoute;
+                for (const Move* move : m_movesCollectingJewel[jewelId])
+                {
+                    const int sccId = m_sccIdAt[move->startPos()];
+                    if (sccId == m_sccIdAt[move->endPos()] && positionInRoute[sccId] >= 0)
+                    {
+                        first = std::min(first, positionInRoute[sccId]);
+                    }
+                }
+
+                if (first == numSccsInRoute)
+                {
+                    return false;
+                }
+
+                route.jewels[first].emplace_back(jewelId);
+            }
+
+            return true;
+        }
+
+        // cheapest insertion of moves collecting the jewels into the path from entry to exit, all inside one scc.
+        // returns the starts and ends of the inserted moves in the order of traversal.
+        // exitNodeId is invalid for the last scc of the route, the path may end anywhere then
+        std::vector<NodeId> planPathInScc(int sccId, int entryNodeId, int exitNodeId, std::vector<JewelId> jewels) const
+        {
+            auto isInside = [&](const Move* move) {
+                return m_sccIdAt[move->startPos()] == sccId && m_sccIdAt[move->endPos()] == sccId;
+            };
+
+            // farthest jewels first, they shape the path
+            std::vector<int> distanceFromEntry(numJewels(), 0);
+            for (const int jewelId : jewels)
+            {
+                int distance = std::numeric_limits<int>::max();
+                for (const Move* move : m_movesCollectingJewel[jewelId])
+                {
+                    if (isInside(move))
+                    {
+                        distance = std::min<int>(distance, distanceFromTo(entryNodeId, m_nodeIdByPosition[move->startPos()]));
+                    }
+                }
+                distanceFromEntry[jewelId] = distance;
+            }
+            std::stable_sort(std::begin(jewels), std::end(jewels), [&](int lhs, int rhs) {
+                return distanceFromEntry[lhs] > distanceFromEntry[rhs];
+                });
+
+            // the entry, pairs of move start and end, then the exit if there is one, like the cah path
+            std::vector<NodeId> nodes{ static_cast<NodeId>(entryNodeId) };
+            if (exitNodeId != invalidNodeId)
+            {
+                nodes.emplace_back(exitNodeId);
+            }
+
+            std::vector<std::uint8_t> isCollected(numJewels(), false);
+            for (const int jewelId : jewels)
+            {
+                if (isCollected[jewelId])
+                {
+                    continue;
+                }
+
+                const Move* bestMove = nullptr;
+                int bestI = -1;
+                int bestCost = std::numeric_limits<int>::max();
+                for (const Move* move : m_movesCollectingJewel[jewelId])
+                {
+                    if (!isInside(move))
+                    {
+                        continue;
+                    }
+
+                    const int moveStartNodeId = m_nodeIdByPosition[move->startPos()];
+                    const int moveEndNodeId = m_nodeIdByPosition[move->endPos()];
+                    for (int i = 0; i < nodes.size(); i += 2)
+                    {
+                        int cost = distanceFromTo(nodes[i], moveStartNodeId) + 1;
+                        if (i + 1 < nodes.size())
+                        {
+                            cost += distanceFromTo(moveEndNodeId, nodes[i + 1]) - distanceFromTo(nodes[i], nodes[i + 1]);
+                        }
+
+                        if (cost < bestCost)
+                        {
+                            bestCost = cost;
+                            bestMove = move;
+                            bestI = i;
+                        }
+                    }
+                }
+
+                const NodeId pair[2] = { m_nodeIdByPosition[bestMove->startPos()], m_nodeIdByPosition[bestMove->endPos()] };
+                nodes.insert(std::begin(nodes) + bestI + 1, std::begin(pair), std::end(pair));
+                for (const int id : bestMove->jewels())
+                {
+                    isCollected[id] = true;
+                }
+            }
+
+            const int numPairNodes = nodes.size() - (exitNodeId != invalidNodeId ? 2 : 1);
+            return std::vector<NodeId>(std::begin(nodes) + 1, std::begin(nodes) + 1 + numPairNodes);
+        }
+
+        // plans the order of sccs first, then the path inside each of them on separate threads
+        // and joins them with the chosen bridges
+        Solution solveUsingSccDecomposition()
+        {
+            const auto timer = m_bench->scopedTimer("sccDecomposition");
+
+            SccRoute route;
+            if (!planSccRoute(route))
+            {
+                return Solution::invalid();
+            }
+
+            const int numParts = route.sccs.size();
+            const int numPartsWithJewels = std::count_if(std::begin(route.jewels), std::end(route.jewels), [](const std::vector<JewelId>& jewels) {
+                return !jewels.empty();
+                });
+            if (numPartsWithJewels < minSccsForDecomposition)
+            {
+                return Solution::invalid();
+            }
+
+            std::vector<int> entries(numParts);
+            std::vector<int> exits(numParts, invalidNodeId);
+            entries[0] = m_nodeIdByPosition[m_vehicleCoords];
+            for (int i = 0; i + 1 < numParts; ++i)
+            {
+                exits[i] = m_nodeIdByPosition[route.bridges[i]->startPos()];
+                entries[i + 1] = m_nodeIdByPosition[route.bridges[i]->endPos()];
+            }
+
+            std::vector<std::vector<NodeId>> parts(numParts);
+            std::atomic<int> nextPart(0);
+            auto planParts = [&]() {
+                for (;;)
+                {
+                    const int i = nextPart++;
+                    if (i >= numParts)
+                    {
+                        return;
+                    }
+
+                    parts[i] = planPathInScc(route.sccs[i], entries[i], exits[i], route.jewels[i]);
+                }
+            };
+
+            std::vector<std::thread> threads;
+            const int numThreads = std::min(m_numThreads, numPartsWithJewels);
+            for (int t = 1; t < numThreads; ++t)
+            {
+                threads.emplace_back(planParts);
+            }
+            planParts();
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            std::vector<NodeId> nodes{ static_cast<NodeId>(entries[0]) };
+            for (int i = 0; i < numParts; ++i)
+            {
+                nodes.insert(std::end(nodes), std::begin(parts[i]), std::end(parts[i]));
+                if (i + 1 < numParts)
+                {
+                    nodes.emplace_back(exits[i]);
+                    nodes.emplace_back(entries[i + 1]);
+                }
+            }
+
+            Solution solution = solutionThroughNodes(nodes);
+            if (!isSolutionValid(solution))
+            {
+                return Solution::invalid();
+            }
+
+            // run removal works on the jewel counts of the whole solution
+            forEachMoveInSolution(solution, [this](const Move& move, const Coords2& pos) {
+                for (const int jewelId : move.jewels())
+                {
+                    m_jewelState.addToCollected(jewelId);
+                }
+            });
+            removeRedundantRuns(solution);
+            m_jewelState.clear();
+
+            return solution;
+        }
+
+        Solution lookForBestSolutionUsingCahHeuristic()
+        {
+            const auto timer = m_bench->scopedTimer("cah");
+
+            const int numMoves = m_allMoves.size();
+
+            std::vector<int> penalties(numMoves, 0);
+            std::vector<int> lastPenaltyIter(numMoves, -1);
+            std::vector<int> numConsecutivePenalties(numMoves, 0);
+
+            std::vector<Solution> bestSolutions;
+            Solution best = Solution::invalid();
+            int v = 0;
+            int i = 0;
+
+            // cah generator needs to know the previous best raw solution length
+            // to know when to apply more costly heuristics
+            int currentBestBeforeReduction = std::numeric_limits<int>::max();
+
+            // partial candidates are not worth keeping
+            if (!m_isPreprocessingCached && computeCahInsertionCandidates())
+            {
+                savePreprocessingCache();
+            }
+
+            // boards split into many sccs get a route planned per scc first, cah has to beat it
+            Solution decomposed = solveUsingSccDecomposition();
+            if (decomposed.exists())
+            {
+                g_logger.log("SCC decomposition: ", decomposed.size(), '\n');
+                if (decomposed.size() <= m_level.maxMoves())
+                {
+                    return decomposed;
+                }
+
+                bestSolutions.emplace_back(decomposed);
+                best = std::move(decomposed);
+            }
+
+            m_scheduler.beginCah();
+            auto lastImprovement = std::chrono::high_resolution_clock::now();
+            for (;;)
+            {
+                ++i;
+                m_bench->count(Counter::CahIterations);
+                Solution solution = Solution::invalid();
+                if (solveUsingCahHeuristic(solution, m_vehicleCoords, penalties, lastPenaltyIter, numConsecutivePenalties, currentBestBeforeReduction, i))
+                {
+                    ++v;
+                    m_bench->count(Counter::ValidCahSolutions);
+                    if (isSolutionValid(solution) && solution.isBetterThan(best))
+                    {
+                        forEachMoveInSolution(solution, [&](const Move & move, const Coords2 & pos) {
+                            penalties[move.id()] -= 1;
+                        });
+
+                        bestSolutions.emplace_back(solution);
+                        best = std::move(solution);
+                        lastImprovement = std::chrono::high_resolution_clock::now();
+                        g_logger.log(i, ": ", best.size(), '\n');
+                    }
+                }
+
+                if (best.exists() && best.size() <= m_level.maxMoves())
+                {
+                    return best;
+                }
+
+                if (m_scheduler.shouldStopCah(lastImprovement) || isPastDeadline()) break;
+            }
+
+            g_logger.log(v, '/', i, " valid CAH solutions\n");
+
+            // on large boards cah plateaus, the memetic search takes its solutions further
+            if (numJewels() >= minJewelsForMemeticSearch && !isPastDeadline())
+            {
+                m_scheduler.beginMemetic();
+                Solution memetic = lookForBestSolutionUsingMemeticSearch(bestSolutions);
+                if (memetic.exists() && memetic.size() <= m_level.maxMoves())
+                {
+                    return memetic;
+                }
+                else if (memetic.isBetterThan(best))
+                {
+                    bestSolutions.emplace_back(memetic);
+                    best = std::move(memetic);
+                }
+            }
+
+            // lns keeps ruining and recreating the best tour instead of recombining a population
+            if (numJewels() >= minJewelsForLns && best.exists() && !isPastDeadline())
+            {
+                m_scheduler.beginLns();
+                Solution improved = improveUsingLargeNeighbourhoodSearch(best);
+                if (improved.exists() && isSolutionValid(improved))
+                {
+                    if (improved.size() <= m_level.maxMoves())
+                    {
+                        return improved;
+                    }
+                    else if (improved.isBetterThan(best))
+                    {
+                        bestSolutions.emplace_back(improved);
+                        best = std::move(improved);
+                    }
+                }
+            }
+
+            // unlike the restarts of cah annealing keeps refining one tour
+            if (best.exists() && !isPastDeadline())
+            {
+                m_scheduler.beginAnnealing();
+                Solution annealed = improveUsingSimulatedAnnealing(best);
+                if (annealed.exists() && isSolutionValid(annealed))
+                {
+                    if (annealed.size() <= m_level.maxMoves())
+                    {
+                        return annealed;
+                    }
+                    else if (annealed.isBetterThan(best))
+                    {
+                        bestSolutions.emplace_back(annealed);
+                        best = std::move(annealed);
+                    }
+                }
+            }
+
+            // try optimising all of them, starting from the most promising ones
+            // this rarely gives an improvement but for large boards
+            // is much more hopeful than later search and for
+            // small ones it goes fast
+            m_scheduler.beginOpt3();
+            std::reverse(std::begin(bestSolutions), std::end(bestSolutions));
+            Solution optimized = postOptimize(std::move(bestSolutions));
+            if (optimized.exists() && optimized.size() <= m_level.maxMoves())
+            {
+                m_bench->end();
+                return optimized;
+            }
+            else if (optimized.isBetterThan(best))
+            {
+                best = std::move(optimized);
+            }
+
+            return best;
+        }
+
+        void postOptimize(Solution& solution, const PostOptimizationContext& context) const
+        {
+            localSearch(solution, context);
+            variableDepthSearch(solution, context);
+            opt3(solution, context);
+        }
+
+        Solution postOptimize(std::vector<Solution> pool) const
+        {
+            // optimizes the solutions on up to m_numThreads threads, identical ones only once
+            // returns the first one (in the pool order) that fits into maxMoves if any, otherwise the shortest one
+            // the other threads are cancelled as soon as a short enough solution is found
+
+            std::vector<std::uint64_t> hashes;
+            pool.erase(std::remove_if(std::begin(pool), std::end(pool), [&](const Solution& solution) {
+                const std::uint64_t hash = solution.hash();
+                if (std::find(std::begin(hashes), std::end(hashes), hash) != std::end(hashes))
+                {
+                    return true;
+                }
+                hashes.emplace_back(hash);
+                return false;
+            }), std::end(pool));
+
+            const int numThreads = std::min(m_numThreads, static_cast<int>(pool.size()));
+            if (numThreads == 0 || isPastDeadline())
+            {
+                return Solution::invalid();
+            }
+
+            // threads not needed for the pool are used for optimizing single solutions in parts
+            const int numThreadsPerSolution = std::max(1, m_numThreads / numThreads);
+            std::atomic<bool> isCancelled(false);
+            std::atomic<int> nextSolution(0);
+            std::vector<Bench> benches(numThreads);
+            auto optimizeSolutions = [&](int threadId) {
+                Bench& bench = benches[threadId];
+                bench.setProfiling(m_bench->isProfiling());
+                const PostOptimizationContext context{ bench, m_scheduler.opt3End(), isCancelled, numThreadsPerSolution };
+                for (;;)
+                {
+                    const int i = nextSolution++;
+                    if (i >= pool.size() || context.shouldStop()) break;
+
+                    Solution& solution = pool[i];
+                    postOptimize(solution, context);
+                    if (!isSolutionValid(solution))
+                    {
+                        solution = Solution::invalid();
+                        continue;
+                    }
+
+                    if (solution.size() <= m_level.maxMoves())
+                    {
+                        isCancelled = true;
+                    }
+                }
+            };
+
+            std::vector<std::thread> threads;
+            for (int threadId = 1; threadId < numThreads; ++threadId)
+            {
+                threads.emplace_back(optimizeSolutions, threadId);
+            }
+            optimizeSolutions(0);
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+
+            for (const Bench& bench : benches)
+            {
+                m_bench->merge(bench);
+            }
+
+            // solutions that were not reached are unchanged so still valid
+            Solution best = Solution::invalid();
+            for (Solution& solution : pool)
+            {
+                if (solution.exists() && solution.size() <= m_level.maxMoves())
+                {
+                    return std::move(solution);
+                }
+                else if (solution.isBetterThan(best))
+                {
+                    best = std::move(solution);
+                }
+            }
+
+            return best;
+        }
+
+        // the moves collecting a jewel not collected before them, in the order of the solution
+        void movesCollectingNewJewels(const Solution& solution, std::vector<const Move*>& moves) const
+        {
+            moves.clear();
+            std::vector<std::uint8_t> isJewelCollected(numJewels(), false);
+            forEachMoveInSolution(solution, [&](const Move& move, const Coords2& pos) {
+                bool anyNewJewels = false;
+                for (const int jewelId : move.jewels())
+                {
+                    if (!isJewelCollected[jewelId])
+                    {
+                        isJewelCollected[jewelId] = true;
+                        anyNewJewels = true;
+                    }
+                }
+
+                if (anyNewJewels)
+                {
+                    moves.emplace_back(&move);
+                }
+            });
+        }
+
+        // joins the moves by shortest paths and shortens the route. The moves are then taken from the result,
+        // so jewels picked up on the way between them no longer need their own move
+        bool decodeTour(JewelTour& tour)
+        {
+            std::vector<NodeId> nodes{ m_nodeIdByPosition[m_vehicleCoords] };
+            for (const Move* move : tour.moves)
+            {
+                nodes.emplace_back(m_nodeIdByPosition[move->startPos()]);
+                nodes.emplace_back(m_nodeIdByPosition[move->endPos()]);
+            }
+
+            tour.solution = solutionThroughNodes(nodes);
+            forEachMoveInSolution(tour.solution, [this](const Move& move, const Coords2& pos) {
+                for (const int jewelId : move.jewels())
+                {
+                    m_jewelState.addToCollected(jewelId);
+                }
+            });
+
+            const bool isComplete = m_jewelState.numLeft() == 0;
+            if (isComplete)
+            {
+                removeRedundantRuns(tour.solution);
+            }
+            m_jewelState.clear();
+
+            if (!isComplete)
+            {
+                tour.solution = Solution::invalid();
+                return false;
+            }
+
+            movesCollectingNewJewels(tour.solution, tour.moves);
+            return true;
+        }
+
+        void countCollectingMoves(const std::vector<const Move*>& moves, std::vector<int>& numCollecting) const
+        {
+            numCollecting.assign(numJewels(), 0);
+            for (const Move* move : moves)
+            {
+                for (const int jewelId : move->jewels())
+                {
+                    numCollecting[jewelId] += 1;
+                }
+            }
+        }
+
+        std::vector<JewelId> uncollectedJewels(const std::vector<int>& numCollecting)
+        {
+            std::vector<JewelId> jewels;
+            for (int jewelId = 0; jewelId < numJewels(); ++jewelId)
+            {
+                if (numCollecting[jewelId] == 0)
+                {
+                    jewels.emplace_back(jewelId);
+                }
+            }
+            std::shuffle(std::begin(jewels), std::end(jewels), m_rng);
+            return jewels;
+        }
+
+        // node before and after each move of the tour
+        void tourNodes(const std::vector<const Move*>& moves, std::vector<NodeId>& starts, std::vector<NodeId>& ends) const
+        {
+            starts.clear();
+            ends.clear();
+            for (const Move* move : moves)
+            {
+                starts.emplace_back(m_nodeIdByPosition[move->startPos()]);
+                ends.emplace_back(m_nodeIdByPosition[move->endPos()]);
+            }
+        }
+
+        // calls f(move, i, cost) for each move collecting the jewel and each place i in [first, last] it can be inserted at
+        // (before moves[i]), with the number of moves it adds to the tour. Unreachable places are skipped
+        template <typename FuncT>
+        void forEachTourInsertion(JewelId jewelId, const std::vector<NodeId>& starts, const std::vector<NodeId>& ends, int first, int last, FuncT&& f) const
+        {
+            const NodeId vehicleNodeId = m_nodeIdByPosition[m_vehicleCoords];
+            const int numMoves = starts.size();
+            for (const Move* move : m_movesCollectingJewel[jewelId])
+            {
+                const int moveStartNodeId = m_nodeIdByPosition[move->startPos()];
+                const int moveEndNodeId = m_nodeIdByPosition[move->endPos()];
+
+                int previousNodeId = first > 0 ? ends[first - 1] : vehicleNodeId;
+                for (int i = first; i <= last; ++i)
+                {
+                    const DistanceType d0 = distanceFromTo(previousNodeId, moveStartNodeId);
+                    const DistanceType d1 = i < numMoves ? distanceFromTo(moveEndNodeId, starts[i]) : 0;
+                    if (d0 != infiniteDistance && d1 != infiniteDistance)
+                    {
+                        f(move, i, d0 + d1 + 1 - (i < numMoves ? distanceFromTo(previousNodeId, starts[i]) : 0));
+                    }
+
+                    if (i < numMoves)
+                    {
+                        previousNodeId = ends[i];
+                    }
+                }
+            }
+        }
+
+        void insertIntoTour(std::vector<const Move*>& moves, std::vector<NodeId>& starts, std::vector<NodeId>& ends, std::vector<int>& numCollecting, const Move* move, int i) const
+        {
+            moves.insert(std::begin(moves) + i, move);
+            starts.insert(std::begin(starts) + i, m_nodeIdByPosition[move->startPos()]);
+            ends.insert(std::begin(ends) + i, m_nodeIdByPosition[move->endPos()]);
+            for (const int jewelId : move->jewels())
+            {
+                numCollecting[jewelId] += 1;
+            }
+        }
+
+        // for each jewel in order that is still not collected the cheapest move collecting it is inserted where it costs the least.
+        // unreachable sccs show up as infinite distances so the order of the sccs is kept.
+        // returns false if some jewel can't be inserted anywhere or the time is up, building a whole tour takes long on large boards
+        bool insertJewelsIntoTour(std::vector<const Move*>& moves, std::vector<int>& numCollecting, const std::vector<JewelId>& jewels) const
+        {
+            std::vector<NodeId> starts;
+            std::vector<NodeId> ends;
+            tourNodes(moves, starts, ends);
+
+            for (const int jewelId : jewels)
+            {
+                if (numCollecting[jewelId] > 0)
+                {
+                    continue;
+                }
+
+                if (isPastDeadline())
+                {
+                    return false;
+                }
+
+                const Move* bestMove = nullptr;
+                int bestPosition = -1;
+                int lowestCost = std::numeric_limits<int>::max();
+                forEachTourInsertion(jewelId, starts, ends, 0, moves.size(), [&](const Move* move, int i, int cost) {
+                    if (cost < lowestCost)
+                    {
+                        lowestCost = cost;
+                        bestMove = move;
+                        bestPosition = i;
+                    }
+                });
+
+                if (bestMove == nullptr)
+                {
+                    return false;
+                }
+
+                insertIntoTour(moves, starts, ends, numCollecting, bestMove, bestPosition);
+            }
+
+            return true;
+        }
+
+        // regret-k insertion: the jewel inserted next is the one that would lose the most by waiting,
+        // measured by how much its k - 1 next cheapest insertions cost more than the cheapest one.
+        // Jewels with fewer than k insertions go first. The k cheapest insertions of each jewel are kept
+        // and after each insertion only the two new places are evaluated, unless one of them was the place taken.
+        // Returns false if some jewel can't be inserted anywhere
+        bool insertJewelsIntoTourByRegret(std::vector<const Move*>& moves, std::vector<int>& numCollecting, const std::vector<JewelId>& jewels, int k) const
+        {
+            struct Insertion
+            {
+                int cost;
+                const Move* move;
+                int position;
+            };
+
+            std::vector<NodeId> starts;
+            std::vector<NodeId> ends;
+            tourNodes(moves, starts, ends);
+
+            // sorted by cost
+            std::vector<std::vector<Insertion>> cheapest(jewels.size());
+            auto evaluate = [&](int j, int first, int last) {
+                std::vector<Insertion>& insertions = cheapest[j];
+                forEachTourInsertion(jewels[j], starts, ends, first, last, [&](const Move* move, int i, int cost) {
+                    if (insertions.size() == k)
+                    {
+                        if (cost >= insertions.back().cost)
+                        {
+                            return;
+                        }
+                        insertions.pop_back();
+                    }
+                    const auto it = std::find_if(std::begin(insertions), std::end(insertions), [cost](const Insertion& insertion) {
+                        return cost < insertion.cost;
+                        });
+                    insertions.insert(it, Insertion{ cost, move, i });
+                });
+            };
+
+            for (int j = 0; j < jewels.size(); ++j)
+            {
+                evaluate(j, 0, moves.size());
+            }
+
+            for (;;)
+            {
+                int chosen = -1;
+                int highestRegret = -1;
+                for (int j = 0; j < jewels.size(); ++j)
+                {
+                    if (numCollecting[jewels[j]] > 0)
+                    {
+                        continue;
+                    }
+
+                    const std::vector<Insertion>& insertions = cheapest[j];
+                    if (insertions.empty())
+                    {
+                        return false;
+                    }
+
+                    int regret = 0;
+                    for (int h = 1; h < k; ++h)
+                    {
+                        regret += h < insertions.size() ? insertions[h].cost - insertions[0].cost : infiniteDistance;
+                    }
+
+                    if (regret > highestRegret || (regret == highestRegret && insertions[0].cost < cheapest[chosen][0].cost))
+                    {
+                        highestRegret = regret;
+                        chosen = j;
+                    }
+                }
+
+                if (chosen == -1)
+                {
+                    return true;
+                }
+
+                const Insertion insertion = cheapest[chosen][0];
+                insertIntoTour(moves, starts, ends, numCollecting, insertion.move, insertion.position);
+
+                for (int j = 0; j < jewels.size(); ++j)
+                {
+                    if (numCollecting[jewels[j]] > 0)
+                    {
+                        continue;
+                    }
+
+                    // the place taken is split in two, the ones after it move by one
+                    std::vector<Insertion>& insertions = cheapest[j];
+                    bool isStale = false;
+                    for (Insertion& other : insertions)
+                    {
+                        isStale |= other.position == insertion.position;
+                        other.position += other.position > insertion.position;
+                    }
+
+                    if (isStale)
+                    {
+                        insertions.clear();
+                        evaluate(j, 0, moves.size());
+                    }
+                    else
+                    {
+                        evaluate(j, insertion.position, insertion.position + 1);
+                    }
+                }
+            }
+        }
+
+        // removes numRemoved moves (fewer if a random sample hits some move twice or the scc has fewer moves)
+        void ruinTour(std::vector<const Move*>& moves, std::vector<int>& numCollecting, TourRuin ruin, int numRemoved)
+        {
+            const int numMoves = moves.size();
+            if (numMoves == 0)
+            {
+                return;
+            }
+            numRemoved = std::clamp(numRemoved, 1, numMoves);
+
+            std::vector<std::uint8_t> isRemoved(numMoves, false);
+            switch (ruin)
+            {
+            case TourRuin::Random:
+            {
+                for (int i = 0; i < numRemoved; ++i)
+                {
+                    isRemoved[std::uniform_int_distribution<int>(0, numMoves - 1)(m_rng)] = true;
+                }
+                break;
+            }
+
+            case TourRuin::Segment:
+            {
+                const int begin = std::uniform_int_distribution<int>(0, numMoves - numRemoved)(m_rng);
+                std::fill(std::begin(isRemoved) + begin, std::begin(isRemoved) + begin + numRemoved, true);
+                break;
+            }
+
+            case TourRuin::Spatial:
+            {
+                const Coords2 center = moves[std::uniform_int_distribution<int>(0, numMoves - 1)(m_rng)]->startPos();
+                std::vector<std::pair<int, int>> distances;
+                for (int i = 0; i < numMoves; ++i)
+                {
+                    const Coords2 pos = moves[i]->startPos();
+                    distances.emplace_back(std::abs(pos.x - center.x) + std::abs(pos.y - center.y), i);
+                }
+
+                std::partial_sort(std::begin(distances), std::begin(distances) + numRemoved, std::end(distances));
+                for (int i = 0; i < numRemoved; ++i)
+                {
+                    isRemoved[distances[i].second] = true;
+                }
+                break;
+            }
+
+            case TourRuin::Scc:
+            {
+                const SccId sccId = m_sccIdAt[moves[std::uniform_int_distribution<int>(0, numMoves - 1)(m_rng)]->startPos()];
+                std::vector<int> inScc;
+                for (int i = 0; i < numMoves; ++i)
+                {
+                    if (m_sccIdAt[moves[i]->startPos()] == sccId)
+                    {
+                        inScc.emplace_back(i);
+                    }
+                }
+
+                std::shuffle(std::begin(inScc), std::end(inScc), m_rng);
+                for (int i = 0; i < std::min<int>(numRemoved, inScc.size()); ++i)
+                {
+                    isRemoved[inScc[i]] = true;
+                }
+                break;
+            }
+
+            default:
+            {
+                const NodeId vehicleNodeId = m_nodeIdByPosition[m_vehicleCoords];
+                std::vector<std::pair<int, int>> savings;
+                for (int i = 0; i < numMoves; ++i)
+                {
+                    const int previousNodeId = i > 0 ? m_nodeIdByPosition[moves[i - 1]->endPos()] : vehicleNodeId;
+                    const int startNodeId = m_nodeIdByPosition[moves[i]->startPos()];
+                    const int endNodeId = m_nodeIdByPosition[moves[i]->endPos()];
+                    int saving = distanceFromTo(previousNodeId, startNodeId) + 1;
+                    if (i + 1 < numMoves)
+                    {
+                        const int nextNodeId = m_nodeIdByPosition[moves[i + 1]->startPos()];
+                        saving += distanceFromTo(endNodeId, nextNodeId) - distanceFromTo(previousNodeId, nextNodeId);
+                    }
+                    savings.emplace_back(saving, i);
+                }
+
+                std::partial_sort(std::begin(savings), std::begin(savings) + numRemoved, std::end(savings), std::greater<>());
+                for (int i = 0; i < numRemoved; ++i)
+                {
+                    isRemoved[savings[i].second] = true;
+                }
+                break;
+            }
+            }
+
+            int j = 0;
+            for (int i = 0; i < numMoves; ++i)
+            {
+                if (isRemoved[i])
+                {
+                    for (const int jewelId : moves[i]->jewels())
+                    {
+                        numCollecting[jewelId] -= 1;
+                    }
+                }
+                else
+                {
+                    moves[j++] = moves[i];
+                }
+            }
+            moves.resize(j);
+        }
+
+        // each move stands for one jewel only it collects (moves without such a jewel are dropped),
+        // keeping that order the cheapest combination of moves collecting them is found by dynamic programming
+        // over the layers of candidates. Jewels only the replaced moves collected are inserted again later
+        bool reselectTourMoves(std::vector<const Move*>& moves, std::vector<int>& numCollecting) const
+        {
+            std::vector<JewelId> representedJewels;
+            int j = 0;
+            for (const Move* move : moves)
+            {
+                const auto& jewels = move->jewels();
+                const auto it = std::find_if(std::begin(jewels), std::end(jewels), [&](int jewelId) {
+                    return numCollecting[jewelId] == 1;
+                    });
+                if (it == std::end(jewels))
+                {
+                    for (const int jewelId : jewels)
+                    {
+                        numCollecting[jewelId] -= 1;
+                    }
+                    continue;
+                }
+
+                representedJewels.emplace_back(*it);
+                moves[j++] = move;
+            }
+            moves.resize(j);
+
+            const int numLayers = moves.size();
+            std::vector<std::vector<int>> costs(numLayers);
+            std::vector<std::vector<int>> predecessors(numLayers);
+            for (int layer = 0; layer < numLayers; ++layer)
+            {
+                const std::vector<const Move*>& candidates = m_movesCollectingJewel[representedJewels[layer]];
+                costs[layer].assign(candidates.size(), std::numeric_limits<int>::max());
+                predecessors[layer].assign(candidates.size(), -1);
+                for (int c = 0; c < candidates.size(); ++c)
+                {
+                    const int startNodeId = m_nodeIdByPosition[candidates[c]->startPos()];
+                    if (layer == 0)
+                    {
+                        const DistanceType d = distanceFromTo(m_nodeIdByPosition[m_vehicleCoords], startNodeId);
+                        if (d != infiniteDistance)
+                        {
+                            costs[layer][c] = d + 1;
+                        }
+                        continue;
+                    }
+
+                    const std::vector<const Move*>& previousCandidates = m_movesCollectingJewel[representedJewels[layer - 1]];
+                    for (int p = 0; p < previousCandidates.size(); ++p)
+                    {
+                        const int previousCost = costs[layer - 1][p];
+                        if (previousCost == std::numeric_limits<int>::max())
+                        {
+                            continue;
+                        }
+
+                        const DistanceType d = distanceFromTo(m_nodeIdByPosition[previousCandidates[p]->endPos()], startNodeId);
+                        if (d != infiniteDistance && previousCost + d + 1 < costs[layer][c])
+                        {
+                            costs[layer][c] = previousCost + d + 1;
+                            predecessors[layer][c] = p;
+                        }
+                    }
+                }
+            }
+
+            if (numLayers == 0)
+            {
+                return true;
+            }
+
+            const auto& lastCosts = costs.back();
+            int c = std::min_element(std::begin(lastCosts), std::end(lastCosts)) - std::begin(lastCosts);
+            if (lastCosts[c] == std::numeric_limits<int>::max())
+            {
+                return false;
+            }
+
+            for (int layer = numLayers - 1; layer >= 0; --layer)
+            {
+                moves[layer] = m_movesCollectingJewel[representedJewels[layer]][c];
+                c = predecessors[layer][c];
+            }
+
+            countCollectingMoves(moves, numCollecting);
+            return true;
+        }
+
+        // order crossover: a random segment of the first parent stays in place,
+        // the rest is filled with the moves of the second one that still collect something new
+        std::vector<const Move*> crossTours(const JewelTour& first, const JewelTour& second)
+        {
+            const int size = first.moves.size();
+            int begin = std::uniform_int_distribution<int>(0, size - 1)(m_rng);
+            int end = std::uniform_int_distribution<int>(0, size - 1)(m_rng);
+            if (begin > end)
+            {
+                std::swap(begin, end);
+            }
+            ++end;
+
+            std::vector<std::uint8_t> isJewelCollected(numJewels(), false);
+            for (int i = begin; i < end; ++i)
+            {
+                for (const int jewelId : first.moves[i]->jewels())
+                {
+                    isJewelCollected[jewelId] = true;
+                }
+            }
+
+            std::vector<const Move*> rest;
+            for (const Move* move : second.moves)
+            {
+                bool anyNewJewels = false;
+                for (const int jewelId : move->jewels())
+                {
+                    if (!isJewelCollected[jewelId])
+                    {
+                        isJewelCollected[jewelId] = true;
+                        anyNewJewels = true;
+                    }
+                }
+
+                if (anyNewJewels)
+                {
+                    rest.emplace_back(move);
+                }
+            }
+
+            const int split = std::min<int>(begin, rest.size());
+            std::vector<const Move*> moves(std::begin(rest), std::begin(rest) + split);
+            moves.insert(std::end(moves), std::begin(first.moves) + begin, std::begin(first.moves) + end);
+            moves.insert(std::end(moves), std::begin(rest) + split, std::end(rest));
+            return moves;
+        }
+
+        // moves reselected once and then ruined and recreated, every step is kept unless it makes the route longer
+        void improveTour(JewelTour& tour)
+        {
+            std::vector<int> numCollecting;
+            for (int step = 0; step <= numMemeticLocalSearchSteps; ++step)
+            {
+                if (isPastDeadline())
+                {
+                    return;
+                }
+
+                JewelTour candidate;
+                candidate.moves = tour.moves;
+                countCollectingMoves(candidate.moves, numCollecting);
+                if (step == 0)
+                {
+                    if (!reselectTourMoves(candidate.moves, numCollecting))
+                    {
+                        continue;
+                    }
+                }
+                else
+                {
+                    const int numMoves = candidate.moves.size();
+                    const int maxRemoved = std::min(numMoves, std::max(2, static_cast<int>(numMoves * maxMemeticRuinFraction)));
+                    const auto ruin = static_cast<TourRuin>(std::uniform_int_distribution<int>(0, static_cast<int>(TourRuin::WorstCost))(m_rng));
+                    ruinTour(candidate.moves, numCollecting, ruin, std::uniform_int_distribution<int>(1, std::max(1, maxRemoved))(m_rng));
+                }
+
+                if (insertJewelsIntoTour(candidate.moves, numCollecting, uncollectedJewels(numCollecting))
+                    && decodeTour(candidate)
+                    && candidate.solution.size() <= tour.solution.size())
+                {
+                    tour = std::move(candidate);
+                }
+            }
+        }
+
+        // generalized tsp view of the problem, every jewel is a cluster of the moves collecting it and
+        // one of them has to be in the route. A population of tours is evolved by crossover and
+        // local search (GLNS by Smith and Imeson is the inspiration), seeded with the given solutions
+        Solution lookForBestSolutionUsingMemeticSearch(const std::vector<Solution>& seeds)
+        {
+            const auto timer = m_bench->scopedTimer("memetic");
+
+            std::vector<JewelTour> population;
+            auto isInPopulation = [&](const Solution& solution) {
+                const std::uint64_t hash = solution.hash();
+                return std::any_of(std::begin(population), std::end(population), [hash](const JewelTour& tour) {
+                    return tour.solution.hash() == hash;
+                    });
+            };
+
+            // the seeds are ordered from the worst
+            for (auto it = seeds.rbegin(); it != seeds.rend() && population.size() < memeticPopulationSize; ++it)
+            {
+                if (!it->exists() || isInPopulation(*it))
+                {
+                    continue;
+                }
+
+                JewelTour tour;
+                tour.solution = *it;
+                movesCollectingNewJewels(tour.solution, tour.moves);
+                population.emplace_back(std::move(tour));
+            }
+
+            // the rest are built by cheapest insertion in random order
+            std::vector<int> numCollecting;
+            for (int attempt = 0; population.size() < memeticPopulationSize && attempt < memeticPopulationSize; ++attempt)
+            {
+                // no best solution yet, so only the end of the share counts
+                if (m_scheduler.shouldStopMemetic(std::numeric_limits<int>::max()) || isPastDeadline())
+                {
+                    break;
+                }
+
+                JewelTour tour;
+                countCollectingMoves(tour.moves, numCollecting);
+                if (insertJewelsIntoTour(tour.moves, numCollecting, uncollectedJewels(numCollecting)) && decodeTour(tour) && !isInPopulation(tour.solution))
+                {
+                    improveTour(tour);
+                    population.emplace_back(std::move(tour));
+                }
+            }
+
+            if (population.empty())
+            {
+                return Solution::invalid();
+            }
+
+            auto isShorter = [](const JewelTour& lhs, const JewelTour& rhs) {
+                return lhs.solution.size() < rhs.solution.size();
+            };
+
+            Solution best = std::min_element(std::begin(population), std::end(population), isShorter)->solution;
+
+            // binary tournament
+            auto selectParent = [&]() -> const JewelTour& {
+                std::uniform_int_distribution<int> d(0, population.size() - 1);
+                const JewelTour& a = population[d(m_rng)];
+                const JewelTour& b = population[d(m_rng)];
+                return isShorter(b, a) ? b : a;
+            };
+
+            while (best.size() > m_level.maxMoves() && !m_scheduler.shouldStopMemetic(best.size()) && !isPastDeadline())
+            {
+                m_bench->count(Counter::MemeticGenerations);
+
+                JewelTour child;
+                child.moves = crossTours(selectParent(), selectParent());
+                countCollectingMoves(child.moves, numCollecting);
+                if (!insertJewelsIntoTour(child.moves, numCollecting, uncollectedJewels(numCollecting)) || !decodeTour(child))
+                {
+                    continue;
+                }
+
+                improveTour(child);
+
+                // replaces the worst one, duplicates would make the population converge too fast
+                auto worst = std::max_element(std::begin(population), std::end(population), isShorter);
+                if (!isShorter(child, *worst) || isInPopulation(child.solution))
+                {
+                    continue;
+                }
+
+                if (child.solution.isBetterThan(best) && isSolutionValid(child.solution))
+                {
+                    best = child.solution;
+                    m_bench->count(Counter::MemeticImprovements);
+                    g_logger.log("memetic: ", best.size(), '\n');
+                }
+                *worst = std::move(child);
+            }
+
+            return best;
+        }
+
+        // ruin and recreate large neighbourhood search on the moves of one tour. Each iteration removes some of them
+        // (see TourRuin) and inserts the jewels left uncollected again, cheapest first in random order or by regret.
+        // The result becomes the current tour if it is longer than the record by at most lnsRecordDeviation
+        // (record-to-record travel). Tours are compared by the length of their links, only new records are decoded
+        Solution improveUsingLargeNeighbourhoodSearch(const Solution& initial)
+        {
+            const auto timer = m_bench->scopedTimer("lns");
+
+            std::vector<const Move*> current;
+            movesCollectingNewJewels(initial, current);
+            if (current.empty())
+            {
+                return Solution::invalid();
+            }
+
+            const NodeId vehicleNodeId = m_nodeIdByPosition[m_vehicleCoords];
+            std::vector<NodeId> starts;
+            std::vector<NodeId> ends;
+            auto tourLength = [&](const std::vector<const Move*>& moves) {
+                tourNodes(moves, starts, ends);
+                int length = moves.size();
+                NodeId previousNodeId = vehicleNodeId;
+                for (int i = 0; i < moves.size(); ++i)
+                {
+                    const DistanceType d = distanceFromTo(previousNodeId, starts[i]);
+                    if (d == infiniteDistance)
+                    {
+                        return std::numeric_limits<int>::max();
+                    }
+                    length += d;
+                    previousNodeId = ends[i];
+                }
+                return length;
+            };
+
+            Solution best = initial;
+            int recordLength = tourLength(current);
+            std::vector<const Move*> candidate;
+            std::vector<int> numCollecting;
+            while (best.size() > m_level.maxMoves() && !m_scheduler.shouldStopLns(best.size()) && !isPastDeadline())
+            {
+                m_bench->count(Counter::LnsIterations);
+
+                candidate = current;
+                countCollectingMoves(candidate, numCollecting);
+                const int maxRemoved = std::clamp(static_cast<int>(candidate.size() * maxLnsRuinFraction), 2, maxLnsRuinSize);
+                const auto ruin = static_cast<TourRuin>(std::uniform_int_distribution<int>(0, static_cast<int>(TourRuin::Count) - 1)(m_rng));
+                ruinTour(candidate, numCollecting, ruin, std::uniform_int_distribution<int>(2, maxRemoved)(m_rng));
+
+                const int k = std::uniform_int_distribution<int>(1, maxLnsRegret)(m_rng);
+                const bool isRepaired = k == 1
+                    ? insertJewelsIntoTour(candidate, numCollecting, uncollectedJewels(numCollecting))
+                    : insertJewelsIntoTourByRegret(candidate, numCollecting, uncollectedJewels(numCollecting), k);
+                if (!isRepaired)
+                {
+                    continue;
+                }
+
+                const int length = tourLength(candidate);
+                if (length == std::numeric_limits<int>::max() || length > recordLength + lnsRecordDeviation)
+                {
+                    continue;
+                }
+
+                current.swap(candidate);
+                if (length >= recordLength)
+                {
+                    continue;
+                }
+
+                // decoding may pick up jewels on the way and drop their moves
+                JewelTour tour;
+                tour.moves = current;
+                if (!decodeTour(tour))
+                {
+                    recordLength = length;
+                    continue;
+                }
+
+                current = tour.moves;
+                recordLength = std::min(length, tourLength(current));
+                if (tour.solution.isBetterThan(best))
+                {
+                    best = std::move(tour.solution);
+                    m_bench->count(Counter::LnsImprovements);
+                    g_logger.log("lns: ", best.size(), '\n');
+                }
+            }
+
+            return best;
+        }
+
+        // simulated annealing over the order of the tour and the move chosen for each jewel. Neighbours swap two moves,
+        // move one elsewhere or replace it by another move collecting the jewels only it collects (or drop it if there are none).
+        // The change of the length is computed from the links to the neighbouring moves only, the temperature falls
+        // exponentially over the time given by the scheduler. The best tour seen is decoded at the end
+        Solution improveUsingSimulatedAnnealing(const Solution& initial)
+        {
+            const auto timer = m_bench->scopedTimer("annealing");
+
+            std::vector<const Move*> moves;
+            movesCollectingNewJewels(initial, moves);
+            if (moves.size() < 2)
+            {
+                return Solution::invalid();
+            }
+
+            std::vector<int> numCollecting;
+            countCollectingMoves(moves, numCollecting);
+
+            std::vector<NodeId> starts;
+            std::vector<NodeId> ends;
+            for (const Move* move : moves)
+            {
+                starts.emplace_back(m_nodeIdByPosition[move->startPos()]);
+                ends.emplace_back(m_nodeIdByPosition[move->endPos()]);
+            }
+
+            const NodeId vehicleNodeId = m_nodeIdByPosition[m_vehicleCoords];
+
+            // distance from the previous move to moves[i], 0 past the end
+            auto link = [&](int i) -> int {
+                if (i >= static_cast<int>(moves.size()))
+                {
+                    return 0;
+                }
+                return distanceFromTo(i > 0 ? ends[i - 1] : vehicleNodeId, starts[i]);
+            };
+
+            auto insertAt = [&](int i, const Move* move) {
+                moves.insert(std::begin(moves) + i, move);
+                starts.insert(std::begin(starts) + i, m_nodeIdByPosition[move->startPos()]);
+                ends.insert(std::begin(ends) + i, m_nodeIdByPosition[move->endPos()]);
+            };
+
+            auto eraseAt = [&](int i) {
+                moves.erase(std::begin(moves) + i);
+                starts.erase(std::begin(starts) + i);
+                ends.erase(std::begin(ends) + i);
+            };
+
+            auto swapAt = [&](int i, int j) {
+                std::swap(moves[i], moves[j]);
+                std::swap(starts[i], starts[j]);
+                std::swap(ends[i], ends[j]);
+            };
+
+            auto replaceAt = [&](int i, const Move* move) {
+                moves[i] = move;
+                starts[i] = m_nodeIdByPosition[move->startPos()];
+                ends[i] = m_nodeIdByPosition[move->endPos()];
+            };
+
+            int length = static_cast<int>(moves.size());
+            for (int i = 0; i < static_cast<int>(moves.size()); ++i)
+            {
+                length += link(i);
+            }
+
+            std::vector<const Move*> bestMoves = moves;
+            int bestLength = length;
+
+            const auto begin = std::chrono::high_resolution_clock::now();
+            const auto budget = m_scheduler.annealingEnd() - begin;
+            double temperature = annealingStartTemperature;
+            std::uniform_real_distribution<double> unit(0.0, 1.0);
+            auto isAccepted = [&](int delta) {
+                return delta <= 0 || unit(m_rng) < std::exp(-delta / temperature);
+            };
+
+            for (std::uint64_t iteration = 0;; ++iteration)
+            {
+                if ((iteration & annealingTimeCheckInterval) == 0)
+                {
+                    const auto now = std::chrono::high_resolution_clock::now();
+                    if (now > m_scheduler.annealingEnd() || isPastDeadline())
+                    {
+                        break;
+                    }
+
+                    const double elapsed = std::chrono::duration<double>(now - begin) / budget;
+                    temperature = annealingStartTemperature * std::pow(annealingEndTemperature / annealingStartTemperature, elapsed);
+                }
+
+                const int numMoves = moves.size();
+                const int i = std::uniform_int_distribution<int>(0, numMoves - 1)(m_rng);
+                const int j = std::clamp(i + std::uniform_int_distribution<int>(-maxAnnealingShift, maxAnnealingShift)(m_rng), 0, numMoves - 1);
+                const int kind = std::uniform_int_distribution<int>(0, 2)(m_rng);
+
+                if (kind == 0)
+                {
+                    if (i == j)
+                    {
+                        continue;
+                    }
+
+                    // links i, i + 1, j and j + 1 change
+                    int affected[] = { i, i + 1, j, j + 1 };
+                    std::sort(std::begin(affected), std::end(affected));
+                    auto sumOfLinks = [&]() {
+                        int sum = 0;
+                        for (int k = 0; k < 4; ++k)
+                        {
+                            if (k == 0 || affected[k] != affected[k - 1])
+                            {
+                                sum += link(affected[k]);
+                            }
+                        }
+                        return sum;
+                    };
+
+                    const int before = sumOfLinks();
+                    swapAt(i, j);
+                    const int after = sumOfLinks();
+                    if (after < infiniteDistance && isAccepted(after - before))
+                    {
+                        length += after - before;
+                    }
+                    else
+                    {
+                        swapAt(i, j);
+                    }
+                }
+                else if (kind == 1)
+                {
+                    if (i == j)
+                    {
+                        continue;
+                    }
+
+                    const Move* move = moves[i];
+                    const int removedBefore = link(i) + link(i + 1);
+                    eraseAt(i);
+                    const int removedAfter = link(i);
+                    const int insertedBefore = link(j);
+                    insertAt(j, move);
+                    const int insertedAfter = link(j) + link(j + 1);
+
+                    const int delta = removedAfter - removedBefore + insertedAfter - insertedBefore;
+                    if (removedAfter < infiniteDistance && insertedAfter < infiniteDistance && isAccepted(delta))
+                    {
+                        length += delta;
+                    }
+                    else
+                    {
+                        eraseAt(j);
+                        insertAt(i, move);
+                    }
+                }
+                else
+                {
+                    const Move* move = moves[i];
+                    auto isOnlyCollector = [&](int jewelId) {
+                        return numCollecting[jewelId] == 1;
+                    };
+
+                    JewelId uniqueJewelId = invalidJewelId;
+                    for (const int jewelId : move->jewels())
+                    {
+                        if (isOnlyCollector(jewelId))
+                        {
+                            uniqueJewelId = jewelId;
+                            break;
+                        }
+                    }
+
+                    const int before = link(i) + link(i + 1);
+                    if (uniqueJewelId == invalidJewelId)
+                    {
+                        // collects nothing needed, dropping it never makes the tour longer
+                        eraseAt(i);
+                        length += link(i) - before - 1;
+                        for (const int jewelId : move->jewels())
+                        {
+                            numCollecting[jewelId] -= 1;
+                        }
+                        if (moves.size() < 2)
+                        {
+                            break;
+                        }
+                        continue;
+                    }
+
+                    // the replacement has to collect all the jewels that only this move collects
+                    const std::vector<const Move*>& candidates = m_movesCollectingJewel[uniqueJewelId];
+                    const Move* replacement = candidates[std::uniform_int_distribution<int>(0, candidates.size() - 1)(m_rng)];
+                    if (replacement == move)
+                    {
+                        continue;
+                    }
+
+                    const bool collectsAll = std::all_of(std::begin(move->jewels()), std::end(move->jewels()), [&](int jewelId) {
+                        return !isOnlyCollector(jewelId) || std::find(std::begin(replacement->jewels()), std::end(replacement->jewels()), jewelId) != std::end(replacement->jewels());
+                        });
+                    if (!collectsAll)
+                    {
+                        continue;
+                    }
+
+                    replaceAt(i, replacement);
+                    const int after = link(i) + link(i + 1);
+                    if (after < infiniteDistance && isAccepted(after - before))
+                    {
+                        length += after - before;
+                        for (const int jewelId : move->jewels())
+                        {
+                            numCollecting[jewelId] -= 1;
+                        }
+                        for (const int jewelId : replacement->jewels())
+                        {
+                            numCollecting[jewelId] += 1;
+                        }
+                    }
+                    else
+                    {
+                        replaceAt(i, move);
+                    }
+                }
+
+                if (length < bestLength)
+                {
+                    bestLength = length;
+                    bestMoves = moves;
+                }
+            }
+
+            JewelTour tour;
+            tour.moves = std::move(bestMoves);
+            if (!decodeTour(tour))
+            {
+                return Solution::invalid();
+            }
+
+            g_logger.log("annealing: ", tour.solution.size(), '\n');
+            return tour.solution;
+        }
+
+        bool solveUsingCahHeuristic(
+            Solution & solution,
+            const Coords2 & start,
+            std::vector<int>& penalties,
+            std::vector<int>& lastPenaltyIter,
+            std::vector<int>& numConsecutivePenalties,
+            int& currentBestBeforeReduction,
+            int iter)
+        {
+            // based on what is briefly described in
+            // https://www.researchgate.net/publication/307583744_The_Traveling_Purchaser_Problem_and_its_Variants p. 14
+            // along with checks regarding solvability due to possiblity of having
+            // many strongly connected components
+            // Also applies penalty to edges that led to blockages
+
+            // to avoid multiple allocations
+            std::vector<Direction> pathBuffer;
+
+            auto addJewelsFromPath = [this, &pathBuffer](int startNodeId, int endNodeId)
+            {
+                Coords2 c = m_nodePositionById[startNodeId];
+                pathBuffer.clear();
+                shortestPathFromTo(m_nodePositionById[startNodeId], m_nodePositionById[endNodeId], pathBuffer);
+                forEachMoveInSolution(pathBuffer, c, [&](const Move & move, const Coords2 & pos) {
+                    for (const int jewelId : move.jewels())
+                    {
+                        m_jewelState.addToCollected(jewelId);
+                    }
+                });
+            };
+
+            auto removeJewelsFromPath = [this, &pathBuffer](int startNodeId, int endNodeId)
+            {
+                Coords2 c = m_nodePositionById[startNodeId];
+                pathBuffer.clear();
+                shortestPathFromTo(m_nodePositionById[startNodeId], m_nodePositionById[endNodeId], pathBuffer);
+                forEachMoveInSolution(pathBuffer, c, [&](const Move & move, const Coords2 & pos) {
+                    for (const int jewelId : move.jewels())
+                    {
+                        m_jewelState.removeFromCollected(jewelId);
+                    }
+                });
+            };
+
+            auto applyPenaltiesToPath = [&](const std::vector<NodeId> & path)
+            {
+                Coords2 c = start;
+                for (int i = 0; i + 1 < path.size(); i += 1)
+                {
+                    const int startNodeId = path[i];
+                    const int endNodeId = path[i + 1];
+                    const DistanceType distance = distanceFromTo(startNodeId, endNodeId);
+                    pathBuffer.clear();
+                    shortestPathFromTo(m_nodePositionById[startNodeId], m_nodePositionById[endNodeId], pathBuffer);
+
+                    forEachMoveInSolution(pathBuffer, c, [&](const Move & move, const Coords2 & pos) {
+                        const int moveId = move.id();
+                        auto old = penalties[moveId];
+                        if (iter > lastPenaltyIter[moveId] + 1)
+                        {
+                            numConsecutivePenalties[moveId] = 0;
+                        }
+
+                        penalties[moveId] += numConsecutivePenalties[moveId] * 2 + 1;
+                        ++numConsecutivePenalties[moveId];
+                        lastPenaltyIter[moveId] = iter;
+                    });
+                }
+            };
+
+            const int numJewels = m_jewelState.numJewels();
+
+            // one entry per jewel of the level, so jewels that stand for many dropped ones come up early more often
+            std::vector<JewelId> jewelIdsShuffled = m_keptJewelIdByOriginalJewelId;
+            std::shuffle(std::begin(jewelIdsShuffled), std::end(jewelIdsShuffled), m_rng);
+
+            std::vector<NodeId> nodesInPath;
+            nodesInPath.emplace_back(m_nodeIdByPosition[start]);
+
+            // edits of nodesInPath made while trying an exchange so a failed one can be undone
+            struct PathEdit
+            {
+                int position;
+                NodeId nodes[2];
+                bool isInsertion;
+            };
+            std::vector<PathEdit> pathJournal;
+            bool isJournalingPath = false;
+
+            // positions of each node in nodesInPath, in no particular order. Built once the path gets long enough
+            // for the candidate lists and then kept up to date by the edits, which only shift the positions after
+            // the edited one, so an edit still costs time linear in the rest of the path
+            std::vector<std::vector<int>> pathPositionsOfNode(m_nodePositionById.size());
+            bool isPathIndexed = false;
+            auto indexPath = [&]() {
+                if (isPathIndexed)
+                {
+                    return;
+                }
+                for (int i = 0; i < nodesInPath.size(); ++i)
+                {
+                    pathPositionsOfNode[nodesInPath[i]].emplace_back(i);
+                }
+                isPathIndexed = true;
+            };
+
+            auto movePathPosition = [&](int from, int to) {
+                std::vector<int>& positions = pathPositionsOfNode[nodesInPath[to]];
+                *std::find(std::begin(positions), std::end(positions), from) = to;
+            };
+
+            auto insertIntoPath = [&](int position, NodeId first, NodeId second) {
+                const NodeId nodes[] = { first, second };
+                nodesInPath.insert(std::begin(nodesInPath) + position, std::begin(nodes), std::end(nodes));
+                if (isPathIndexed)
+                {
+                    // from the end so a node never has the same position twice
+                    for (int i = static_cast<int>(nodesInPath.size()) - 1; i >= position + 2; --i)
+                    {
+                        movePathPosition(i - 2, i);
+                    }
+                    pathPositionsOfNode[first].emplace_back(position);
+                    pathPositionsOfNode[second].emplace_back(position + 1);
+                }
+                if (isJournalingPath)
+                {
+                    pathJournal.push_back(PathEdit{ position, { first, second }, true });
+                }
+            };
+
+            auto eraseFromPath = [&](int position) {
+                if (isJournalingPath)
+                {
+                    pathJournal.push_back(PathEdit{ position, { nodesInPath[position], nodesInPath[position + 1] }, false });
+                }
+                if (isPathIndexed)
+                {
+                    for (int i = position; i < position + 2; ++i)
+                    {
+                        std::vector<int>& positions = pathPositionsOfNode[nodesInPath[i]];
+                        positions.erase(std::find(std::begin(positions), std::end(positions), i));
+                    }
+                }
+                nodesInPath.erase(std::begin(nodesInPath) + position, std::begin(nodesInPath) + position + 2);
+                if (isPathIndexed)
+                {
+                    for (int i = position; i < nodesInPath.size(); ++i)
+                    {
+                        movePathPosition(i + 2, i);
+                    }
+                }
+            };
+
+            auto beginJournal = [&]() {
+                m_jewelState.beginJournal();
+                pathJournal.clear();
+                isJournalingPath = true;
+            };
+
+            auto commitJournal = [&]() {
+                m_jewelState.commitJournal();
+                isJournalingPath = false;
+            };
+
+            auto rollbackJournal = [&]() {
+                m_jewelState.rollbackJournal();
+                isJournalingPath = false;
+                for (auto it = pathJournal.rbegin(); it != pathJournal.rend(); ++it)
+                {
+                    if (it->isInsertion)
+                    {
+                        eraseFromPath(it->position);
+                    }
+                    else
+                    {
+                        insertIntoPath(it->position, it->nodes[0], it->nodes[1]);
+                    }
+                }
+            };
+
+            std::vector<std::uint8_t> isTraversed(m_sccs.size(), false);
+            std::vector<std::uint8_t> mayBeEnterable(m_sccs.size(), true);
+            isTraversed[m_sccIdAt[start]] = true;
+
+            // candidate lists miss insertions where the move lies on the way between two distant nodes,
+            // that hurts the initial construction so they are only used for reinsertions in exchange
+            auto insertForJewel = [&](int jewelId, bool mayUseCandidates) -> int {
+                const Move* bestMove = nullptr;
+                int bestI = -1;
+                int lowestDistance = std::numeric_limits<int>::max();
+                int additionalDistance = infiniteDistance;
+
+                auto findBestInsertion = [&](bool useCandidates) {
+                    for (auto move : m_movesCollectingJewel[jewelId])
+                    {
+                        // if going to this scc would prevent us from accessing any jewel
+                        // (because we would lose access to its only scc) then mark this scc as a no go
+                        const int startSccId = m_sccIdAt[move->startPos()];
+                        const int endSccId = m_sccIdAt[move->endPos()];
+                        if (mayBeEnterable[startSccId] && !remainsSolvableAfterEnteringScc(isTraversed, startSccId))
+                        {
+                            mayBeEnterable[startSccId] = false;
+                            continue;
+                        }
+                        if (mayBeEnterable[endSccId] && !remainsSolvableAfterEnteringScc(isTraversed, endSccId))
+                        {
+                            mayBeEnterable[endSccId] = false;
+                            continue;
+                        }
+
+                        const int numJewelsOnTheWay = static_cast<int>(move->jewels().size());
+                        const int moveValue = numJewelsOnTheWay - penalties[move->id()];
+
+                        const int thisMoveStartId = m_nodeIdByPosition[move->startPos()];
+                        const int thisMoveEndId = m_nodeIdByPosition[move->endPos()];
+
+                        // inserts the move after nodesInPath[i]
+                        auto evaluateInsertion = [&](int i) {
+                            const int startNodeId = nodesInPath[i];
+                            const int endNodeId = nodesInPath[i + 1];
+                            const DistanceType d0 = distanceFromTo(startNodeId, thisMoveStartId);
+                            const DistanceType d1 = distanceFromTo(thisMoveEndId, endNodeId);
+                            const DistanceType dOld = distanceFromTo(startNodeId, endNodeId);
+                            if (d0 == infiniteDistance || d1 == infiniteDistance)
+                            {
+                                return;
+                            }
+                            const int distance = d0 + d1 - dOld - moveValue;
+                            if (distance < lowestDistance)
+                            {
+                                bestI = i;
+                                lowestDistance = distance;
+                                bestMove = move;
+                                additionalDistance = d0 + d1 - dOld;
+                            }
+                        };
+
+                        // we skip one edge each iteration because we have to go through it and collect the jewels
+                        // only edges starting at a node near the start of the move or ending at a node near its end
+                        // the candidates are walked until enough of them are found in the path
+                        int numBefore = 0;
+                        int numAfter = 0;
+                        for (int k = 0; useCandidates && k < numCahInsertionCandidates; ++k)
+                        {
+                            const NodeId before = m_nearestNodesBefore[thisMoveStartId][k];
+                            if (before != invalidNodeId && numBefore < numCahInsertionCandidatesInPath && !pathPositionsOfNode[before].empty())
+                            {
+                                ++numBefore;
+                                for (const int i : pathPositionsOfNode[before])
+                                {
+                                    if (i % 2 == 0 && i + 1 < nodesInPath.size()) evaluateInsertion(i);
+                                }
+                            }
+
+                            const NodeId after = m_nearestNodesAfter[thisMoveEndId][k];
+                            if (after != invalidNodeId && numAfter < numCahInsertionCandidatesInPath && !pathPositionsOfNode[after].empty())
+                            {
+                                ++numAfter;
+                                for (const int i : pathPositionsOfNode[after])
+                                {
+                                    if (i % 2 == 1) evaluateInsertion(i - 1);
+                                }
+                            }
+                        }
+
+                        if (!useCandidates || numBefore + numAfter == 0)
+                        {
+                            for (int i = 0; i + 1 < nodesInPath.size(); i += 2)
+                            {
+                                evaluateInsertion(i);
+                            }
+                        }
+
+                        const int dn = distanceFromTo(nodesInPath.back(), thisMoveStartId);
+                        const int distance = dn - moveValue;
+                        if (dn != infiniteDistance && distance < lowestDistance)
+                        {
+                            bestI = nodesInPath.size() - 1;
+                            lowestDistance = distance;
+                            bestMove = move;
+                            additionalDistance = dn;
+                        }
+                    }
+                };
+
+                // the candidates may all be missing from the path, then the whole path is searched
+                const bool useCandidates = mayUseCandidates && nodesInPath.size() >= minCahPathSizeForCandidates;
+                if (useCandidates)
+                {
+                    indexPath();
+                    findBestInsertion(true);
+                }
+                if (bestI < 0)
+                {
+                    findBestInsertion(false);
+                }
+
+                if (bestI < 0)
+                {
+                    applyPenaltiesToPath(nodesInPath);
+                    m_jewelState.clear();
+                    return infiniteDistance;
+                }
+
+                for (const int jewelId : bestMove->jewels())
+                {
+                    m_jewelState.addToCollected(jewelId);
+                }
+
+                const int bestMoveStartId = m_nodeIdByPosition[bestMove->startPos()];
+                const int bestMoveEndId = m_nodeIdByPosition[bestMove->endPos()];
+
+                isTraversed[m_sccIdAt[bestMove->startPos()]] = true;
+                isTraversed[m_sccIdAt[bestMove->endPos()]] = true;
+
+                {
+                    const int startNodeId = nodesInPath[bestI];
+                    addJewelsFromPath(startNodeId, bestMoveStartId);
+
+                    if (bestI != nodesInPath.size() - 1)
+                    {
+                        const int endNodeId = nodesInPath[bestI + 1];
+                        addJewelsFromPath(bestMoveEndId, endNodeId);
+                        removeJewelsFromPath(startNodeId, endNodeId);
+                    }
+                }
+
+                insertIntoPath(bestI + 1, bestMoveStartId, bestMoveEndId);
+
+                return additionalDistance + 1;
+            };
+
+            while (m_jewelState.numLeft() > 0)
+            {
+                for (const int jewelId : jewelIdsShuffled)
+                {
+                    if (m_jewelState.isCollected(jewelId))
+                    {
+                        continue;
+                    }
+
+                    if (isPastDeadline())
+                    {
+                        m_jewelState.clear();
+                        return false;
+                    }
+
+                    if (insertForJewel(jewelId, false) == infiniteDistance)
+                    {
+                        return false;
+                    }
+                }
+            }
+
+            auto tryExchange = [&](int i) -> bool {
+                const int startNodeId = nodesInPath[i];
+                const int leftMiddleNodeId = nodesInPath[i + 1];
+                const int rightMiddleNodeId = nodesInPath[i + 2];
+                int endNodeId = invalidNodeId;
+                int distanceSaved = 0;
+                {
+                    removeJewelsFromPath(startNodeId, leftMiddleNodeId);
+                    removeJewelsFromPath(leftMiddleNodeId, rightMiddleNodeId);
+
+                    distanceSaved = distanceFromTo(startNodeId, leftMiddleNodeId);
+
+                    if (i + 3 < nodesInPath.size())
+                    {
+                        endNodeId = nodesInPath[i + 3];
+                        removeJewelsFromPath(rightMiddleNodeId, endNodeId);
+                        addJewelsFromPath(startNodeId, endNodeId);
+
+                        distanceSaved +=
+                            distanceFromTo(rightMiddleNodeId, endNodeId)
+                            - distanceFromTo(startNodeId, endNodeId);
+                    }
+                }
+
+                eraseFromPath(i + 1);
+
+                int addedDistance = 0;
+
+                while (m_jewelState.numLeft() > 0)
+                {
+                    for (int jewelId = m_jewelState.nextUncollected(0); jewelId < numJewels; jewelId = m_jewelState.nextUncollected(jewelId + 1))
+                    {
+                        addedDistance += insertForJewel(jewelId, true);
+                    }
+                }
+
+                return addedDistance < distanceSaved;
+            };
+
+            auto exchange = [&]() -> bool {
+                bool anyImprovement = false;
+
+                // we skip one edge each iteration because we have to go through it and collect the jewels
+                for (int i = 0; i + 1 < nodesInPath.size(); i += 2)
+                {
+                    if (isPastDeadline())
+                    {
+                        break;
+                    }
+
+                    beginJournal();
+                    if (tryExchange(i))
+                    {
+                        commitJournal();
+                        anyImprovement = true;
+                    }
+                    else
+                    {
+                        rollbackJournal();
+                    }
+                }
+
+                return anyImprovement;
+            };
+
+            solution = solutionThroughNodes(nodesInPath);
+
+            // shorten all possible subpaths. Here we do it only to get the length of the shortened solution
+            {
+                JewelState oldState = m_jewelState;
+                removeRedundantRuns(solution);
+                m_jewelState = std::move(oldState);
+            }
+
+            if (solution.size() < currentBestBeforeReduction)
+            {
+                currentBestBeforeReduction = solution.size();
+
+                // exchange markets until not improvement can be made
+                for (;;)
+                {
+                    if (solution.size() <= m_level.maxMoves())
+                    {
+                        break;
+                    }
+
+                    if (!exchange())
+                    {
+                        break;
+                    }
+                }
+            }
+
+            // again do the same as before exchange
+            solution = solutionThroughNodes(nodesInPath);
+            // shorten all possible subpaths
+            removeRedundantRuns(solution);
+
+            m_jewelState.clear();
+
+            solution.setExists(true);
+
+            return true;
+        }
+
+        void initializeSkipProbability()
+        {
+            const int maxMoves = m_level.maxMoves();
+            m_skipProbabilityAtDepth.resize(m_level.maxMoves(), 0.0f);
+
+            for (int i = 0; i < maxMoves; ++i)
+            {
+                int skip = maxMoves / std::sqrt(maxMoves - i) + 1;
+                skip *= skip;
+                if (i <= minDepthToAllowSkip || isPerfectSquare(i))
+                {
+                    m_skipProbabilityAtDepth[i] = 0.0f;
+                }
+                else
+                {
+                    m_skipProbabilityAtDepth[i] = 1.0f - 1.0f / static_cast<float>(skip);
+                }
+            }
+        }
+
+        std::vector<Coords2> coordsAlongSolution(const Solution & solution) const
+        {
+            // [i] contains the position of the vehicle before move solution[i]
+
+            std::vector<Coords2> r{};
+            r.reserve(solution.size() + 1);
+
+            Coords2 coords = m_vehicleCoords;
+            r.emplace_back(coords);
+            for (int i = 0; i < solution.size(); ++i)
+            {
+                const Moves& moves = m_movesByPosition[coords];
+                const Move& move = moves[solution[i]];
+                coords = move.endPos();
+                r.emplace_back(coords);
+            }
+
+            return r;
+        }
+
+        // the jewelState must describe the solution, it's kept up to date
+        int removeRedundantRuns(Solution & solution)
+        {
+            const auto timer = m_bench->scopedTimer("runRemoval");
+
+            // a run is a sequence of consecutive moves that collect only jewels that are collected elsewhere too
+            // it can be replaced by the shortest path between its ends if that one is shorter.
+            // each pass puts the longest run starting at each position into a queue ordered by improvement
+            // and replaces all of them that don't overlap and are still redundant, rebuilding the solution once.
+            // passes are repeated until nothing is removed
+            // returns the number of removed runs
+
+            struct Run
+            {
+                int improvement;
+                int start;
+                int length;
+
+                bool operator<(const Run& other) const
+                {
+                    return improvement < other.improvement;
+                }
+            };
+
+            int numRemoved = 0;
+            std::vector<int> numOmitted(numJewels(), 0);
+            std::vector<std::uint8_t> isReplaced;
+            std::vector<std::pair<Run, std::vector<Direction>>> replacements;
+            for (;;)
+            {
+                const std::vector<Coords2> starts = coordsAlongSolution(solution);
+                const int solLength = solution.size();
+                auto moveAt = [&](int i) -> const Move& {
+                    return m_movesByPosition[starts[i]][solution[i]];
+                };
+
+                auto omit = [&](const Move& move, int n) {
+                    for (const int jewelId : move.jewels())
+                    {
+                        numOmitted[jewelId] += n;
+                    }
+                };
+
+                auto isOmittable = [&](const Move& move) {
+                    for (const int jewelId : move.jewels())
+                    {
+                        if (m_jewelState.numCollected(jewelId) - numOmitted[jewelId] < 2)
+                        {
+                            return false;
+                        }
+                    }
+                    return true;
+                };
+
+                // two pointers, numOmitted counts jewels on [begin, end)
+                std::priority_queue<Run> runs;
+                for (int begin = 0, end = 0; begin < solLength; ++begin)
+                {
+                    while (end < solLength && isOmittable(moveAt(end)))
+                    {
+                        omit(moveAt(end), 1);
+                        ++end;
+                    }
+
+                    if (end == begin)
+                    {
+                        ++end;
+                        continue;
+                    }
+
+                    const int length = end - begin;
+                    const int improvement = length - distanceFromTo(m_nodeIdByPosition[starts[begin]], m_nodeIdByPosition[starts[end]]);
+                    if (improvement > 0)
+                    {
+                        runs.push(Run{ improvement, begin, length });
+                    }
+
+                    omit(moveAt(begin), -1);
+                }
+
+                isReplaced.assign(solLength, false);
+                replacements.clear();
+                while (!runs.empty())
+                {
+                    const Run run = runs.top();
+                    runs.pop();
+
+                    const auto runBegin = std::begin(isReplaced) + run.start;
+                    const auto runEnd = runBegin + run.length;
+                    if (std::find(runBegin, runEnd, true) != runEnd)
+                    {
+                        continue;
+                    }
+
+                    // the runs replaced so far may have made it necessary
+                    bool isRedundant = true;
+                    for (int i = run.start; i < run.start + run.length; ++i)
+                    {
+                        isRedundant = isRedundant && isOmittable(moveAt(i));
+                        omit(moveAt(i), 1);
+                    }
+                    for (int i = run.start; i < run.start + run.length; ++i)
+                    {
+                        omit(moveAt(i), -1);
+                    }
+
+                    std::vector<Direction> path;
+                    if (!isRedundant || !pathFromToWithLength(starts[run.start], starts[run.start + run.length], run.length - 1, path))
+                    {
+                        continue;
+                    }
+
+                    for (int i = run.start; i < run.start + run.length; ++i)
+                    {
+                        for (const int jewelId : moveAt(i).jewels())
+                        {
+                            m_jewelState.removeFromCollected(jewelId);
+                        }
+                    }
+                    Coords2 coords = starts[run.start];
+                    for (const Direction dir : path)
+                    {
+                        const Move& move = m_movesByPosition[coords][dir];
+                        for (const int jewelId : move.jewels())
+                        {
+                            m_jewelState.addToCollected(jewelId);
+                        }
+                        coords = move.endPos();
+                    }
+
+                    std::fill(runBegin, runEnd, true);
+                    replacements.emplace_back(run, std::move(path));
+                }
+
+                if (replacements.empty())
+                {
                     break;
                 }
 
-                solution = solutionThroughNodes(nodesInPathCoalesced, successors);
+                std::sort(std::begin(replacements), std::end(replacements), [](const auto& lhs, const auto& rhs) {
+                    return lhs.first.start < rhs.first.start;
+                });
+
+                Solution shortened = Solution::empty();
+                shortened.setExists(solution.exists());
+                int i = 0;
+                for (const auto& replacement : replacements)
+                {
+                    for (; i < replacement.first.start; ++i)
+                    {
+                        shortened.push(solution[i]);
+                    }
+                    shortened.append(replacement.second);
+                    i += replacement.first.length;
+                }
+                for (; i < solLength; ++i)
+                {
+                    shortened.push(solution[i]);
+                }
+                solution = std::move(shortened);
+
+                numRemoved += replacements.size();
+                m_bench->count(Counter::RunRemovals, replacements.size());
+            }
+
+            return numRemoved;
+        }
+
+        bool shortestPathFromTo(const Coords2 & fromCoords, const Coords2 & toCoords, std::vector<Direction> & path) const
+        {
+            const int from = m_nodeIdByPosition[fromCoords];
+            int to = m_nodeIdByPosition[toCoords];
+            return pathFromToWithLength(fromCoords, toCoords, distanceFromTo(from, to), path);
+        }
+
+        bool pathFromToWithLength(const Coords2 & fromCoords, const Coords2 & toCoords, int length, std::vector<Direction> & path) const
+        {
+            // returns false if no such path exists
+
+            int from = m_nodeIdByPosition[fromCoords];
+            const int to = m_nodeIdByPosition[toCoords];
+            if (distanceFromTo(from, to) > length)
+            {
+                return false;
+            }
+
+            while (from != to)
+            {
+                if (length-- <= 0)
+                {
+                    return false;
+                }
+
+                const int distance = distanceFromTo(from, to);
+
+                const auto& moves = m_movesByPosition[m_nodePositionById[from]];
+                int newFrom = from;
+                for (Direction dir : DirectionHelper::values())
+                {
+                    const auto& move = moves[dir];
+
+                    if (move.id() < 0)
+                    {
+                        continue;
+                    }
+
+                    const int newFromCandidate = m_nodeIdByPosition[move.endPos()];
+                    if (distanceFromTo(newFromCandidate, to) < distance)
+                    {
+                        path.emplace_back(dir);
+                        newFrom = newFromCandidate;
+                        break;
+                    }
+                }
+
+                if (from == newFrom)
+                {
+                    return false;
+                }
+                else
+                {
+                    from = newFrom;
+                }
+            }
+
+            return true;
+        }
+
+        SmallVector<const Move*, 8> orderMoves(const Moves & moves) const
+        {
+            SmallVector<const Move*, 8> dirs;
+
+            for (Direction dir : DirectionHelper::values())
+            {
+                const Move& move = moves[dir];
+
+                if (move.id() < 0)
+                {
+                    continue;
+                }
+
+                const Coords2& start = move.startPos();
+                const Coords2& end = move.endPos();
+                const int startSccId = m_sccIdAt[start];
+                const int endSccId = m_sccIdAt[end];
+                if (startSccId != endSccId && !canMoveToScc(endSccId))
+                {
+                    continue;
+                }
+
+                dirs.emplace_back(&moves[dir]);
+            }
+
+            std::sort(std::begin(dirs), std::end(dirs), [this, &moves](const Move * lhs, const Move * rhs) {
+                return m_totalPotentialAtEdge[lhs->id()] > m_totalPotentialAtEdge[rhs->id()];
+                });
+
+            return dirs;
+        }
+
+        bool canMoveToScc(int id) const
+        {
+            // there are possibilties of false positives
+            // but they should be rare and only impact performance
+            // ability to find a solution is unharmed
+
+            if (id == invalidSccId)
+            {
+                return false;
+            }
+
+            const int numJewels = m_jewelState.numJewels();
+            for (int jewelId = m_jewelState.nextUncollected(0); jewelId < numJewels; jewelId = m_jewelState.nextUncollected(jewelId + 1))
+            {
+                if (id > m_lastSccWithJewel[jewelId])
+                {
+                    // we must already have this jewel, because we can't pick it later
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        const Move* findNearestMoveWithUncollectedJewel(const Coords2 & start)
+        {
+            const int numJewels = m_jewelState.numJewels();
+
+            const int startNodeId = m_nodeIdByPosition[start];
+
+            const Move* bestMove = nullptr;
+            int bestMoveDistance = std::numeric_limits<int>::max();
+            for (int jewelId = m_jewelState.nextUncollected(0); jewelId < numJewels; jewelId = m_jewelState.nextUncollected(jewelId + 1))
+            {
+                for (const Move* move : m_movesCollectingJewel[jewelId])
+                {
+                    const int startSccId = m_sccIdAt[move->startPos()];
+                    const int endSccId = m_sccIdAt[move->endPos()];
+                    if (startSccId != endSccId && !canMoveToScc(endSccId))
+                    {
+                        continue;
+                    }
+
+                    const int moveStartNodeId = m_nodeIdByPosition[move->startPos()];
+                    const DistanceType distance = distanceFromTo(startNodeId, moveStartNodeId);
+                    if (distance < bestMoveDistance)
+                    {
+                        bestMoveDistance = distance;
+                        bestMove = move;
+                    }
+                }
+            }
+
+            return bestMove;
+        }
+
+        Solution solveUsingSearchWithBacktracking(const Coords2& coords, int movesLeft, int depth, int additionalMoves)
+        {
+            const auto timer = m_bench->scopedTimer("backtracking");
+
+            int minDepth = 0;
+            Solution solution = Solution::empty();
+            if (solveUsingSearchWithBacktracking(solution, coords, movesLeft, depth, additionalMoves, minDepth))
+            {
+                return solution;
+            }
+            return Solution::invalid();
+        }
+
+        bool solveUsingSearchWithBacktracking(Solution & solution, const Coords2 & coords, int movesLeft, int depth, int additionalMoves, int& minDepth)
+        {
+            m_bench->node();
+
+            // the whole search is abandoned when out of time, the state is not restored
+            if ((m_bench->nodes() & deadlineCheckInterval) == 0)
+            {
+                isPastDeadline();
+            }
+
+            if (m_isOutOfTime)
+            {
+                return false;
+            }
+
+            if (depth < minDepth)
+            {
+                minDepth = depth;
+            }
+
+            const Moves& moves = m_movesByPosition[coords];
+
+            const auto orderedMoves = orderMoves(moves);
+            if (m_searchStatistics)
+            {
+                m_searchStatistics->node(depth, orderedMoves.size());
+                m_searchStatistics->cutoff(depth, Cutoff::Scc, countMovesAt(coords) - orderedMoves.size());
+            }
+
+            if (orderedMoves.empty())
+            {
+                return false;
+            }
+
+            const float maxPotential = static_cast<float>(m_totalPotentialAtEdge[orderedMoves[0]->id()]);
+            const float potentialThreshold = maxPotential * pruningFactor;
+            for (int moveIndex = 0; moveIndex < orderedMoves.size(); ++moveIndex)
+            {
+                if (m_isOutOfTime)
+                {
+                    return false;
+                }
+
+                const Move& move = *orderedMoves[moveIndex];
 
-                window = std::min(static_cast<int>(window * opt3WindowIncreaseFactor), static_cast<int>(nodesInPathCoalesced.size()));
-            }
-        }
+                const float potential = static_cast<float>(m_totalPotentialAtEdge[move.id()]);
+                if (potential < potentialThreshold)
+                {
+                    if (m_searchStatistics) m_searchStatistics->cutoff(depth, Cutoff::Pruning, orderedMoves.size() - moveIndex);
+                    return false;
+                }
 
-        int numJewels() const
-        {
-            return m_jewelState.numJewels();
-        }
+                const Coords2& end = move.endPos();
 
-        Solution lookForBestSolutionUsingCahHeuristicForTime(std::chrono::milliseconds time)
-        {
-            const int numMoves = m_allMoves.size();
+                const int oldNumJewelsLeft = m_numJewelsLeftWhenSolvingAt[end];
+                if (m_jewelState.numLeft() - move.numUncollectedJewelsOnTheWay(m_jewelState) >= oldNumJewelsLeft)
+                {
+                    // we have not made progress and we are in the
+                    // same state as when we were here previously
 
-            std::vector<int> penalties(numMoves, 0);
-            std::vector<int> lastPenaltyIter(numMoves, -1);
-            std::vector<int> numConsecutivePenalties(numMoves, 0);
+                    // if potential is not very well defined here then try to move to the
+                    // nearest edge that collects a new jewel
 
-            std::vector<Solution> bestSolutions;
-            Solution best = Solution::invalid();
-            int v = 0;
-            int i = 0;
+                    // TODO: fill m_numJewelsLeftWhenSolvingAt correctly
+                    if (m_searchStatistics) m_searchStatistics->cutoff(depth, Cutoff::Revisit);
+                    if (potential < uncertainPotentialThreshold)
+                    {
+                        if (m_searchStatistics) m_searchStatistics->fallback();
+                        const Move* bestMove = findNearestMoveWithUncollectedJewel(coords);
+                        if (bestMove == nullptr)
+                        {
+                            return false;
+                        }
 
-            // cah generator needs to know the previous best raw solution length
-            // to know when to apply more costly heuristics
-            int currentBestBeforeReduction = std::numeric_limits<int>::max();
+                        std::vector<Direction> path;
+                        // this appends twice to the same path, effectively joining them
+                        if (shortestPathFromTo(coords, bestMove->startPos(), path) && shortestPathFromTo(bestMove->startPos(), bestMove->endPos(), path))
+                        {
+                            if (path.size() > -additionalMoves)
+                            {
+                                if (m_searchStatistics) m_searchStatistics->cutoff(depth, Cutoff::Horizon);
+                                return false;
+                            }
 
-            for (;;)
-            {
-                ++i;
-                Solution solution = Solution::invalid();
-                if (solveUsingCahHeuristic(solution, m_vehicleCoords, penalties, lastPenaltyIter, numConsecutivePenalties, currentBestBeforeReduction, i))
-                {
-                    ++v;
-                    if (isSolutionValid(solution) && solution.isBetterThan(best))
-                    {
-                        forEachMoveInSolution(solution, [&](const Move & move, const Coords2 & pos) {
-                            penalties[move.id()] -= 1;
-                        });
+                            Coords2 newCoords = coords;
+                            forEachMoveInSolution(path, newCoords, [&](const Move & move, const Coords2 & coords) {
+                                for (int jewel : move.jewels())
+                                {
+                                    if (m_jewelState.addToCollected(jewel))
+                                    {
+                                        onJewelContributionDisabled(jewel);
+                                    }
+                                }
 
-                        bestSolutions.emplace_back(solution);
-                        best = std::move(solution);
-                        g_logger.log(i, ": ", best.size(), '\n');
+                                solution.push(move.direction());
+                            });
+
+                            if (solveUsingSearchWithBacktracking(solution, newCoords, movesLeft - path.size(), depth + path.size(), additionalMoves, minDepth))
+                            {
+                                return true;
+                            }
+                            else
+                            {
+                                // backtrack
+                                Coords2 newCoords = coords;
+                                forEachMoveInSolution(path, newCoords, [&](const Move & move, const Coords2 & coords) {
+                                    for (int jewel : move.jewels())
+                                    {
+                                        if (m_jewelState.removeFromCollected(jewel))
+                                        {
+                                            onJewelContributionEnabled(jewel);
+                                        }
+                                    }
+
+                                    solution.pop();
+                                });
+                                return false;
+                            }
+                        }
+                        else
+                        {
+                            return false;
+                        }
                     }
+
+                    continue;
                 }
 
-                if (best.exists() && best.size() <= m_level.maxMoves())
+                auto discard = [this, &solution, &move, oldNumJewelsLeft]()
                 {
-                    return best;
+                    for (int jewel : move.jewels())
+                    {
+                        if (m_jewelState.removeFromCollected(jewel))
+                        {
+                            onJewelContributionEnabled(jewel);
+                        }
+                    }
+
+                    m_numJewelsLeftWhenSolvingAt[move.endPos()] = oldNumJewelsLeft;
+                    solution.pop();
+                };
+                solution.push(move.direction());
+
+                for (int jewel : move.jewels())
+                {
+                    if (m_jewelState.addToCollected(jewel))
+                    {
+                        onJewelContributionDisabled(jewel);
+                    }
                 }
 
-                if (m_bench->elapsedToNow() > maxTimeForStochasticHeuristic) break;
-            }
+                m_numJewelsLeftWhenSolvingAt[end] = m_jewelState.numLeft();
 
-            g_logger.log(v, '/', i, " valid CAH solutions\n");
+                if (m_jewelState.numLeft() == 0)
+                {
+                    if (solution.size() > m_level.maxMoves())
+                    {
+                        if (minDepth > m_level.maxMoves() - additionalMoves * 0.70710678118654752440084436210485f)
+                        {
+                            discard();
+                            return false;
+                        }
 
-            // try optimising all of them, starting from the most promising ones
-            // this rarely gives an improvement but for large boards
-            // is much more hopeful than later search and for
-            // small ones it goes fast
-            std::reverse(std::begin(bestSolutions), std::end(bestSolutions));
-            for (Solution& sol : bestSolutions)
-            {
-                if (m_bench->elapsedToNow() > maxTimeForStochasticHeuristic + maxTimeForOpt3) break;
+                        minDepth = depth;
+                        JewelState jc = m_jewelState;
+                        Solution cpy = solution;
+                        removeRedundantRuns(cpy);
+                        m_jewelState = jc;
+                        if (isSolutionValid(cpy) && cpy.size() <= m_level.maxMoves())
+                        {
+                            solution = cpy;
+                            return true;
+                        }
+                        else
+                        {
+                            discard();
+
+                            return false;
+                        }
+                    }
 
-                opt3(sol);
-                if (!isSolutionValid(sol))
+                    return true;
+                }
+                else if (movesLeft > -additionalMoves)
                 {
-                    continue;
+                    if (solveUsingSearchWithBacktracking(solution, end, movesLeft - 1, depth + 1, additionalMoves, minDepth))
+                    {
+                        return true;
+                    }
+                    else if (movesLeft > 0)
+                    {
+                        const float skipProbability = 1.0f - (1.0f - m_skipProbabilityAtDepth[depth]) * potential / (maxPotential + 1);
+                        if (std::bernoulli_distribution(skipProbability)(m_rng))
+                        {
+                            if (m_searchStatistics) m_searchStatistics->cutoff(depth, Cutoff::Skip);
+                            discard();
+                            return false;
+                        }
+                    }
+                    else if (movesLeft <= 0)
+                    {
+                        if (m_searchStatistics) m_searchStatistics->cutoff(depth, Cutoff::Horizon);
+                        discard();
+                        return false;
+                    }
                 }
-
-                if (sol.size() <= m_level.maxMoves())
+                else if (m_searchStatistics)
                 {
-                    m_bench->end();
-                    return sol;
+                    m_searchStatistics->cutoff(depth, Cutoff::Horizon);
                 }
-                else if (sol.isBetterThan(best))
+
+                discard();
+            }
+
+            return false;
+        }
+
+        int countMovesAt(const Coords2 & pos) const
+        {
+            int c = 0;
+            const Moves& moves = m_movesByPosition[pos];
+            for (Direction dir : DirectionHelper::values())
+            {
+                const Move& move = moves[dir];
+
+                if (move.id() >= 0)
                 {
-                    best = std::move(sol);
+                    ++c;
                 }
             }
 
-            return best;
+            return c;
         }
 
-        bool solveUsingCahHeuristic(
-            Solution & solution,
-            const Coords2 & start,
-            std::vector<int>& penalties,
-            std::vector<int>& lastPenaltyIter,
-            std::vector<int>& numConsecutivePenalties,
-            int& currentBestBeforeReduction,
-            int iter)
+        void fillInitialMovePotential()
         {
-            // based on what is briefly described in
-            // https://www.researchgate.net/publication/307583744_The_Traveling_Purchaser_Problem_and_its_Variants p. 14
-            // along with checks regarding solvability due to possiblity of having
-            // many strongly connected components
-            // Also applies penalty to edges that led to blockages
+            const int numEdges = static_cast<int>(m_allMoves.size());
 
-            // to avoid multiple allocations
-            std::vector<Direction> pathBuffer;
+            for (int edgeId = 0; edgeId < numEdges; ++edgeId)
+            {
+                const Move& move = *(m_allMoves[edgeId]);
+                for (const int jewelId : move.jewels())
+                {
+                    m_potentialOfJewelAtEdge[jewelId][edgeId] = maxPotential;
+                }
+            }
+        }
 
-            auto addJewelsFromPath = [this, &pathBuffer](int startNodeId, int endNodeId)
+        void printAllMovesFlat() const
+        {
+            for (const Move* movePtr : m_allMoves)
             {
-                Coords2 c = m_nodePositionById[startNodeId];
-                pathBuffer.clear();
-                shortestPathFromTo(m_nodePositionById[startNodeId], m_nodePositionById[endNodeId], pathBuffer);
-                forEachMoveInSolution(pathBuffer, c, [&](const Move & move, const Coords2 & pos) {
-                    for (const int jewelId : move.jewels())
+                const Move& move = *movePtr;
+                const Coords2& start = move.startPos();
+                const Coords2& end = move.endPos();
+                if (end != start && end != Coords2(0, 0))
+                {
+                    g_logger.log("(", start.x, ", ", start.y, ") -> (", end.x, ", ", end.y, "): ");
+                    for (int id : move.jewels())
                     {
-                        m_jewelState.addToCollected(jewelId);
+                        g_logger.log(id, ' ');
                     }
-                });
-            };
+                    g_logger.log(" [", m_totalPotentialAtEdge[move.id()], "]");
+                }
+                g_logger.log('\n');
+            }
+        }
+
+        void printPotential()
+        {
+            const int numEdges = static_cast<int>(m_allMoves.size());
 
-            auto removeJewelsFromPath = [this, &pathBuffer](int startNodeId, int endNodeId)
+            g_logger.log("    ");
+            for (int edgeId = 0; edgeId < numEdges; ++edgeId)
             {
-                Coords2 c = m_nodePositionById[startNodeId];
-                pathBuffer.clear();
-                shortestPathFromTo(m_nodePositionById[startNodeId], m_nodePositionById[endNodeId], pathBuffer);
-                forEachMoveInSolution(pathBuffer, c, [&](const Move & move, const Coords2 & pos) {
-                    for (const int jewelId : move.jewels())
-                    {
-                        m_jewelState.removeFromCollected(jewelId);
-                    }
-                });
-            };
+                g_logger.log(std::setw(3), edgeId, ' ');
+            }
+            g_logger.log('\n');
 
-            auto applyPenaltiesToPath = [&](const std::vector<NodeId> & path)
+            for (int jewelId = 0; jewelId < numJewels(); ++jewelId)
             {
-                Coords2 c = start;
-                for (int i = 0; i + 1 < path.size(); i += 1)
+                g_logger.log(std::setw(2), jewelId, ": ");
+                for (int edgeId = 0; edgeId < numEdges; ++edgeId)
                 {
-                    const int startNodeId = path[i];
-                    const int endNodeId = path[i + 1];
-                    const DistanceType distance = m_distanceFromTo[startNodeId][endNodeId];
-                    pathBuffer.clear();
-                    shortestPathFromTo(m_nodePositionById[startNodeId], m_nodePositionById[endNodeId], pathBuffer);
-
-                    forEachMoveInSolution(pathBuffer, c, [&](const Move & move, const Coords2 & pos) {
-                        const int moveId = move.id();
-                        auto old = penalties[moveId];
-                        if (iter > lastPenaltyIter[moveId] + 1)
-                        {
-                            numConsecutivePenalties[moveId] = 0;
-                        }
-
-                        penalties[moveId] += numConsecutivePenalties[moveId] * 2 + 1;
-                        ++numConsecutivePenalties[moveId];
-                        lastPenaltyIter[moveId] = iter;
-                    });
+                    g_logger.log(std::setw(3), static_cast<int>(m_potentialOfJewelAtEdge[jewelId][edgeId]), ' ');
                 }
-            };
+                g_logger.log('\n');
+            }
+        }
 
-            const int numJewels = m_jewelState.numJewels();
-            std::vector<JewelId> jewelIdsShuffled(numJewels);
-            std::iota(std::begin(jewelIdsShuffled), std::end(jewelIdsShuffled), 0);
-            std::shuffle(std::begin(jewelIdsShuffled), std::end(jewelIdsShuffled), m_rng);
+        // when the jewel is collected for the first time
+        void onJewelContributionEnabled(int jewelId)
+        {
+            const int numEdges = static_cast<int>(m_allMoves.size());
 
-            std::vector<NodeId> nodesInPath;
-            nodesInPath.emplace_back(m_nodeIdByPosition[start]);
+            for (int edgeId = 0; edgeId < numEdges; ++edgeId)
+            {
+                m_totalPotentialAtEdge[edgeId] += m_potentialOfJewelAtEdge[jewelId][edgeId];
+            }
+        }
 
-            std::vector<std::uint8_t> isTraversed(m_sccs.size(), false);
-            std::vector<std::uint8_t> mayBeEnterable(m_sccs.size(), true);
-            isTraversed[m_sccIdAt[start]] = true;
+        // when the was collected but is no more
+        void onJewelContributionDisabled(int jewelId)
+        {
+            const int numEdges = static_cast<int>(m_allMoves.size());
 
-            auto insertForJewel = [&](int jewelId) -> int {
-                const Move* bestMove = nullptr;
-                int bestI = -1;
-                int lowestDistance = std::numeric_limits<int>::max();
-                int additionalDistance = infiniteDistance;
+            for (int edgeId = 0; edgeId < numEdges; ++edgeId)
+            {
+                m_totalPotentialAtEdge[edgeId] -= m_potentialOfJewelAtEdge[jewelId][edgeId];
+            }
+        }
+
+        void summarizeMovePotential()
+        {
+            const int numEdges = static_cast<int>(m_allMoves.size());
 
-                for (auto move : m_movesCollectingJewel[jewelId])
+            for (int jewelId = 0; jewelId < numJewels(); ++jewelId)
+            {
+                for (int edgeId = 0; edgeId < numEdges; ++edgeId)
                 {
-                    // if going to this scc would prevent us from accessing any jewel
-                    // (because we would lose access to its only scc) then mark this scc as a no go
-                    const int startSccId = m_sccIdAt[move->startPos()];
-                    const int endSccId = m_sccIdAt[move->endPos()];
-                    if (mayBeEnterable[startSccId] && !remainsSolvableAfterEnteringScc(isTraversed, startSccId))
-                    {
-                        mayBeEnterable[startSccId] = false;
-                        continue;
-                    }
-                    if (mayBeEnterable[endSccId] && !remainsSolvableAfterEnteringScc(isTraversed, endSccId))
+                    if (DirectionHelper::isDiagonal(m_allMoves[edgeId]->direction()))
                     {
-                        mayBeEnterable[endSccId] = false;
-                        continue;
+                        // empirical tests show that this is a good factor for diagonal moves
+                        m_potentialOfJewelAtEdge[jewelId][edgeId] *= 0.70710678118654752440084436210485f; // 1/sqrt(2)
                     }
+                    m_totalPotentialAtEdge[edgeId] += m_potentialOfJewelAtEdge[jewelId][edgeId];
+                }
+            }
+        }
+
+        void propagatePotentialFromJewel(int jewelId)
+        {
+            std::queue<const Move*> movesQueue;
+            for (const Move* move : m_movesCollectingJewel[jewelId])
+            {
+                movesQueue.emplace(move);
+            }
 
-                    const int numJewelsOnTheWay = static_cast<int>(move->jewels().size());
-                    const int moveValue = numJewelsOnTheWay - penalties[move->id()];
+            while (!movesQueue.empty())
+            {
+                const Move& move = *movesQueue.front();
+                movesQueue.pop();
 
-                    const int thisMoveStartId = m_nodeIdByPosition[move->startPos()];
-                    const int thisMoveEndId = m_nodeIdByPosition[move->endPos()];
+                const Coords2& start = move.startPos();
 
-                    // we skip one edge each iteration because we have to go through it and collect the jewels
-                    for (int i = 0; i + 1 < nodesInPath.size(); i += 2)
-                    {
-                        const int startNodeId = nodesInPath[i];
-                        const int endNodeId = nodesInPath[i + 1];
-                        const DistanceType d0 = m_distanceFromTo[startNodeId][thisMoveStartId];
-                        const DistanceType d1 = m_distanceFromTo[thisMoveEndId][endNodeId];
-                        const DistanceType dOld = m_distanceFromTo[startNodeId][endNodeId];
-                        if (d0 == infiniteDistance || d1 == infiniteDistance)
-                        {
-                            continue;
-                        }
-                        const int distance = d0 + d1 - dOld - moveValue;
-                        if (distance < lowestDistance)
-                        {
-                            bestI = i;
-                            lowestDistance = distance;
-                            bestMove = move;
-                            additionalDistance = d0 + d1 - dOld;
-                        }
-                    }
+                const auto& currentPotential = m_potentialOfJewelAtEdge[jewelId][move.id()];
+                const auto newPotential = saturatePotential(currentPotential);
 
-                    const int dn = m_distanceFromTo[nodesInPath.back()][thisMoveStartId];
-                    const int distance = dn - moveValue;
-                    if (dn != infiniteDistance && distance < lowestDistance)
+                for (const Move* moveAtEnd : m_movesByEndPosition[start])
+                {
+                    auto& currentPotentialAtEnd = m_potentialOfJewelAtEdge[jewelId][moveAtEnd->id()];
+                    if (newPotential > currentPotentialAtEnd)
                     {
-                        bestI = nodesInPath.size() - 1;
-                        lowestDistance = distance;
-                        bestMove = move;
-                        additionalDistance = dn;
+                        currentPotentialAtEnd = newPotential;
+                        movesQueue.emplace(moveAtEnd);
                     }
                 }
+            }
+        }
 
-                if (bestI < 0)
-                {
-                    applyPenaltiesToPath(nodesInPath);
-                    m_jewelState.clear();
-                    return infiniteDistance;
-                }
+        void propagateMovePotential()
+        {
+            constexpr int numAllPrints = 20;
+            const int numEdges = static_cast<int>(m_allMoves.size());
 
-                for (const int jewelId : bestMove->jewels())
+            int numPrints = 0;
+            for (int jewelId = 0; jewelId < numJewels(); ++jewelId)
+            {
+                propagatePotentialFromJewel(jewelId);
+                if (jewelId >= numJewels() / numAllPrints * numPrints)
                 {
-                    m_jewelState.addToCollected(jewelId);
+                    g_logger.log("Propagate potential ", jewelId + 1, '/', numJewels(), '\n');
+                    ++numPrints;
                 }
+            }
+        }
 
-                const int bestMoveStartId = m_nodeIdByPosition[bestMove->startPos()];
-                const int bestMoveEndId = m_nodeIdByPosition[bestMove->endPos()];
+        PotentialType saturatePotential(PotentialType p) const
+        {
+            // empirically chosen
+            return p / 7 * 3;
+        }
 
-                isTraversed[m_sccIdAt[bestMove->startPos()]] = true;
-                isTraversed[m_sccIdAt[bestMove->endPos()]] = true;
+        void initializeMovePotential()
+        {
+            const int numEdges = static_cast<int>(m_allMoves.size());
+
+            m_potentialOfJewelAtEdge = Array2<PotentialType>(numJewels(), numEdges);
+            m_totalPotentialAtEdge = std::vector<TotalPotentialType>(numEdges);
+        }
 
+        int countJewels() const
+        {
+            int count = 0;
+            m_level.board().forEach([&count](CellType cell, int x, int y) {
+                if (cell == CellType::Jewel)
                 {
-                    const int startNodeId = nodesInPath[bestI];
-                    addJewelsFromPath(startNodeId, bestMoveStartId);
+                    ++count;
+                }
+                });
+            return count;
+        }
 
-                    if (bestI != nodesInPath.size() - 1)
+        void printAllMoves() const
+        {
+            forEach(m_movesByPosition, [](const Moves & moves, int x, int y) {
+                const Coords2 start(x, y);
+
+                g_logger.log("From (", x, ", ", y, ") to: ");
+                for (Direction dir : DirectionHelper::values())
+                {
+                    const Move& move = moves[dir];
+                    const Coords2& end = move.endPos();
+                    if (end != start && end != Coords2(0, 0))
                     {
-                        const int endNodeId = nodesInPath[bestI + 1];
-                        addJewelsFromPath(bestMoveEndId, endNodeId);
-                        removeJewelsFromPath(startNodeId, endNodeId);
+                        g_logger.log("(", end.x, ", ", end.y, ", {");
+                        for (int id : move.jewels())
+                        {
+                            g_logger.log(id, ' ');
+                        }
+                        g_logger.log("}) ");
                     }
                 }
+                g_logger.log('\n');
+                });
+        }
+
+        void identifyJewels()
+        {
+            int nextJewelId = 0;
+            m_level.board().forEach([this, &nextJewelId](CellType cell, int x, int y) {
+                if (cell == CellType::Jewel)
+                {
+                    m_jewelIdByPosition[x][y] = nextJewelId++;
+                }
+                });
+        }
 
-                int e[] = { bestMoveStartId, bestMoveEndId };
-                nodesInPath.insert(std::begin(nodesInPath) + bestI + 1, std::begin(e), std::end(e));
+        // jewel b is dropped if there is a jewel a such that every move collecting a also collects b.
+        // of jewels collected by exactly the same moves only the first one is kept.
+        // any route collecting the kept jewels collects all of them so solutions need no mapping back,
+        // the remaining jewels are renumbered and the moves only list them from now on
+        void reduceDominatedJewels()
+        {
+            const auto timer = m_bench->scopedTimer("reduceJewels");
 
-                return additionalDistance + 1;
+            const int numJewels = this->numJewels();
+            auto isCollectedWhenever = [this](int a, int b) {
+                const auto& movesA = m_movesCollectingJewel[a];
+                const auto& movesB = m_movesCollectingJewel[b];
+                return std::includes(std::begin(movesB), std::end(movesB), std::begin(movesA), std::end(movesA), [](const Move* lhs, const Move* rhs) {
+                    return lhs->id() < rhs->id();
+                    });
             };
 
-            while (m_jewelState.numLeft() > 0)
+            // the jewel each dropped jewel is collected with, it may be dropped too
+            std::vector<int> dominatingJewel(numJewels);
+            std::iota(std::begin(dominatingJewel), std::end(dominatingJewel), 0);
+
+            std::vector<std::uint8_t> isDropped(numJewels, false);
+            for (int a = 0; a < numJewels; ++a)
             {
-                for (int a = 0; a < numJewels; ++a)
+                // every jewel dominated by a is collected by any of its moves, in particular the first one
+                const int numMovesA = m_movesCollectingJewel[a].size();
+                for (const int b : m_movesCollectingJewel[a].front()->jewels())
                 {
-                    const int jewelId = jewelIdsShuffled[a];
-                    if (m_jewelState.isCollected(jewelId))
+                    const int numMovesB = m_movesCollectingJewel[b].size();
+                    if (b == a || isDropped[b] || numMovesB < numMovesA || (numMovesB == numMovesA && b < a))
                     {
                         continue;
                     }
 
-                    if (insertForJewel(jewelId) == infiniteDistance)
+                    if (isCollectedWhenever(a, b))
                     {
-                        return false;
+                        isDropped[b] = true;
+                        dominatingJewel[b] = a;
                     }
                 }
             }
 
-            auto tryExchange = [&](int i) -> bool {
-                const int startNodeId = nodesInPath[i];
-                const int leftMiddleNodeId = nodesInPath[i + 1];
-                const int rightMiddleNodeId = nodesInPath[i + 2];
-                int endNodeId = invalidNodeId;
-                int distanceSaved = 0;
-                {
-                    removeJewelsFromPath(startNodeId, leftMiddleNodeId);
-                    removeJewelsFromPath(leftMiddleNodeId, rightMiddleNodeId);
-
-                    distanceSaved = m_distanceFromTo[startNodeId][leftMiddleNodeId];
+            const int numKept = std::count(std::begin(isDropped), std::end(isDropped), false);
+            g_logger.log("Dropped ", numJewels - numKept, " dominated jewels\n");
 
-                    if (i + 3 < nodesInPath.size())
-                    {
-                        endNodeId = nodesInPath[i + 3];
-                        removeJewelsFromPath(rightMiddleNodeId, endNodeId);
-                        addJewelsFromPath(startNodeId, endNodeId);
+            std::vector<JewelId> newJewelIds(numJewels, invalidJewelId);
+            for (int jewelId = 0, nextJewelId = 0; jewelId < numJewels; ++jewelId)
+            {
+                if (!isDropped[jewelId])
+                {
+                    newJewelIds[jewelId] = nextJewelId++;
+                }
+            }
 
-                        distanceSaved +=
-                            m_distanceFromTo[rightMiddleNodeId][endNodeId]
-                            - m_distanceFromTo[startNodeId][endNodeId];
-                    }
+            // chains of dominance end in a kept jewel because each step goes to fewer moves or a lower id
+            m_keptJewelIdByOriginalJewelId.resize(numJewels);
+            for (int jewelId = 0; jewelId < numJewels; ++jewelId)
+            {
+                int keptJewelId = jewelId;
+                while (isDropped[keptJewelId])
+                {
+                    keptJewelId = dominatingJewel[keptJewelId];
                 }
+                m_keptJewelIdByOriginalJewelId[jewelId] = newJewelIds[keptJewelId];
+            }
 
-                nodesInPath.erase(std::begin(nodesInPath) + i + 1, std::begin(nodesInPath) + i + 3);
+            if (numKept == numJewels)
+            {
+                return;
+            }
 
-                int addedDistance = 0;
+            for (JewelId& jewelId : m_jewelIdByPosition)
+            {
+                if (jewelId != invalidJewelId)
+                {
+                    jewelId = newJewelIds[jewelId];
+                }
+            }
 
-                while (m_jewelState.numLeft() > 0)
+            // also the moves that are not possible, they still pick up the jewel they start at
+            for (Moves& moves : m_movesByPosition)
+            {
+                for (Direction dir : DirectionHelper::values())
                 {
-                    for (int jewelId = 0; jewelId < numJewels; ++jewelId)
+                    Move& move = moves[dir];
+                    std::vector<JewelId> jewels;
+                    for (const int jewelId : move.jewels())
                     {
-                        if (m_jewelState.isCollected(jewelId))
+                        if (!isDropped[jewelId])
                         {
-                            continue;
+                            jewels.emplace_back(newJewelIds[jewelId]);
                         }
-
-                        addedDistance += insertForJewel(jewelId);
                     }
+                    move.setJewels(std::move(jewels));
                 }
+            }
 
-                return addedDistance < distanceSaved;
-            };
+            m_movesCollectingJewel = std::vector<std::vector<const Move*>>(numKept);
+            for (const Move* move : m_allMoves)
+            {
+                for (const int jewelId : move->jewels())
+                {
+                    m_movesCollectingJewel[jewelId].emplace_back(move);
+                }
+            }
 
-            auto exchange = [&]() -> bool {
-                bool anyImprovement = false;
+            m_jewelState = JewelState(numKept);
+        }
 
-                // we skip one edge each iteration because we have to go through it and collect the jewels
-                for (int i = 0; i + 1 < nodesInPath.size(); i += 2)
+        void printSccs() const
+        {
+            const int width = m_sccIdAt.width();
+            const int height = m_sccIdAt.height();
+
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
                 {
-                    JewelState oldState = m_jewelState;
-                    auto nodesInPathCpy = nodesInPath;
-                    if (tryExchange(i))
+                    const int id = m_sccIdAt[x][y];
+                    if (id < 0)
                     {
-                        anyImprovement = true;
+                        g_logger.log(' ');
                     }
                     else
                     {
-                        m_jewelState = std::move(oldState);
-                        nodesInPath = std::move(nodesInPathCpy);
+                        g_logger.log(id);
                     }
+                    g_logger.log(' ');
                 }
+                g_logger.log('\n');
+            }
 
-                return anyImprovement;
-            };
-
-            solution = solutionThroughNodes(nodesInPath);
-
-            // shorten all possible subpaths. Here we do it only to get the length of the shortened solution
+            for (int i = 0; i < m_sccs.size(); ++i)
             {
-                JewelState oldState = m_jewelState;
-                while (tryRemoveAnyRunFromSolution(solution))
+                g_logger.log("SCC ", m_sccs[i].id, " has ", m_sccs[i].jewels.size(), " jewels\n");
+                g_logger.log("  Neighbours: ");
+                for (int n : m_sccs[i].neighbours)
                 {
+                    g_logger.log(n, ' ');
                 }
-                m_jewelState = std::move(oldState);
+                g_logger.log('\n');
             }
+        }
 
-            if (solution.size() < currentBestBeforeReduction)
+        void assignJewelsToSccs()
+        {
+            const auto timer = m_bench->scopedTimer("assignJewelsToSccs");
+
+            // there is a possibility that a jewel is collectible from 2 or more SCCs
+            // #######
+            // #   * #
+            // *+#   #
+            // * .* O#
+            // #*O *##
+            // #######
+
+            // if a jewels lies on the edge that moves between different sccs (but not on the start) then
+            // it is assigned to the latter scc
+            // if it doesn't cross sccs then it is assigned to both (not at once, but we can be sure that
+            // end node has outcoming edges to the same scc so it will be handled)
+
+            // use a set to remove duplicates, later copy to vector
+            std::vector<std::set<int>> jewels(m_sccs.size());
+            int numTotalJewels = 0;
+            const int numJewels = m_jewelState.numJewels();
+            for (const Move* movePtr : m_allMoves)
             {
-                currentBestBeforeReduction = solution.size();
+                const Move& move = *movePtr;
+                if (move.id() < 0)
+                {
+                    continue;
+                }
 
-                // exchange markets until not improvement can be made
-                for (;;)
+                const Coords2& v = move.startPos();
+                const int iv = m_sccIdAt[v];
+                const Coords2& w = move.endPos();
+                const int iw = m_sccIdAt[w];
+                for (const int jewelId : move.jewels())
                 {
-                    if (solution.size() <= m_level.maxMoves())
+                    if (iv != iw && m_jewelIdByPosition[move.startPos()] != jewelId)
                     {
-                        break;
+                        jewels[iw].emplace(jewelId);
                     }
-
-                    if (!exchange())
+                    else
                     {
-                        break;
+                        jewels[iv].emplace(jewelId);
                     }
+
+                    ++numTotalJewels;
                 }
             }
 
-            // again do the same as before exchange
-            solution = solutionThroughNodes(nodesInPath);
-            // shorten all possible subpaths
-            while (tryRemoveAnyRunFromSolution(solution))
+            for (int i = 0; i < m_sccs.size(); ++i)
             {
+                m_sccs[i].jewels = std::vector<JewelId>(std::begin(jewels[i]), std::end(jewels[i]));
             }
 
-            m_jewelState.clear();
-
-            solution.setExists(true);
+            m_lastSccWithJewel.resize(numJewels);
+            for (int i = 0; i < m_sccs.size(); ++i)
+            {
+                for (const int jewelId : m_sccs[i].jewels)
+                {
+                    m_lastSccWithJewel[jewelId] = i;
+                }
+            }
 
-            return true;
+            resetSccCountsPerJewel();
         }
 
-        void initializeSkipProbability()
+        bool mayBeSolvable() const
         {
-            const int maxMoves = m_level.maxMoves();
-            m_skipProbabilityAtDepth.resize(m_level.maxMoves(), 0.0f);
+            // try looking for sccs pair that cannot be both reached in one traversal
+            // but both contain the only instances of some jewel
+            // ie. look for places where taking one required scc prevents us from taking another required one
 
-            for (int i = 0; i < maxMoves; ++i)
+            for (const auto& scc : m_sccs)
             {
-                int skip = maxMoves / std::sqrt(maxMoves - i) + 1;
-                skip *= skip;
-                if (i <= minDepthToAllowSkip || isPerfectSquare(i))
-                {
-                    m_skipProbabilityAtDepth[i] = 0.0f;
-                }
-                else
+                for (const int jewelId : scc.jewels)
                 {
-                    m_skipProbabilityAtDepth[i] = 1.0f - 1.0f / static_cast<float>(skip);
+                    if (m_numSccsWithJewel[jewelId] == 1)
+                    {
+                        // this is the only scc where we can collect it
+
+                        for (int otherSccId = 0; otherSccId < m_sccs.size(); ++otherSccId)
+                        {
+                            if (scc.id == otherSccId)
+                            {
+                                continue;
+                            }
+
+                            if (m_ifSccTraversedThenSccUnreachable[scc.id][otherSccId])
+                            {
+                                // we can't reach this scc if we take the previously checked one
+
+                                for (const int jewelId : m_sccs[otherSccId].jewels)
+                                {
+                                    // but we have to reach it to have a solution
+                                    // so it is not solvable
+                                    if (m_numSccsWithJewel[jewelId] == 1)
+                                    {
+                                        return false;
+                                    }
+                                }
+                            }
+                        }
+                    }
                 }
             }
+
+            return true;
         }
 
-        void updateJewelStateOnSolutionPartReplaced(const Solution & oldSolution, int start, int length, const std::vector<Direction> & directions)
+        bool remainsSolvableAfterEnteringScc(std::vector<std::uint8_t> & isTraversed, int i)
         {
-            // reevaluates jewels collected on the path
+            // this may be very costly potentially
+            // we'll have to se whether it requires any more early exits
 
-            const auto starts = coordsAlongSolution(oldSolution);
+            if (i == invalidSccId)
+            {
+                return true;
+            }
 
-            Coords2 coords = starts[start];
-            for (int i = start; i < start + length; ++i)
+            if (isTraversed[i])
             {
-                const Moves& moves = m_movesByPosition[coords];
-                const Move& move = moves[oldSolution[i]];
-                for (int jewelId : move.jewels())
+                // already traversed, no action required
+                return true;
+            }
+
+            bool remainsSolvable = true;
+            for (const auto& scc : m_sccs)
+            {
+                if (m_ifSccTraversedThenSccUnreachable[i][scc.id])
                 {
-                    m_jewelState.removeFromCollected(jewelId);
+                    for (const int jewelId : scc.jewels)
+                    {
+                        m_numSccsWithJewel[jewelId] -= 1;
+                        if (m_numSccsWithJewel[jewelId] <= 0)
+                        {
+                            remainsSolvable = false;
+                        }
+                    }
                 }
-
-                coords = move.endPos();
             }
 
-            coords = starts[start];
-            for (int i = 0; i < directions.size(); ++i)
+            for (const auto& scc : m_sccs)
             {
-                const Moves& moves = m_movesByPosition[coords];
-                const Move& move = moves[directions[i]];
-                for (int jewelId : move.jewels())
+                if (m_ifSccTraversedThenSccUnreachable[i][scc.id])
                 {
-                    m_jewelState.addToCollected(jewelId);
+                    for (const int jewelId : scc.jewels)
+                    {
+                        m_numSccsWithJewel[jewelId] += 1;
+                    }
                 }
-
-                coords = move.endPos();
             }
+
+            return remainsSolvable;
         }
 
-        std::vector<Coords2> coordsAlongSolution(const Solution & solution) const
+        void fillBackwardSccUnreachabilityIfSccTraversed(const Scc & initialScc)
         {
-            // [i] contains the position of the vehicle before move solution[i]
+            // identifies backward reachable sccs from scc
 
-            std::vector<Coords2> r{};
-            r.reserve(solution.size() + 1);
+            const int numSccs = m_sccs.size();
+            std::vector<int> isVisited(numSccs, false);
+            std::stack<int> reachable;
+            reachable.emplace(initialScc.id);
 
-            Coords2 coords = m_vehicleCoords;
-            r.emplace_back(coords);
-            for (int i = 0; i < solution.size(); ++i)
+            while (!reachable.empty())
             {
-                const Moves& moves = m_movesByPosition[coords];
-                const Move& move = moves[solution[i]];
-                coords = move.endPos();
-                r.emplace_back(coords);
+                const Scc& scc = m_sccs[reachable.top()];
+                reachable.pop();
+
+                m_ifSccTraversedThenSccUnreachable[initialScc.id][scc.id] = false;
+
+                for (const int n : scc.predecessors)
+                {
+                    if (!isVisited[n])
+                    {
+                        isVisited[n] = true;
+                        reachable.emplace(n);
+                    }
+                }
             }
+        }
 
-            return r;
+        void fillForwardSccUnreachabilityIfSccTraversed(const Scc & initialScc)
+        {
+            // identifies forward reachable sccs from scc
+
+            const int numSccs = m_sccs.size();
+            std::vector<int> isVisited(numSccs, false);
+            std::stack<int> reachable;
+            reachable.emplace(initialScc.id);
+
+            while (!reachable.empty())
+            {
+                const Scc& scc = m_sccs[reachable.top()];
+                reachable.pop();
+
+                m_ifSccTraversedThenSccUnreachable[initialScc.id][scc.id] = false;
+
+                for (const int n : scc.neighbours)
+                {
+                    if (!isVisited[n])
+                    {
+                        isVisited[n] = true;
+                        reachable.emplace(n);
+                    }
+                }
+            }
         }
 
-        bool tryRemoveAnyRunFromSolution(Solution & solution)
+        void fillSccUnreachabilityIfSccTraversed(const Scc & initialScc)
         {
-            // tries to remove the run that would shorten the path the most
-            // returns true if anything removed
-
-            auto run = findMostImprovableRedundantEdgeRun(solution);
-
-            if (run.first != -1)
-            {
-                const int start = run.first;
-                const int length = run.second;
-                auto sol = tryShortenRun(solution, start, length);
-                updateJewelStateOnSolutionPartReplaced(solution, start, length, sol);
-                solution.replace(start, length, sol);
-                return true;
-            }
+            // identifies reachable sccs from scc
 
-            return false;
+            fillForwardSccUnreachabilityIfSccTraversed(initialScc);
+            fillBackwardSccUnreachabilityIfSccTraversed(initialScc);
         }
 
-
-        std::vector<Direction> tryShortenRun(const Solution & solution, int start, int length) const
+        void fillSccConditionalUnreachability()
         {
-            // looks for a shorter path to replace solution[start..start+length]
+            const auto timer = m_bench->scopedTimer("fillSccConditionalUnreachability");
 
-            if (length <= 1) return {};
-
-            Coords2 coords = m_vehicleCoords;
-            for (int i = 0; i < start; ++i)
-            {
-                const Moves& moves = m_movesByPosition[coords];
-                const Move& move = moves[solution[i]];
-                coords = move.endPos();
-            }
+            const int numSccs = m_sccs.size();
 
-            Coords2 endCoords = coords;
-            for (int i = start; i < start + length; ++i)
-            {
-                const Moves& moves = m_movesByPosition[endCoords];
-                const Move& move = moves[solution[i]];
-                endCoords = move.endPos();
-            }
+            // we will make reachable all the ones we can reach, unreachable by default
+            m_ifSccTraversedThenSccUnreachable = Array2<bool>(numSccs, numSccs, true);
 
-            // coords now at where we should start
-            // endCoords where we should end
-            std::vector<Direction> path{};
-            if (pathFromToWithLength(coords, endCoords, length - 1, path))
+            for (const auto& scc : m_sccs)
             {
-                return path;
+                fillSccUnreachabilityIfSccTraversed(scc);
             }
-
-            return {};
         }
 
-        bool shortestPathFromTo(const Coords2 & fromCoords, const Coords2 & toCoords, std::vector<Direction> & path) const
+        bool isVertex(const Coords2 & v) const
         {
-            const int from = m_nodeIdByPosition[fromCoords];
-            int to = m_nodeIdByPosition[toCoords];
-            return pathFromToWithLength(fromCoords, toCoords, m_distanceFromTo[from][to], path);
+            return m_nodeIdByPosition[v] != invalidNodeId;
         }
 
-        bool pathFromToWithLength(const Coords2 & fromCoords, const Coords2 & toCoords, int length, std::vector<Direction> & path) const
+        void resetSccCountsPerJewel()
         {
-            // returns false if no such path exists
-
-            int from = m_nodeIdByPosition[fromCoords];
-            const int to = m_nodeIdByPosition[toCoords];
-            if (m_distanceFromTo[from][to] > length)
-            {
-                return false;
-            }
+            m_numSccsWithJewel.resize(m_jewelState.numJewels());
+            std::fill(std::begin(m_numSccsWithJewel), std::end(m_numSccsWithJewel), 0);
 
-            while (from != to)
+            for (const auto& scc : m_sccs)
             {
-                if (length-- <= 0)
+                for (const int jewelId : scc.jewels)
                 {
-                    return false;
+                    m_numSccsWithJewel[jewelId] += 1;
                 }
+            }
+        }
 
-                const int distance = m_distanceFromTo[from][to];
+        void identifyOneScc(std::stack<Coords2> & S, const Coords2 & v, int& index, Array2<int> & indexAt, Array2<int> & lowlinkAt, Array2<bool> & onStackAt)
+        {
+            // Set the depth index for v to the smallest unused index
+            indexAt[v] = index;
+            lowlinkAt[v] = index;
+            index += 1;
+            S.emplace(v);
+            onStackAt[v] = true;
 
-                const auto& moves = m_movesByPosition[m_nodePositionById[from]];
-                int newFrom = from;
-                for (Direction dir : DirectionHelper::values())
+            // Consider successors of v
+            const Moves& moves = m_movesByPosition[v];
+            for (Direction dir : DirectionHelper::values())
+            {
+                const Move& move = moves[dir];
+                if (move.id() < 0)
                 {
-                    const auto& move = moves[dir];
-
-                    if (move.id() < 0)
-                    {
-                        continue;
-                    }
-
-                    const int newFromCandidate = m_nodeIdByPosition[move.endPos()];
-                    if (m_distanceFromTo[newFromCandidate][to] < distance)
-                    {
-                        path.emplace_back(dir);
-                        newFrom = newFromCandidate;
-                        break;
-                    }
+                    continue;
                 }
 
-                if (from == newFrom)
+                const Coords2& w = move.endPos();
+                if (indexAt[w] == -1)
                 {
-                    return false;
+                    // Successor w has not yet been visited; recurse on it
+                    identifyOneScc(S, w, index, indexAt, lowlinkAt, onStackAt);
+                    lowlinkAt[v.x][v.y] = std::min(lowlinkAt[v.x][v.y], lowlinkAt[w]);
                 }
-                else
+                else if (onStackAt[w])
                 {
-                    from = newFrom;
+                    // Successor w is in stack S and hence in the current SCC
+                    // If w is not on stack, then (v, w) is a cross-edge in the DFS tree and must be ignored
+                    // Note: The next line may look odd - but is correct.
+                    // It says w.index not w.lowlink; that is deliberate and from the original paper
+                    lowlinkAt[v.x][v.y] = std::min(lowlinkAt[v.x][v.y], indexAt[w]);
                 }
             }
 
-            return true;
+            // If v is a root node, pop the stack and generate an SCC
+            if (lowlinkAt[v.x][v.y] == indexAt[v])
+            {
+                std::vector<Coords2> scc;
+                Coords2 w;
+                do
+                {
+                    w = S.top();
+                    S.pop();
+                    onStackAt[w] = false;
+                    scc.emplace_back(w);
+                } while (w != v);
+
+                m_sccs.emplace_back();
+                m_sccs.back().nodes = std::move(scc);
+            }
         }
 
-        // the jewelState must not be cleared yet
-        std::pair<int, int> findMostImprovableRedundantEdgeRun(const Solution & solution) const
+        void identifySccs()
         {
-            struct Improvement
-            {
-                int start;
-                int length;
-                int possibleImprovement;
-            };
+            const auto timer = m_bench->scopedTimer("identifySccs");
+
+            // https://en.wikipedia.org/wiki/Tarjan%27s_strongly_connected_components_algorithm
+
+            int index = 0;
+            std::stack<Coords2> S;
+            Array2<int> indexAt(m_level.width(), m_level.height(), -1);
+            Array2<int> lowlinkAt(m_level.width(), m_level.height(), -1);
+            Array2<bool> onStackAt(m_level.width(), m_level.height(), false);
+            const int width = m_movesByPosition.width();
+            const int height = m_movesByPosition.height();
 
-            Improvement bestImprovement{ -1, -1, 0 };
-            const auto starts = coordsAlongSolution(solution);
-            const int solLength = solution.size();
-            std::vector<MoveId> numOmitted(m_jewelState.numJewels(), 0);
-            int begin = 0;
-            int end = 0;
-            while (begin != solLength && end != solLength)
+            for (int x = 0; x < width; ++x)
             {
-                while (end != solLength)
+                for (int y = 0; y < height; ++y)
                 {
-                    const Coords2& coords = starts[end];
-                    const Moves& moves = m_movesByPosition[coords];
-                    const Move& move = moves[solution[end]];
-                    bool isRedundant = true;
-                    for (int jewelId : move.jewels())
+                    const Coords2 v(x, y);
+                    if (isVertex(v) && indexAt[v] == -1)
                     {
-                        if (m_jewelState.numCollected(jewelId) - numOmitted[jewelId] < 2)
-                        {
-                            isRedundant = false;
-                        }
-
-                        ++numOmitted[jewelId];
+                        identifyOneScc(S, v, index, indexAt, lowlinkAt, onStackAt);
                     }
+                }
+            }
+
+            // reverse sccs so they are in topological order
+            std::reverse(std::begin(m_sccs), std::end(m_sccs));
+
+            // fills all other information based on sccs
+            // ids
+            int i = 0;
+            for (auto& scc : m_sccs)
+            {
+                scc.id = i;
+                for (const auto& v : scc.nodes)
+                {
+                    m_sccIdAt[v] = i;
+                }
+                ++i;
+            }
 
-                    if (!isRedundant)
+            // neighbours, predecessors
+            int iv = 0;
+            for (auto& scc : m_sccs)
+            {
+                std::set<int> neighbours;
+                for (const auto& v : scc.nodes)
+                {
+                    const Moves& moves = m_movesByPosition[v];
+                    for (Direction dir : DirectionHelper::values())
                     {
-                        // backtrack incrementing ommitted count
-                        for (int jewelId : move.jewels())
+                        const Move& move = moves[dir];
+                        if (move.id() < 0)
                         {
-                            --numOmitted[jewelId];
+                            continue;
                         }
 
-                        break;
-                    }
-
-                    ++end;
-                }
+                        const Coords2& w = move.endPos();
+                        const int iw = m_sccIdAt[w];
 
-                if (begin != end)
-                {
-                    const int start = begin;
-                    const int length = end - begin;
-                    if (length > bestImprovement.possibleImprovement)
-                    {
-                        const Coords2 fromCoords = starts[start];
-                        const Coords2 toCoords = starts[start + length];
-                        const int from = m_nodeIdByPosition[fromCoords];
-                        const int to = m_nodeIdByPosition[toCoords];
-                        const DistanceType newLength = m_distanceFromTo[from][to];
-                        const int impr = length - newLength;
-                        if (impr > bestImprovement.possibleImprovement)
+                        if (iv != iw)
                         {
-                            bestImprovement.start = start;
-                            bestImprovement.length = length;
-                            bestImprovement.possibleImprovement = impr;
+                            scc.bridges.emplace_back(&move);
+                            neighbours.emplace(iw);
                         }
                     }
                 }
 
-                const Coords2& coords = starts[begin];
-                const Moves& moves = m_movesByPosition[coords];
-                const Move& move = moves[solution[begin]];
-                for (int jewelId : move.jewels())
+                scc.neighbours = std::vector<SccId>(std::begin(neighbours), std::end(neighbours));
+                for (const int n : scc.neighbours)
                 {
-                    --numOmitted[jewelId];
+                    m_sccs[n].predecessors.emplace_back(scc.id);
                 }
 
-                ++begin;
+                ++iv;
             }
-
-            return { bestImprovement.start, bestImprovement.length };
         }
 
-        SmallVector<const Move*, 8> orderMoves(const Moves & moves) const
+        void fillDistancesFromNode(int s, const std::vector<SmallVector<NodeId, 8>> & moveEnds, std::vector<NodeId> & Q, std::vector<DistanceType> & distances)
         {
-            SmallVector<const Move*, 8> dirs;
-
-            for (Direction dir : DirectionHelper::values())
-            {
-                const Move& move = moves[dir];
+            // bfs since we have all edge weights equal
 
-                if (move.id() < 0)
-                {
-                    continue;
-                }
+            // using a fixed length vector is faster than std::queue
+            // we can do it since we know the amount of nodes and we visit each one at most once
 
-                const Coords2& start = move.startPos();
-                const Coords2& end = move.endPos();
-                const int startSccId = m_sccIdAt[start];
-                const int endSccId = m_sccIdAt[end];
-                if (startSccId != endSccId && !canMoveToScc(endSccId))
+            std::fill(std::begin(distances), std::end(distances), infiniteDistance);
+            distances[s] = 0;
+            Q[0] = s;
+            auto begin = std::begin(Q);
+            auto end = begin + 1;
+            while (begin != end)
+            {
+                int v = *begin;
+                ++begin;
+                for (const NodeId endV : moveEnds[v])
                 {
-                    continue;
+                    if (distances[endV] == infiniteDistance)
+                    {
+                        // distance should never be intmax here so we can safely increment
+                        distances[endV] = distances[v] + 1;
+                        *end = endV;
+                        ++end;
+                    }
                 }
-
-                dirs.emplace_back(&moves[dir]);
             }
 
-            std::sort(std::begin(dirs), std::end(dirs), [this, &moves](const Move * lhs, const Move * rhs) {
-                return m_totalPotentialAtEdge[lhs->id()] > m_totalPotentialAtEdge[rhs->id()];
-                });
-
-            return dirs;
+            // only the hubs are stored
+            std::copy(std::begin(distances), std::begin(distances) + m_numHubs, m_distanceFromTo[s]);
         }
 
-        bool canMoveToScc(int id) const
+        void fillDistancesBetweenNodes()
         {
-            // there are possibilties of false positives
-            // but they should be rare and only impact performance
-            // ability to find a solution is unharmed
+            std::vector<SmallVector<NodeId, 8>> moveEnds(m_nodePositionById.size());
 
-            if (id == invalidSccId)
-            {
-                return false;
-            }
+            forEach(m_movesByPosition, [this, &moveEnds](const Moves & moves, int x, int y)
+                {
+                    const int nodeId = m_nodeIdByPosition[x][y];
+
+                    if (nodeId == invalidNodeId)
+                    {
+                        return;
+                    }
+
+                    for (Direction dir : DirectionHelper::values())
+                    {
+                        const Move& move = moves[dir];
+                        if (move.id() < 0) continue;
+
+                        const Coords2& end = move.endPos();
+                        const int endV = m_nodeIdByPosition[end];
+                        moveEnds[nodeId].emplace_back(endV);
+                    }
+                });
 
-            const int numJewels = m_jewelState.numJewels();
-            for (int jewelId = 0; jewelId < numJewels; ++jewelId)
+            std::vector<NodeId> Q(m_nodePositionById.size());
+            std::vector<DistanceType> distances(m_nodePositionById.size());
+            const int numNodes = m_distanceFromTo.width();
+            for (int i = 0; i < numNodes; ++i)
             {
-                if (id > m_lastSccWithJewel[jewelId])
+                if ((i & distancesDeadlineCheckInterval) == 0 && isPastDeadline())
                 {
-                    // we must already have this jewel, because we can't pick it later
-                    if (!m_jewelState.isCollected(jewelId))
-                    {
-                        return false;
-                    }
+                    return;
                 }
+
+                fillDistancesFromNode(i, moveEnds, Q, distances);
             }
-            return true;
         }
 
-        const Move* findNearestMoveWithUncollectedJewel(const Coords2 & start)
+        // each hub is followed by its tree in preorder
+        void assignDistanceColumns()
         {
-            const int numJewels = m_jewelState.numJewels();
+            const int numNodes = m_nodePositionById.size();
 
-            const int startNodeId = m_nodeIdByPosition[start];
+            // every node is reachable from the vehicle, so the forced moves can't form a cycle without a hub
+            std::vector<NodeId> parent(numNodes, invalidNodeId);
+            std::vector<std::vector<NodeId>> children(numNodes);
+            for (int nodeId = m_numHubs; nodeId < numNodes; ++nodeId)
+            {
+                const Move* moveIn = m_movesByEndPosition[m_nodePositionById[nodeId]].front();
+                parent[nodeId] = m_nodeIdByPosition[moveIn->startPos()];
+                children[parent[nodeId]].emplace_back(nodeId);
+            }
 
-            const Move* bestMove = nullptr;
-            int bestMoveDistance = std::numeric_limits<int>::max();
-            for (int jewelId = 0; jewelId < numJewels; ++jewelId)
+            m_distanceColumnByNodeId = std::vector<DistanceColumn>(numNodes);
+
+            std::vector<NodeId> preorder;
+            preorder.reserve(numNodes);
+            std::vector<NodeId> stack;
+            for (int hub = 0; hub < m_numHubs; ++hub)
             {
-                if (m_jewelState.isCollected(jewelId))
+                m_distanceColumnByNodeId[hub].depth = 0;
+                stack.emplace_back(hub);
+                while (!stack.empty())
                 {
-                    continue;
-                }
+                    const int nodeId = stack.back();
+                    stack.pop_back();
 
-                for (const Move* move : m_movesCollectingJewel[jewelId])
-                {
-                    const int startSccId = m_sccIdAt[move->startPos()];
-                    const int endSccId = m_sccIdAt[move->endPos()];
-                    if (startSccId != endSccId && !canMoveToScc(endSccId))
-                    {
-                        continue;
-                    }
+                    DistanceColumn& nodeColumn = m_distanceColumnByNodeId[nodeId];
+                    nodeColumn.hub = hub;
+                    nodeColumn.first = preorder.size();
+                    preorder.emplace_back(nodeId);
 
-                    const int moveStartNodeId = m_nodeIdByPosition[move->startPos()];
-                    const DistanceType distance = m_distanceFromTo[startNodeId][moveStartNodeId];
-                    if (distance < bestMoveDistance)
+                    for (const NodeId child : children[nodeId])
                     {
-                        bestMoveDistance = distance;
-                        bestMove = move;
+                        m_distanceColumnByNodeId[child].depth = nodeColumn.depth + 1;
+                        stack.emplace_back(child);
                     }
                 }
             }
 
-            return bestMove;
+            // subtrees are contiguous in preorder, their sizes are summed up from the leaves
+            std::vector<NodeId> subtreeSize(numNodes, 1);
+            for (int i = numNodes - 1; i >= 0; --i)
+            {
+                const int nodeId = preorder[i];
+                m_distanceColumnByNodeId[nodeId].last = i + subtreeSize[nodeId] - 1;
+                if (parent[nodeId] != invalidNodeId)
+                {
+                    subtreeSize[parent[nodeId]] += subtreeSize[nodeId];
+                }
+            }
         }
 
-        Solution solveUsingSearchWithBacktracking(const Coords2& coords, int movesLeft, int depth, int additionalMoves)
+        // same numbering as in computePairwiseNodeDistances, move ends and the vehicle
+        int countNodes() const
         {
-            int minDepth = 0;
-            Solution solution = Solution::empty();
-            if (solveUsingSearchWithBacktracking(solution, coords, movesLeft, depth, additionalMoves, minDepth))
+            Array2<bool> isNode(m_level.width(), m_level.height(), false);
+            isNode[m_vehicleCoords] = true;
+            int numNodes = 1;
+            for (const Move* move : m_allMoves)
             {
-                return solution;
+                if (!isNode[move->endPos()])
+                {
+                    isNode[move->endPos()] = true;
+                    ++numNodes;
+                }
             }
-            return Solution::invalid();
+            return numNodes;
         }
 
-        bool solveUsingSearchWithBacktracking(Solution & solution, const Coords2 & coords, int movesLeft, int depth, int additionalMoves, int& minDepth)
+        void computePairwiseNodeDistances()
         {
-            m_bench->node();
+            const auto timer = m_bench->scopedTimer("computePairwiseNodeDistances");
 
-            if (depth < minDepth)
+            // fills pairwise distances
+
+            Array2<bool> visited(m_level.width(), m_level.height(), false);
+
+            // reading a distance to a node in a tree costs more than a plain lookup,
+            // so the trees are only formed when the full matrix would be large
+            const std::size_t numNodes = countNodes();
+            const bool isContracted = numNodes * numNodes * sizeof(DistanceType) >= minDistanceMatrixSizeForContraction;
+            Array2<bool> isHub(m_level.width(), m_level.height(), !isContracted);
+            isHub[m_vehicleCoords] = true;
+            for (const Move* move : m_allMoves)
             {
-                minDepth = depth;
+                if (m_movesByEndPosition[move->endPos()].size() != 1)
+                {
+                    isHub[move->endPos()] = true;
+                }
             }
 
-            const Moves& moves = m_movesByPosition[coords];
+            // hubs first, so that they can be used as columns directly
+            int c = 0;
+            auto addNodes = [&](bool hubs) {
+                for (const Move* movePtr : m_allMoves)
+                {
+                    const Move& move = *movePtr;
+                    // we use end instead of start because each node has a way to get to
+                    const Coords2& end = move.endPos();
+                    if (!visited[end] && isHub[end] == hubs)
+                    {
+                        m_nodeIdByPosition[end] = c;
+                        ++c;
+                        visited[end] = true;
+                    }
+                }
+            };
 
-            const auto orderedMoves = orderMoves(moves);
-            if (orderedMoves.empty())
+            addNodes(true);
+
+            if (m_nodeIdByPosition[m_vehicleCoords] == invalidNodeId)
             {
-                return false;
+                // can happen if isVehicleSpotAHole == false
+                m_nodeIdByPosition[m_vehicleCoords] = c;
+                ++c;
             }
 
-            const float maxPotential = static_cast<float>(m_totalPotentialAtEdge[orderedMoves[0]->id()]);
-            const float potentialThreshold = maxPotential * pruningFactor;
-            for (const Move* movePtr : orderedMoves)
-            {
-                const Move& move = *movePtr;
+            m_numHubs = c;
+            addNodes(false);
 
-                const float potential = static_cast<float>(m_totalPotentialAtEdge[move.id()]);
-                if (potential < potentialThreshold)
+            m_nodePositionById = std::vector<Coords2>(c);
+
+            m_level.board().forEach([this](CellType cell, int x, int y) {
+                const int id = m_nodeIdByPosition[x][y];
+                if (id < 0)
                 {
-                    return false;
+                    return;
                 }
+                m_nodePositionById[id] = Coords2(x, y);
+                });
 
-                const Coords2& end = move.endPos();
-
-                const int oldNumJewelsLeft = m_numJewelsLeftWhenSolvingAt[end];
-                if (m_jewelState.numLeft() - move.numUncollectedJewelsOnTheWay(m_jewelState) >= oldNumJewelsLeft)
-                {
-                    // we have not made progress and we are in the
-                    // same state as when we were here previously
+            assignDistanceColumns();
+            m_distanceFromTo = Array2<DistanceType>(c, m_numHubs, infiniteDistance);
+            m_scheduler.reserveForRelease(static_cast<std::size_t>(c) * m_numHubs * sizeof(DistanceType));
 
-                    // if potential is not very well defined here then try to move to the
-                    // nearest edge that collects a new jewel
+            m_isPreprocessingCached = loadPreprocessingCache();
+            if (!m_isPreprocessingCached)
+            {
+                fillDistancesBetweenNodes();
+            }
+            g_logger.log("Number of nodes: ", c, ", distance columns: ", m_numHubs, '\n');
+        }
 
-                    // TODO: fill m_numJewelsLeftWhenSolvingAt correctly
-                    if (potential < uncertainPotentialThreshold)
-                    {
-                        const Move* bestMove = findNearestMoveWithUncollectedJewel(coords);
-                        if (bestMove == nullptr)
-                        {
-                            return false;
-                        }
+        std::string preprocessingCacheFilename() const
+        {
+            std::ostringstream filename;
+            filename << m_cacheDirectory << '/' << std::hex << std::setw(16) << std::setfill('0') << m_level.board().hash() << ".cache";
+            return filename.str();
+        }
 
-                        std::vector<Direction> path;
-                        // this appends twice to the same path, effectively joining them
-                        if (shortestPathFromTo(coords, bestMove->startPos(), path) && shortestPathFromTo(bestMove->startPos(), bestMove->endPos(), path))
-                        {
-                            if (path.size() > -additionalMoves)
-                            {
-                                return false;
-                            }
+        PreprocessingCacheHeader preprocessingCacheHeader() const
+        {
+            PreprocessingCacheHeader header{};
+            std::memcpy(header.magic, "APTOPRE", sizeof(header.magic));
+            header.version = PreprocessingCacheHeader::currentVersion;
+            header.indexWidth = sizeof(NodeId);
+            header.boardHash = m_level.board().hash();
+            header.width = m_level.width();
+            header.height = m_level.height();
+            header.numNodes = m_nodePositionById.size();
+            header.numDistanceColumns = m_numHubs;
+            header.numCandidates = numCahInsertionCandidates;
+            return header;
+        }
 
-                            Coords2 newCoords = coords;
-                            forEachMoveInSolution(path, newCoords, [&](const Move & move, const Coords2 & coords) {
-                                for (int jewel : move.jewels())
-                                {
-                                    if (m_jewelState.addToCollected(jewel))
-                                    {
-                                        onJewelContributionDisabled(jewel);
-                                    }
-                                }
+        // node numbering and distance columns are not stored, they are cheap to recompute and deterministic for the board.
+        // fills the distances and the cah insertion candidates if there is a matching file
+        bool loadPreprocessingCache()
+        {
+            if (m_cacheDirectory.empty())
+            {
+                return false;
+            }
 
-                                solution.push(move.direction());
-                            });
+            const auto timer = m_bench->scopedTimer("loadCache");
 
-                            if (solveUsingSearchWithBacktracking(solution, newCoords, movesLeft - path.size(), depth + path.size(), additionalMoves, minDepth))
-                            {
-                                return true;
-                            }
-                            else
-                            {
-                                // backtrack
-                                Coords2 newCoords = coords;
-                                forEachMoveInSolution(path, newCoords, [&](const Move & move, const Coords2 & coords) {
-                                    for (int jewel : move.jewels())
-                                    {
-                                        if (m_jewelState.removeFromCollected(jewel))
-                                        {
-                                            onJewelContributionEnabled(jewel);
-                                        }
-                                    }
+            const MappedFile file(preprocessingCacheFilename());
+            const PreprocessingCacheHeader expectedHeader = preprocessingCacheHeader();
+            const std::size_t numNodes = m_nodePositionById.size();
+            const std::size_t distancesSize = numNodes * m_numHubs * sizeof(DistanceType);
+            const std::size_t candidatesSize = numNodes * numCahInsertionCandidates * sizeof(NodeId);
+            if (file.size() != sizeof(PreprocessingCacheHeader) + distancesSize + 2 * candidatesSize)
+            {
+                return false;
+            }
 
-                                    solution.pop();
-                                });
-                                return false;
-                            }
-                        }
-                        else
-                        {
-                            return false;
-                        }
-                    }
+            PreprocessingCacheHeader header;
+            std::memcpy(&header, file.data(), sizeof(header));
+            if (!(header == expectedHeader))
+            {
+                return false;
+            }
 
-                    continue;
-                }
+            const char* data = file.data() + sizeof(header);
+            std::memcpy(m_distanceFromTo.begin(), data, distancesSize);
+            data += distancesSize;
 
-                auto discard = [this, &solution, &move, oldNumJewelsLeft]()
-                {
-                    for (int jewel : move.jewels())
-                    {
-                        if (m_jewelState.removeFromCollected(jewel))
-                        {
-                            onJewelContributionEnabled(jewel);
-                        }
-                    }
+            m_nearestNodesBefore = Array2<NodeId>(numNodes, numCahInsertionCandidates);
+            std::memcpy(m_nearestNodesBefore.begin(), data, candidatesSize);
+            data += candidatesSize;
 
-                    m_numJewelsLeftWhenSolvingAt[move.endPos()] = oldNumJewelsLeft;
-                    solution.pop();
-                };
-                solution.push(move.direction());
+            m_nearestNodesAfter = Array2<NodeId>(numNodes, numCahInsertionCandidates);
+            std::memcpy(m_nearestNodesAfter.begin(), data, candidatesSize);
 
-                for (int jewel : move.jewels())
-                {
-                    if (m_jewelState.addToCollected(jewel))
-                    {
-                        onJewelContributionDisabled(jewel);
-                    }
-                }
+            g_logger.log("Loaded preprocessing cache\n");
+            return true;
+        }
 
-                m_numJewelsLeftWhenSolvingAt[end] = m_jewelState.numLeft();
+        // written to a temporary file first so that concurrent runs never see a partial file
+        void savePreprocessingCache() const
+        {
+            if (m_cacheDirectory.empty())
+            {
+                return;
+            }
 
-                if (m_jewelState.numLeft() == 0)
-                {
-                    if (solution.size() > m_level.maxMoves())
-                    {
-                        if (minDepth > m_level.maxMoves() - additionalMoves * 0.70710678118654752440084436210485f)
-                        {
-                            discard();
-                            return false;
-                        }
+            const auto timer = m_bench->scopedTimer("saveCache");
 
-                        minDepth = depth;
-                        JewelState jc = m_jewelState;
-                        Solution cpy = solution;
-                        while (tryRemoveAnyRunFromSolution(cpy));
-                        m_jewelState = jc;
-                        if (isSolutionValid(cpy) && cpy.size() <= m_level.maxMoves())
-                        {
-                            solution = cpy;
-                            return true;
-                        }
-                        else
-                        {
-                            discard();
+            const std::string filename = preprocessingCacheFilename();
+            std::ostringstream temporaryFilename;
+            temporaryFilename << filename << '.' << std::this_thread::get_id() << ".tmp";
 
-                            return false;
-                        }
-                    }
+            const PreprocessingCacheHeader header = preprocessingCacheHeader();
+            bool isWritten = false;
+            {
+                std::ofstream file(temporaryFilename.str(), std::ios::binary);
+                auto writeArray = [&file](const auto& a) {
+                    file.write(reinterpret_cast<const char*>(a.begin()), (a.end() - a.begin()) * sizeof(*a.begin()));
+                };
 
-                    return true;
-                }
-                else if (movesLeft > -additionalMoves)
-                {
-                    if (solveUsingSearchWithBacktracking(solution, end, movesLeft - 1, depth + 1, additionalMoves, minDepth))
-                    {
-                        return true;
-                    }
-                    else if (movesLeft > 0)
-                    {
-                        const float skipProbability = 1.0f - (1.0f - m_skipProbabilityAtDepth[depth]) * potential / (maxPotential + 1);
-                        if (std::bernoulli_distribution(skipProbability)(m_rng))
-                        {
-                            discard();
-                            return false;
-                        }
-                    }
-                    else if (movesLeft <= 0)
-                    {
-                        discard();
-                        return false;
-                    }
-                }
+                file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+                writeArray(m_distanceFromTo);
+                writeArray(m_nearestNodesBefore);
+                writeArray(m_nearestNodesAfter);
+                isWritten = static_cast<bool>(file);
+            }
 
-                discard();
+            if (!isWritten || std::rename(temporaryFilename.str().c_str(), filename.c_str()) != 0)
+            {
+                std::remove(temporaryFilename.str().c_str());
             }
+        }
 
-            return false;
+        bool areAllJewelsReachable() const
+        {
+            return m_jewelState.numJewels() == countReachableJewels();
         }
 
-        int countMovesAt(const Coords2 & pos) const
+        // jewels no single move collects two of need a move each. Such a set of jewels is chosen greedily,
+        // the ones sharing moves with the fewest others first, and each of its jewels can't be collected before
+        // the shortest route to a move collecting it ends. Giving them distinct moves in the order of these
+        // distances gives the bound.
+        // The order of the sccs needs no separate term, the distances from the vehicle already go through them
+        int computeLowerBound() const
         {
-            int c = 0;
-            const Moves& moves = m_movesByPosition[pos];
-            for (Direction dir : DirectionHelper::values())
-            {
-                const Move& move = moves[dir];
+            const auto timer = m_bench->scopedTimer("lowerBound");
 
-                if (move.id() >= 0)
+            // moves needed to get to each position
+            Array2<int> depths(m_level.width(), m_level.height(), -1);
+            std::queue<Coords2> queue;
+            depths[m_vehicleCoords] = 0;
+            queue.push(m_vehicleCoords);
+            while (!queue.empty())
+            {
+                const Coords2 pos = queue.front();
+                queue.pop();
+                for (Direction dir : DirectionHelper::values())
                 {
-                    ++c;
+                    const Move& move = m_movesByPosition[pos][dir];
+                    if (move.startPos() != move.endPos() && depths[move.endPos()] < 0)
+                    {
+                        depths[move.endPos()] = depths[pos] + 1;
+                        queue.push(move.endPos());
+                    }
                 }
             }
 
-            return c;
-        }
-
-        void fillInitialMovePotential()
-        {
-            const int numEdges = static_cast<int>(m_allMoves.size());
-
-            for (int edgeId = 0; edgeId < numEdges; ++edgeId)
+            // the number of jewels on the moves collecting it, farther ones first when equal
+            std::vector<std::tuple<int, int, JewelId>> jewels;
+            std::vector<int> distanceByJewelId(numJewels(), std::numeric_limits<int>::max());
+            for (int jewelId = 0; jewelId < numJewels(); ++jewelId)
             {
-                const Move& move = *(m_allMoves[edgeId]);
-                for (const int jewelId : move.jewels())
+                int numShared = 0;
+                for (const Move* move : m_movesCollectingJewel[jewelId])
                 {
-                    m_potentialOfJewelAtEdge[jewelId][edgeId] = maxPotential;
+                    numShared += move->jewels().size();
+                    distanceByJewelId[jewelId] = std::min(distanceByJewelId[jewelId], depths[move->startPos()] + 1);
                 }
+                jewels.emplace_back(numShared, -distanceByJewelId[jewelId], jewelId);
             }
-        }
+            std::sort(std::begin(jewels), std::end(jewels));
 
-        void printAllMovesFlat() const
-        {
-            for (const Move* movePtr : m_allMoves)
+            std::vector<std::uint8_t> isSharingMove(numJewels(), false);
+            std::vector<int> distances;
+            for (const auto& [numShared, negatedDistance, jewelId] : jewels)
             {
-                const Move& move = *movePtr;
-                const Coords2& start = move.startPos();
-                const Coords2& end = move.endPos();
-                if (end != start && end != Coords2(0, 0))
+                if (isSharingMove[jewelId])
                 {
-                    g_logger.log("(", start.x, ", ", start.y, ") -> (", end.x, ", ", end.y, "): ");
-                    for (int id : move.jewels())
+                    continue;
+                }
+
+                distances.emplace_back(distanceByJewelId[jewelId]);
+                for (const Move* move : m_movesCollectingJewel[jewelId])
+                {
+                    for (const int otherJewelId : move->jewels())
                     {
-                        g_logger.log(id, ' ');
+                        isSharingMove[otherJewelId] = true;
                     }
-                    g_logger.log(" [", m_totalPotentialAtEdge[move.id()], "]");
                 }
-                g_logger.log('\n');
             }
-        }
-
-        void printPotential()
-        {
-            const int numEdges = static_cast<int>(m_allMoves.size());
 
-            g_logger.log("    ");
-            for (int edgeId = 0; edgeId < numEdges; ++edgeId)
+            std::sort(std::begin(distances), std::end(distances));
+            int bound = 0;
+            for (const int distance : distances)
             {
-                g_logger.log(std::setw(3), edgeId, ' ');
+                bound = std::max(distance, bound + 1);
             }
-            g_logger.log('\n');
+            return bound;
+        }
 
-            for (int jewelId = 0; jewelId < numJewels(); ++jewelId)
+        int countReachableJewels() const
+        {
+            std::vector<std::uint8_t> isReachable(m_jewelState.numJewels(), false);
+            for (const Move* move : m_allMoves)
             {
-                g_logger.log(std::setw(2), jewelId, ": ");
-                for (int edgeId = 0; edgeId < numEdges; ++edgeId)
+                for (const int jewelId : move->jewels())
                 {
-                    g_logger.log(std::setw(3), static_cast<int>(m_potentialOfJewelAtEdge[jewelId][edgeId]), ' ');
+                    isReachable[jewelId] = true;
                 }
-                g_logger.log('\n');
             }
+            return std::count(std::begin(isReachable), std::end(isReachable), true);
         }
 
-        // when the jewel is collected for the first time
-        void onJewelContributionEnabled(int jewelId)
+        void addMove(Move & move)
         {
-            const int numEdges = static_cast<int>(m_allMoves.size());
+            const Coords2& end = move.endPos();
 
-            for (int edgeId = 0; edgeId < numEdges; ++edgeId)
+            move.setId(static_cast<int>(m_allMoves.size()));
+
+            m_allMoves.emplace_back(&move);
+            for (int jewelId : move.jewels())
             {
-                m_totalPotentialAtEdge[edgeId] += m_potentialOfJewelAtEdge[jewelId][edgeId];
+                m_movesCollectingJewel[jewelId].emplace_back(&move);
             }
+
+            m_movesByEndPosition[end].emplace_back(&move);
         }
 
-        // when the was collected but is no more
-        void onJewelContributionDisabled(int jewelId)
+        void addMoves(Moves && movesP, const Coords2 & start, std::queue<Coords2> & ends)
         {
-            const int numEdges = static_cast<int>(m_allMoves.size());
-
-            for (int edgeId = 0; edgeId < numEdges; ++edgeId)
+            Moves& moves = m_movesByPosition[start] = std::move(movesP);
+            for (Direction dir : DirectionHelper::values())
             {
-                m_totalPotentialAtEdge[edgeId] -= m_potentialOfJewelAtEdge[jewelId][edgeId];
+                Move& move = moves[dir];
+                const Coords2& start = move.startPos();
+                const Coords2& end = move.endPos();
+
+                if (start == end)
+                {
+                    continue;
+                }
+
+                addMove(move);
+
+                // add the destination point to the queue
+                // so we gather all moves from there later
+                ends.push(end);
             }
         }
 
-        void summarizeMovePotential()
+        void generateAllMoves()
         {
-            const int numEdges = static_cast<int>(m_allMoves.size());
+            const auto timer = m_bench->scopedTimer("generateAllMoves");
 
-            for (int jewelId = 0; jewelId < numJewels(); ++jewelId)
+            const int width = m_level.width();
+            const int height = m_level.height();
+            Array2<bool> isVisited(width, height, false);
+
+            std::queue<Coords2> coordsQueue;
+            coordsQueue.push(m_vehicleCoords);
+
+            while (!coordsQueue.empty())
             {
-                for (int edgeId = 0; edgeId < numEdges; ++edgeId)
+                const Coords2 start = coordsQueue.front();
+                coordsQueue.pop();
+
+                if (isVisited[start])
                 {
-                    if (DirectionHelper::isDiagonal(m_allMoves[edgeId]->direction()))
-                    {
-                        // empirical tests show that this is a good factor for diagonal moves
-                        m_potentialOfJewelAtEdge[jewelId][edgeId] *= 0.70710678118654752440084436210485f; // 1/sqrt(2)
-                    }
-                    m_totalPotentialAtEdge[edgeId] += m_potentialOfJewelAtEdge[jewelId][edgeId];
+                    // prevent infinite recursion
+                    continue;
                 }
+
+                isVisited[start] = true;
+
+                addMoves(generateMovesAt(start), start, coordsQueue);
             }
         }
 
-        void propagatePotentialFromJewel(int jewelId)
+        Moves generateMovesAt(const Coords2 & start) const
         {
-            std::queue<const Move*> movesQueue;
-            for (const Move* move : m_movesCollectingJewel[jewelId])
-            {
-                movesQueue.emplace(move);
-            }
+            Moves moves{};
 
-            while (!movesQueue.empty())
+            for (Direction dir : DirectionHelper::values())
             {
-                const Move& move = *movesQueue.front();
-                movesQueue.pop();
+                const Coords2 offset = DirectionHelper::offset(dir);
+                Coords2 end = start;
 
-                const Coords2& start = move.startPos();
+                // walk to the nearest stopping point
+                std::vector<JewelId> jewels;
+                if (m_level[start] == CellType::Jewel)
+                {
+                    jewels.emplace_back(m_jewelIdByPosition[start]);
+                }
+                for (;;)
+                {
+                    end += offset;
 
-                const auto& currentPotential = m_potentialOfJewelAtEdge[jewelId][move.id()];
-                const auto newPotential = saturatePotential(currentPotential);
+                    const int x = end.x;
+                    const int y = end.y;
+                    const CellType cell = m_level[x][y];
 
-                for (const Move* moveAtEnd : m_movesByEndPosition[start])
-                {
-                    auto& currentPotentialAtEnd = m_potentialOfJewelAtEdge[jewelId][moveAtEnd->id()];
-                    if (newPotential > currentPotentialAtEnd)
+                    if (cell == CellType::Jewel)
                     {
-                        currentPotentialAtEnd = newPotential;
-                        movesQueue.emplace(moveAtEnd);
+                        jewels.emplace_back(m_jewelIdByPosition[x][y]);
+                    }
+
+                    if (cell == CellType::Wall)
+                    {
+                        // we have to stop one before
+                        moves[dir] = Move(invalidMoveId, start, end - offset, std::move(jewels));
+                        break;
+                    }
+
+                    if (cell == CellType::Mine)
+                    {
+                        // invalidate the whole direction
+                        moves[dir] = Move(invalidMoveId, start, start, std::move(jewels));
+                        break;
+                    }
+
+                    // there's always a hole under the vehicle
+                    if (cell == CellType::Hole || (cell == CellType::Vehicle && isVehicleSpotAHole))
+                    {
+                        // stop right here
+                        moves[dir] = Move(invalidMoveId, start, end, std::move(jewels));
+                        break;
                     }
                 }
             }
+
+            return moves;
         }
+    };
 
-        void propagateMovePotential()
+    // replays the solution cell by cell on the board, independently of any preprocessed data
+    // the same rules as in judge.py
+    SolutionStatus judge(const Level& level, const Solution& solution, bool isVehicleSpotAHole)
+    {
+        if (solution.size() > level.maxMoves())
         {
-            constexpr int numAllPrints = 20;
-            const int numEdges = static_cast<int>(m_allMoves.size());
+            return SolutionStatus::TooLong;
+        }
 
-            int numPrints = 0;
-            for (int jewelId = 0; jewelId < numJewels(); ++jewelId)
+        Board board = level.board();
+        Coords2 pos = level.vehicleCoords();
+        board[pos] = isVehicleSpotAHole ? CellType::Hole : CellType::Blank;
+
+        for (Direction dir : solution)
+        {
+            const Coords2 offset = DirectionHelper::offset(dir);
+            for (;;)
             {
-                propagatePotentialFromJewel(jewelId);
-                if (jewelId >= numJewels() / numAllPrints * numPrints)
+                const Coords2 nextPos = pos + offset;
+                const CellType cell = board[nextPos];
+                if (cell == CellType::Mine)
                 {
-                    g_logger.log("Propagate potential ", jewelId + 1, '/', numJewels(), '\n');
-                    ++numPrints;
+                    return SolutionStatus::Mine;
+                }
+
+                if (cell == CellType::Wall)
+                {
+                    break;
+                }
+
+                pos = nextPos;
+
+                if (cell == CellType::Jewel)
+                {
+                    board[pos] = CellType::Blank;
+                }
+                else if (cell == CellType::Hole)
+                {
+                    break;
                 }
             }
         }
 
-        PotentialType saturatePotential(PotentialType p) const
-        {
-            // empirically chosen
-            return p / 7 * 3;
+        bool anyJewelLeft = false;
+        board.forEach([&anyJewelLeft](CellType cell, int x, int y) {
+            if (cell == CellType::Jewel)
+            {
+                anyJewelLeft = true;
+            }
+            });
+
+        return anyJewelLeft ? SolutionStatus::JewelsLeft : SolutionStatus::Ok;
+    }
+
+    // one of the 8 symmetries of the grid: a mirror image across the north-south axis (if any)
+    // followed by numQuarterTurns clockwise rotations by 90 degrees
+    struct Symmetry
+    {
+        int numQuarterTurns;
+        bool isMirrored;
+
+        static const std::array<Symmetry, 8>& values()
+        {
+            static const std::array<Symmetry, 8> v{
+                Symmetry{ 0, false },
+                Symmetry{ 1, false },
+                Symmetry{ 2, false },
+                Symmetry{ 3, false },
+                Symmetry{ 0, true },
+                Symmetry{ 1, true },
+                Symmetry{ 2, true },
+                Symmetry{ 3, true }
+            };
+
+            return v;
         }
 
-        void initializeMovePotential()
+        Direction apply(Direction dir) const
         {
-            const int numEdges = static_cast<int>(m_allMoves.size());
-
-            m_potentialOfJewelAtEdge = Array2<PotentialType>(numJewels(), numEdges);
-            m_totalPotentialAtEdge = std::vector<TotalPotentialType>(numEdges);
+            if (isMirrored)
+            {
+                dir = DirectionHelper::mirrored(dir);
+            }
+            for (int i = 0; i < numQuarterTurns; ++i)
+            {
+                dir = DirectionHelper::rotatedClockwise(DirectionHelper::rotatedClockwise(dir));
+            }
+            return dir;
         }
 
-        int countJewels() const
+        Direction applyInverse(Direction dir) const
         {
-            int count = 0;
-            m_level.board().forEach([&count](CellType cell, int x, int y) {
-                if (cell == CellType::Jewel)
-                {
-                    ++count;
-                }
-                });
-            return count;
+            for (int i = 0; i < numQuarterTurns; ++i)
+            {
+                dir = DirectionHelper::rotatedCounterClockwise(DirectionHelper::rotatedCounterClockwise(dir));
+            }
+            if (isMirrored)
+            {
+                dir = DirectionHelper::mirrored(dir);
+            }
+            return dir;
         }
 
-        void printAllMoves() const
+        Board apply(const Board& board) const
         {
-            forEach(m_movesByPosition, [](const Moves & moves, int x, int y) {
-                const Coords2 start(x, y);
-
-                g_logger.log("From (", x, ", ", y, ") to: ");
-                for (Direction dir : DirectionHelper::values())
-                {
-                    const Move& move = moves[dir];
-                    const Coords2& end = move.endPos();
-                    if (end != start && end != Coords2(0, 0))
-                    {
-                        g_logger.log("(", end.x, ", ", end.y, ", {");
-                        for (int id : move.jewels())
-                        {
-                            g_logger.log(id, ' ');
-                        }
-                        g_logger.log("}) ");
-                    }
-                }
-                g_logger.log('\n');
-                });
+            Board result = board;
+            if (isMirrored)
+            {
+                board.forEach([&result, &board](CellType cell, int x, int y) {
+                    result[board.width() - 1 - x][y] = cell;
+                    });
+            }
+            for (int i = 0; i < numQuarterTurns; ++i)
+            {
+                Board rotated(result.height(), result.width());
+                result.forEach([&rotated, &result](CellType cell, int x, int y) {
+                    rotated[result.height() - 1 - y][x] = cell;
+                    });
+                result = std::move(rotated);
+            }
+            return result;
         }
 
-        void identifyJewels()
+        // directions the same solution takes on the transformed board
+        Solution apply(const Solution& solution) const
         {
-            int nextJewelId = 0;
-            m_level.board().forEach([this, &nextJewelId](CellType cell, int x, int y) {
-                if (cell == CellType::Jewel)
+            Solution result = Solution::empty();
+            for (Direction dir : solution)
+            {
+                if (dir != Direction::None)
                 {
-                    m_jewelIdByPosition[x][y] = nextJewelId++;
+                    result.push(apply(dir));
                 }
-                });
+            }
+            return result;
         }
 
-        void printSccs() const
+        Solution applyInverse(const Solution& solution) const
         {
-            const int width = m_sccIdAt.width();
-            const int height = m_sccIdAt.height();
-
-            for (int y = 0; y < height; ++y)
+            Solution result = Solution::empty();
+            for (Direction dir : solution)
             {
-                for (int x = 0; x < width; ++x)
+                if (dir != Direction::None)
                 {
-                    const int id = m_sccIdAt[x][y];
-                    if (id < 0)
-                    {
-                        g_logger.log(' ');
-                    }
-                    else
-                    {
-                        g_logger.log(id);
-                    }
-                    g_logger.log(' ');
+                    result.push(applyInverse(dir));
                 }
-                g_logger.log('\n');
             }
+            return result;
+        }
+    };
 
-            for (int i = 0; i < m_sccs.size(); ++i)
+    // best known solutions, in a text file with one line per improvement: board hash and solution.
+    // boards are stored in a canonical orientation, the one of the 8 symmetric variants with the lowest hash,
+    // so a level is found no matter how it is rotated or reflected. Lines are only ever appended
+    struct SolutionStore
+    {
+        SolutionStore(std::string filename) :
+            m_filename(std::move(filename))
+        {
+            std::ifstream file(m_filename);
+            std::string hash;
+            std::string directions;
+            while (file >> hash >> directions)
             {
-                g_logger.log("SCC ", m_sccs[i].id, " has ", m_sccs[i].jewels.size(), " jewels\n");
-                g_logger.log("  Neighbours: ");
-                for (int n : m_sccs[i].neighbours)
+                auto& best = m_bestSolutions[std::strtoull(hash.c_str(), nullptr, 16)];
+                if (best.empty() || directions.size() < best.size())
                 {
-                    g_logger.log(n, ' ');
+                    best = std::move(directions);
                 }
-                g_logger.log('\n');
             }
         }
 
-        void assignJewelsToSccs()
+        // a stored solution that is valid for the level and fits into its maxMoves
+        std::optional<Solution> find(const Level& level, bool isVehicleSpotAHole) const
         {
-            // there is a possibility that a jewel is collectible from 2 or more SCCs
-            // #######
-            // #   * #
-            // *+#   #
-            // * .* O#
-            // #*O *##
-            // #######
-
-            // if a jewels lies on the edge that moves between different sccs (but not on the start) then
-            // it is assigned to the latter scc
-            // if it doesn't cross sccs then it is assigned to both (not at once, but we can be sure that
-            // end node has outcoming edges to the same scc so it will be handled)
+            const auto [symmetry, hash] = canonicalOrientation(level.board());
 
-            // use a set to remove duplicates, later copy to vector
-            std::vector<std::set<int>> jewels(m_sccs.size());
-            int numTotalJewels = 0;
-            const int numJewels = m_jewelState.numJewels();
-            for (const Move* movePtr : m_allMoves)
+            std::string directions;
             {
-                const Move& move = *movePtr;
-                if (move.id() < 0)
-                {
-                    continue;
-                }
-
-                const Coords2& v = move.startPos();
-                const int iv = m_sccIdAt[v];
-                const Coords2& w = move.endPos();
-                const int iw = m_sccIdAt[w];
-                for (const int jewelId : move.jewels())
+                std::lock_guard<std::mutex> lock(m_mutex);
+                auto it = m_bestSolutions.find(hash);
+                if (it == m_bestSolutions.end())
                 {
-                    if (iv != iw && m_jewelIdByPosition[move.startPos()] != jewelId)
-                    {
-                        jewels[iw].emplace(jewelId);
-                    }
-                    else
-                    {
-                        jewels[iv].emplace(jewelId);
-                    }
-
-                    ++numTotalJewels;
+                    return std::nullopt;
                 }
+                directions = it->second;
             }
 
-            for (int i = 0; i < m_sccs.size(); ++i)
+            Solution canonicalSolution = Solution::empty();
+            for (const char c : directions)
             {
-                m_sccs[i].jewels = std::vector<JewelId>(std::begin(jewels[i]), std::end(jewels[i]));
+                canonicalSolution.push(DirectionHelper::fromId(c - '0'));
             }
 
-            m_lastSccWithJewel.resize(numJewels);
-            for (int i = 0; i < m_sccs.size(); ++i)
+            // also guards against hash collisions and edited files
+            Solution solution = symmetry.applyInverse(canonicalSolution);
+            if (judge(level, solution, isVehicleSpotAHole) != SolutionStatus::Ok)
             {
-                for (const int jewelId : m_sccs[i].jewels)
-                {
-                    m_lastSccWithJewel[jewelId] = i;
-                }
+                return std::nullopt;
             }
 
-            resetSccCountsPerJewel();
+            return solution;
         }
 
-        bool mayBeSolvable() const
+        // keeps the solution if it is shorter than the stored one
+        void record(const Level& level, const Solution& solution)
         {
-            // try looking for sccs pair that cannot be both reached in one traversal
-            // but both contain the only instances of some jewel
-            // ie. look for places where taking one required scc prevents us from taking another required one
+            if (!solution.exists() || solution.isEmpty())
+            {
+                return;
+            }
 
-            for (const auto& scc : m_sccs)
+            const auto [symmetry, hash] = canonicalOrientation(level.board());
+            std::ostringstream directions;
+            write(symmetry.apply(solution), directions);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::string& best = m_bestSolutions[hash];
+            if (!best.empty() && best.size() <= directions.str().size())
             {
-                for (const int jewelId : scc.jewels)
-                {
-                    if (m_numSccsWithJewel[jewelId] == 1)
-                    {
-                        // this is the only scc where we can collect it
+                return;
+            }
 
-                        for (int otherSccId = 0; otherSccId < m_sccs.size(); ++otherSccId)
-                        {
-                            if (scc.id == otherSccId)
-                            {
-                                continue;
-                            }
+            best = directions.str();
+            std::ofstream file(m_filename, std::ios::app);
+            file << std::hex << std::setw(16) << std::setfill('0') << hash << ' ' << best << '\n';
+        }
 
-                            if (m_ifSccTraversedThenSccUnreachable[scc.id][otherSccId])
-                            {
-                                // we can't reach this scc if we take the previously checked one
+    private:
+        std::string m_filename;
+        std::map<std::uint64_t, std::string> m_bestSolutions;
+        mutable std::mutex m_mutex;
 
-                                for (const int jewelId : m_sccs[otherSccId].jewels)
-                                {
-                                    // but we have to reach it to have a solution
-                                    // so it is not solvable
-                                    if (m_numSccsWithJewel[jewelId] == 1)
-                                    {
-                                        return false;
-                                    }
-                                }
-                            }
-                        }
-                    }
+        static std::pair<Symmetry, std::uint64_t> canonicalOrientation(const Board& board)
+        {
+            Symmetry bestSymmetry = Symmetry::values()[0];
+            std::uint64_t bestHash = board.hash();
+            for (const Symmetry& symmetry : Symmetry::values())
+            {
+                const std::uint64_t hash = symmetry.apply(board).hash();
+                if (hash < bestHash)
+                {
+                    bestSymmetry = symmetry;
+                    bestHash = hash;
                 }
             }
 
-            return true;
+            return { bestSymmetry, bestHash };
         }
+    };
 
-        bool remainsSolvableAfterEnteringScc(std::vector<std::uint8_t> & isTraversed, int i)
+    // chooses the index width for the level and runs the solver instantiated with it
+    struct Solver
+    {
+        static constexpr auto noTimeLimit = BasicSolver<NarrowIndexPolicy>::noTimeLimit;
+
+        static constexpr bool isVehicleSpotAHole = BasicSolver<NarrowIndexPolicy>::isVehicleSpotAHole;
+
+        // store is optional, it is consulted first and told about any solution found
+        Solver(Level level, Bench& bench, std::chrono::milliseconds timeLimit = noTimeLimit, int numThreads = 1, std::string cacheDirectory = {}, SolutionStore* store = nullptr) :
+            m_level(std::move(level)),
+            m_bench(&bench),
+            m_timeLimit(timeLimit),
+            m_numThreads(numThreads),
+            m_cacheDirectory(std::move(cacheDirectory)),
+            m_store(store)
         {
-            // this may be very costly potentially
-            // we'll have to se whether it requires any more early exits
+        }
 
-            if (i == invalidSccId)
+        Solution solve()
+        {
+            if (m_store == nullptr)
             {
-                return true;
+                return solve(std::move(m_level));
             }
 
-            if (isTraversed[i])
+            if (std::optional<Solution> stored = m_store->find(m_level, isVehicleSpotAHole))
             {
-                // already traversed, no action required
-                return true;
+                g_logger.log("Found in the solution store\n");
+                m_bench->end();
+                return *stored;
             }
 
-            bool remainsSolvable = true;
-            for (const auto& scc : m_sccs)
+            Solution solution = solve(m_level);
+            m_store->record(m_level, solution);
+            return solution;
+        }
+
+        // moves are the most numerous of the indexed elements, there is at most one node
+        // more than there are moves and no more sccs than nodes.
+        // jewel ids also have to hold the number of jewels plus one
+        static bool fitsNarrowIndices(const Level& level)
+        {
+            constexpr int maxIndex = std::numeric_limits<NarrowIndexPolicy::MoveId>::max();
+
+            const int width = level.width();
+            const int height = level.height();
+            if (width * height * DirectionHelper::values().size() < maxIndex)
             {
-                if (m_ifSccTraversedThenSccUnreachable[i][scc.id])
-                {
-                    for (const int jewelId : scc.jewels)
-                    {
-                        m_numSccsWithJewel[jewelId] -= 1;
-                        if (m_numSccsWithJewel[jewelId] <= 0)
-                        {
-                            remainsSolvable = false;
-                        }
-                    }
-                }
+                return true;
             }
 
-            for (const auto& scc : m_sccs)
-            {
-                if (m_ifSccTraversedThenSccUnreachable[i][scc.id])
+            int numJewels = 0;
+            level.board().forEach([&numJewels](CellType cell, int x, int y) {
+                if (cell == CellType::Jewel)
                 {
-                    for (const int jewelId : scc.jewels)
-                    {
-                        m_numSccsWithJewel[jewelId] += 1;
-                    }
+                    ++numJewels;
                 }
+                });
+            if (numJewels + 1 > maxIndex)
+            {
+                return false;
             }
 
-            return remainsSolvable;
+            return countReachableMoves(level, maxIndex) < maxIndex;
         }
 
-        void fillBackwardSccUnreachabilityIfSccTraversed(const Scc & initialScc)
-        {
-            // identifies backward reachable sccs from scc
-
-            const int numSccs = m_sccs.size();
-            std::vector<int> isVisited(numSccs, false);
-            std::stack<int> reachable;
-            reachable.emplace(initialScc.id);
+    private:
+        Level m_level;
+        Bench* m_bench;
+        std::chrono::milliseconds m_timeLimit;
+        int m_numThreads;
+        std::string m_cacheDirectory;
+        SolutionStore* m_store;
 
-            while (!reachable.empty())
+        Solution solve(Level level)
+        {
+            if (fitsNarrowIndices(level))
             {
-                const Scc& scc = m_sccs[reachable.top()];
-                reachable.pop();
-
-                m_ifSccTraversedThenSccUnreachable[initialScc.id][scc.id] = false;
-
-                for (const int n : scc.predecessors)
-                {
-                    if (!isVisited[n])
-                    {
-                        isVisited[n] = true;
-                        reachable.emplace(n);
-                    }
-                }
+                return BasicSolver<NarrowIndexPolicy>(std::move(level), *m_bench, m_timeLimit, m_numThreads, std::move(m_cacheDirectory)).solve();
             }
+
+            g_logger.log("Using wide indices\n");
+            return BasicSolver<WideIndexPolicy>(std::move(level), *m_bench, m_timeLimit, m_numThreads, std::move(m_cacheDirectory)).solve();
         }
 
-        void fillForwardSccUnreachabilityIfSccTraversed(const Scc & initialScc)
+        // same rules as in BasicSolver::generateMovesAt, stops counting after limit
+        static int countReachableMoves(const Level& level, int limit)
         {
-            // identifies forward reachable sccs from scc
+            Array2<bool> isVisited(level.width(), level.height(), false);
+            std::vector<Coords2> stack{ level.vehicleCoords() };
+            isVisited[level.vehicleCoords()] = true;
 
-            const int numSccs = m_sccs.size();
-            std::vector<int> isVisited(numSccs, false);
-            std::stack<int> reachable;
-            reachable.emplace(initialScc.id);
-
-            while (!reachable.empty())
+            int numMoves = 0;
+            while (!stack.empty() && numMoves < limit)
             {
-                const Scc& scc = m_sccs[reachable.top()];
-                reachable.pop();
+                const Coords2 start = stack.back();
+                stack.pop_back();
+
+                for (Direction dir : DirectionHelper::values())
+                {
+                    const Coords2 offset = DirectionHelper::offset(dir);
+                    Coords2 end = start;
+                    for (;;)
+                    {
+                        const CellType cell = level[end + offset];
+                        if (cell == CellType::Wall || cell == CellType::Mine)
+                        {
+                            if (cell == CellType::Mine)
+                            {
+                                end = start;
+                            }
+                            break;
+                        }
 
-                m_ifSccTraversedThenSccUnreachable[initialScc.id][scc.id] = false;
+                        end += offset;
+                        if (cell == CellType::Hole || (cell == CellType::Vehicle && isVehicleSpotAHole))
+                        {
+                            break;
+                        }
+                    }
 
-                for (const int n : scc.neighbours)
-                {
-                    if (!isVisited[n])
+                    if (end == start)
                     {
-                        isVisited[n] = true;
-                        reachable.emplace(n);
+                        continue;
+                    }
+
+                    ++numMoves;
+                    if (!isVisited[end])
+                    {
+                        isVisited[end] = true;
+                        stack.emplace_back(end);
                     }
                 }
             }
+
+            return numMoves;
         }
+    };
 
-        void fillSccUnreachabilityIfSccTraversed(const Scc & initialScc)
-        {
-            // identifies reachable sccs from scc
+    bool hasMoreLevels(std::istream& in)
+    {
+        in >> std::ws;
+        return in.peek() != std::char_traits<char>::eof();
+    }
 
-            fillForwardSccUnreachabilityIfSccTraversed(initialScc);
-            fillBackwardSccUnreachabilityIfSccTraversed(initialScc);
-        }
+    std::vector<std::string> readLevelList(const std::string& listFilename)
+    {
+        // same format as used by rate_min.py, one level name per line
+        // levels are stored next to the list as <name>.txt
 
-        void fillSccConditionalUnreachability()
+        const auto separator = listFilename.find_last_of("/\\");
+        const std::string directory = separator == std::string::npos ? "" : listFilename.substr(0, separator + 1);
+
+        std::vector<std::string> filenames;
+        std::ifstream list(listFilename);
+        std::string name;
+        while (list >> name)
         {
-            const int numSccs = m_sccs.size();
+            filenames.emplace_back(directory + name + ".txt");
+        }
 
-            // we will make reachable all the ones we can reach, unreachable by default
-            m_ifSccTraversedThenSccUnreachable = Array2<bool>(numSccs, numSccs, true);
+        return filenames;
+    }
 
-            for (const auto& scc : m_sccs)
-            {
-                fillSccUnreachabilityIfSccTraversed(scc);
-            }
-        }
+    struct BatchSolver
+    {
+        // how many parsed levels may wait for a free worker
+        static constexpr int numQueuedLevelsPerThread = 2;
 
-        bool isVertex(const Coords2 & v) const
+        BatchSolver(int numThreads, std::chrono::milliseconds timeLimit, int maxMovesOverride, std::string cacheDirectory, SolutionStore* store) :
+            m_numThreads(std::max(1, numThreads)),
+            m_timeLimit(timeLimit),
+            m_maxMovesOverride(maxMovesOverride),
+            m_cacheDirectory(std::move(cacheDirectory)),
+            m_store(store),
+            m_isInputExhausted(false),
+            m_nextIndexToWrite(0)
         {
-            return m_nodeIdByPosition[v] != invalidNodeId;
         }
 
-        void resetSccCountsPerJewel()
+        // nextLevel(level) is called on the calling thread while workers solve the previous levels
+        // it should return false when there are no more levels and leave level empty if the next one can't be read
+        // one line is written for each level, in input order, BRAK for the unreadable ones
+        template <typename NextLevelFuncT>
+        void run(NextLevelFuncT&& nextLevel, std::ostream& out)
         {
-            m_numSccsWithJewel.resize(m_jewelState.numJewels());
-            std::fill(std::begin(m_numSccsWithJewel), std::end(m_numSccsWithJewel), 0);
+            std::vector<std::thread> workers;
+            for (int i = 0; i < m_numThreads; ++i)
+            {
+                workers.emplace_back([this, &out]() { work(out); });
+            }
 
-            for (const auto& scc : m_sccs)
+            for (int index = 0;; ++index)
             {
-                for (const int jewelId : scc.jewels)
+                std::optional<Level> level;
+                if (!nextLevel(level))
                 {
-                    m_numSccsWithJewel[jewelId] += 1;
+                    break;
                 }
+
+                std::unique_lock<std::mutex> lock(m_tasksMutex);
+                m_tasksNotFull.wait(lock, [this]() {
+                    return static_cast<int>(m_tasks.size()) < m_numThreads * numQueuedLevelsPerThread;
+                    });
+                m_tasks.push_back(Task{ index, std::move(level) });
+                m_tasksNotEmpty.notify_one();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_tasksMutex);
+                m_isInputExhausted = true;
+            }
+            m_tasksNotEmpty.notify_all();
+
+            for (auto& worker : workers)
+            {
+                worker.join();
             }
         }
 
-        void identifyOneScc(std::stack<Coords2> & S, const Coords2 & v, int& index, Array2<int> & indexAt, Array2<int> & lowlinkAt, Array2<bool> & onStackAt)
+    private:
+        struct Task
         {
-            // Set the depth index for v to the smallest unused index
-            indexAt[v] = index;
-            lowlinkAt[v] = index;
-            index += 1;
-            S.emplace(v);
-            onStackAt[v] = true;
+            int index;
+            // empty if it couldn't be read
+            std::optional<Level> level;
+        };
 
-            // Consider successors of v
-            const Moves& moves = m_movesByPosition[v];
-            for (Direction dir : DirectionHelper::values())
+        int m_numThreads;
+        std::chrono::milliseconds m_timeLimit;
+        int m_maxMovesOverride;
+        std::string m_cacheDirectory;
+        SolutionStore* m_store;
+
+        std::mutex m_tasksMutex;
+        std::condition_variable m_tasksNotEmpty;
+        std::condition_variable m_tasksNotFull;
+        std::deque<Task> m_tasks;
+        bool m_isInputExhausted;
+
+        // results that are done but wait for the preceding ones
+        std::mutex m_resultsMutex;
+        std::map<int, std::string> m_pendingResults;
+        int m_nextIndexToWrite;
+
+        void work(std::ostream& out)
+        {
+            for (;;)
             {
-                const Move& move = moves[dir];
-                if (move.id() < 0)
+                std::optional<Task> task;
                 {
-                    continue;
-                }
+                    std::unique_lock<std::mutex> lock(m_tasksMutex);
+                    m_tasksNotEmpty.wait(lock, [this]() { return !m_tasks.empty() || m_isInputExhausted; });
+                    if (m_tasks.empty())
+                    {
+                        return;
+                    }
 
-                const Coords2& w = move.endPos();
-                if (indexAt[w] == -1)
-                {
-                    // Successor w has not yet been visited; recurse on it
-                    identifyOneScc(S, w, index, indexAt, lowlinkAt, onStackAt);
-                    lowlinkAt[v.x][v.y] = std::min(lowlinkAt[v.x][v.y], lowlinkAt[w]);
+                    task.emplace(std::move(m_tasks.front()));
+                    m_tasks.pop_front();
                 }
-                else if (onStackAt[w])
+                m_tasksNotFull.notify_one();
+
+                std::string result = solve(std::move(task->level));
+
+                std::lock_guard<std::mutex> lock(m_resultsMutex);
+                m_pendingResults.emplace(task->index, std::move(result));
+                for (auto it = m_pendingResults.find(m_nextIndexToWrite); it != m_pendingResults.end(); it = m_pendingResults.find(m_nextIndexToWrite))
                 {
-                    // Successor w is in stack S and hence in the current SCC
-                    // If w is not on stack, then (v, w) is a cross-edge in the DFS tree and must be ignored
-                    // Note: The next line may look odd - but is correct.
-                    // It says w.index not w.lowlink; that is deliberate and from the original paper
-                    lowlinkAt[v.x][v.y] = std::min(lowlinkAt[v.x][v.y], indexAt[w]);
+                    out << it->second << '\n';
+                    m_pendingResults.erase(it);
+                    ++m_nextIndexToWrite;
                 }
+                out.flush();
             }
+        }
 
-            // If v is a root node, pop the stack and generate an SCC
-            if (lowlinkAt[v.x][v.y] == indexAt[v])
+        std::string solve(std::optional<Level> level) const
+        {
+            std::ostringstream out;
+            if (!level.has_value())
             {
-                std::vector<Coords2> scc;
-                Coords2 w;
-                do
-                {
-                    w = S.top();
-                    S.pop();
-                    onStackAt[w] = false;
-                    scc.emplace_back(w);
-                } while (w != v);
+                write(Solution::invalid(), out);
+                return out.str();
+            }
 
-                m_sccs.emplace_back();
-                m_sccs.back().nodes = std::move(scc);
+            if (m_maxMovesOverride >= 0)
+            {
+                level->setMaxMoves(m_maxMovesOverride);
             }
+
+            Bench bench;
+            Solver solver(std::move(*level), bench, m_timeLimit, 1, m_cacheDirectory, m_store);
+            write(solver.solve(), out);
+            return out.str();
         }
+    };
 
-        void identifySccs()
-        {
-            // https://en.wikipedia.org/wiki/Tarjan%27s_strongly_connected_components_algorithm
+    struct LevelBenchmark
+    {
+        std::string name;
+        // -1 if no solution was found
+        int moves;
+        int baselineMoves;
+        SolutionStatus status;
+        std::string solution;
+        int numAttempts;
+        double wallTime;
+        double timeToBest;
+        std::uint64_t nodes;
+        double nodesPerSecond;
+        // summed over all attempts
+        std::vector<std::pair<std::string, double>> phaseTimes;
+        // -1 if no attempt got as far as computing it
+        int lowerBound;
+        // the best solution is as short as the lower bound
+        bool isOptimal;
+    };
 
-            int index = 0;
-            std::stack<Coords2> S;
-            Array2<int> indexAt(m_level.width(), m_level.height(), -1);
-            Array2<int> lowlinkAt(m_level.width(), m_level.height(), -1);
-            Array2<bool> onStackAt(m_level.width(), m_level.height(), false);
-            const int width = m_movesByPosition.width();
-            const int height = m_movesByPosition.height();
+    // rate_min.py starts from this limit, the boards with no solution count as having this many moves
+    constexpr int initialBenchmarkMaxMoves = 9999;
 
-            for (int x = 0; x < width; ++x)
+    double toSeconds(Bench::duration d)
+    {
+        return std::chrono::duration<double>(d).count();
+    }
+
+    std::string levelNameFromFilename(const std::string& filename)
+    {
+        const auto separator = filename.find_last_of("/\\");
+        std::string name = separator == std::string::npos ? filename : filename.substr(separator + 1);
+        const auto extension = name.rfind(".txt");
+        if (extension != std::string::npos && extension + 4 == name.size())
+        {
+            name.erase(extension);
+        }
+        return name;
+    }
+
+    // best number of moves for each level from the output of rate_min.py (bench/*_min_10s.txt)
+    std::map<std::string, int> readBenchmarkBaseline(const std::string& filename)
+    {
+        std::map<std::string, int> best;
+        std::ifstream file(filename);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream words(line);
+            std::string name, status;
+            int moves;
+            if (words >> name >> status >> moves && status == "OK")
             {
-                for (int y = 0; y < height; ++y)
+                auto it = best.find(name);
+                if (it == best.end() || moves < it->second)
                 {
-                    const Coords2 v(x, y);
-                    if (isVertex(v) && indexAt[v] == -1)
-                    {
-                        identifyOneScc(S, v, index, indexAt, lowlinkAt, onStackAt);
-                    }
+                    best[name] = moves;
                 }
             }
+        }
+        return best;
+    }
 
-            // reverse sccs so they are in topological order
-            std::reverse(std::begin(m_sccs), std::end(m_sccs));
+    LevelBenchmark benchmarkLevel(const std::string& name, const Level& level, int baselineMoves, std::chrono::milliseconds timeLimit, bool isTimeShared, int maxAttempts, int numThreads, const std::string& cacheDirectory, std::ostream& out)
+    {
+        // same procedure as rate_min.py, each attempt asks for a solution shorter than the best one so far
+        // and gets the whole time limit, unless it is shared by all attempts on the level
+        // writes the same lines as rate_min.py
 
-            // fills all other information based on sccs
-            // ids
-            int i = 0;
-            for (auto& scc : m_sccs)
+        using clock = std::chrono::high_resolution_clock;
+
+        LevelBenchmark result{ name, -1, baselineMoves, SolutionStatus::Ok, "", 0, 0.0, 0.0, 0, 0.0, {}, -1, false };
+        double searchTime = 0.0;
+
+        const auto levelStart = clock::now();
+        int maxMoves = std::max(initialBenchmarkMaxMoves, level.width() * level.height()) - 1;
+        for (;;)
+        {
+            const auto remaining = isTimeShared
+                ? std::chrono::duration_cast<std::chrono::milliseconds>(timeLimit - (clock::now() - levelStart))
+                : timeLimit;
+            if (remaining.count() <= 0 || result.numAttempts >= maxAttempts)
             {
-                scc.id = i;
-                for (const auto& v : scc.nodes)
-                {
-                    m_sccIdAt[v] = i;
-                }
-                ++i;
+                break;
             }
 
-            // neighbours, predecessors
-            int iv = 0;
-            for (auto& scc : m_sccs)
-            {
-                std::set<int> neighbours;
-                for (const auto& v : scc.nodes)
-                {
-                    const Moves& moves = m_movesByPosition[v];
-                    for (Direction dir : DirectionHelper::values())
-                    {
-                        const Move& move = moves[dir];
-                        if (move.id() < 0)
-                        {
-                            continue;
-                        }
+            Level attemptLevel = level;
+            attemptLevel.setMaxMoves(maxMoves);
 
-                        const Coords2& w = move.endPos();
-                        const int iw = m_sccIdAt[w];
+            Bench bench;
+            const auto attemptStart = clock::now();
+            Solver solver(attemptLevel, bench, remaining, numThreads, cacheDirectory);
+            const Solution solution = solver.solve();
+            const auto attemptEnd = clock::now();
 
-                        if (iv != iw)
-                        {
-                            scc.bridges.emplace_back(&move);
-                            neighbours.emplace(iw);
-                        }
-                    }
+            result.numAttempts += 1;
+            result.nodes += bench.nodes();
+            result.lowerBound = std::max(result.lowerBound, bench.lowerBound());
+            for (const auto& phase : bench.phases())
+            {
+                auto it = std::find_if(std::begin(result.phaseTimes), std::end(result.phaseTimes), [&phase](const auto& p) { return p.first == phase.first; });
+                if (it == std::end(result.phaseTimes))
+                {
+                    it = result.phaseTimes.emplace(std::end(result.phaseTimes), phase.first, 0.0);
                 }
+                it->second += toSeconds(phase.second);
 
-                scc.neighbours = std::vector<SccId>(std::begin(neighbours), std::end(neighbours));
-                for (const int n : scc.neighbours)
+                if (it->first == "search")
                 {
-                    m_sccs[n].predecessors.emplace_back(scc.id);
+                    searchTime += toSeconds(phase.second);
                 }
-
-                ++iv;
             }
-        }
 
-        void fillDistancesFromNode(int s, const std::vector<SmallVector<NodeId, 8>> & moveEnds, std::vector<NodeId> & Q)
-        {
-            // bfs since we have all edge weights equal
+            if (!solution.exists())
+            {
+                break;
+            }
 
-            // using a fixed length vector is faster than std::queue
-            // we can do it since we know the amount of nodes and we visit each one at most once
+            const SolutionStatus status = judge(attemptLevel, solution, Solver::isVehicleSpotAHole);
+            std::ostringstream solutionString;
+            write(solution, solutionString);
+            out << name << ' ' << SolutionStatusHelper::toString(status) << ' ' << solution.size() << ' '
+                << std::fixed << std::setprecision(3) << toSeconds(attemptEnd - attemptStart) << "s "
+                << solutionString.str() << '\n';
 
-            const int numNodes = m_distanceFromTo.width();
-            std::vector<std::uint8_t> visited(numNodes, false);
-            m_distanceFromTo[s][s] = 0;
-            Q[0] = s;
-            auto begin = std::begin(Q);
-            auto end = begin + 1;
-            visited[s] = true;
-            while (begin != end)
+            if (status != SolutionStatus::Ok)
             {
-                int v = *begin;
-                ++begin;
-                for (const NodeId endV : moveEnds[v])
+                if (result.moves < 0)
                 {
-                    if (!visited[endV])
-                    {
-                        visited[endV] = true;
-                        // distance should never be intmax here so we can safely increment
-                        m_distanceFromTo[s][endV] = m_distanceFromTo[s][v] + 1;
-                        *end = endV;
-                        ++end;
-                    }
+                    result.status = status;
                 }
+                break;
             }
-        }
 
-        void fillDistancesBetweenNodes()
-        {
-            std::vector<SmallVector<NodeId, 8>> moveEnds(m_nodePositionById.size());
+            result.moves = solution.size();
+            result.solution = solutionString.str();
+            result.timeToBest = toSeconds(attemptEnd - levelStart);
 
-            forEach(m_movesByPosition, [this, &moveEnds](const Moves & moves, int x, int y)
-                {
-                    const int nodeId = m_nodeIdByPosition[x][y];
+            // a shorter one doesn't exist
+            if (solution.size() == result.lowerBound)
+            {
+                result.isOptimal = true;
+                break;
+            }
 
-                    if (nodeId == invalidNodeId)
-                    {
-                        return;
-                    }
+            maxMoves = solution.size() - 1;
+            if (maxMoves < 0)
+            {
+                break;
+            }
+        }
 
-                    for (Direction dir : DirectionHelper::values())
-                    {
-                        const Move& move = moves[dir];
-                        if (move.id() < 0) continue;
+        result.wallTime = toSeconds(clock::now() - levelStart);
+        result.nodesPerSecond = searchTime > 0.0 ? result.nodes / searchTime : 0.0;
 
-                        const Coords2& end = move.endPos();
-                        const int endV = m_nodeIdByPosition[end];
-                        moveEnds[nodeId].emplace_back(endV);
-                    }
-                });
+        out << '\n';
 
-            std::vector<NodeId> Q(m_nodePositionById.size());
-            const int numNodes = m_distanceFromTo.width();
-            for (int i = 0; i < numNodes; ++i)
+        return result;
+    }
+
+    void writeBenchmarkReport(const std::vector<LevelBenchmark>& results, int total, int baselineTotal, bool isTimeShared, std::ostream& out)
+    {
+        out << "{\n  \"total\": " << total << ",\n  \"baselineTotal\": " << baselineTotal
+            << ",\n  \"timeLimitPer\": \"" << (isTimeShared ? "level" : "attempt") << "\",\n  \"levels\": [";
+        for (int i = 0; i < results.size(); ++i)
+        {
+            const LevelBenchmark& r = results[i];
+            out << (i == 0 ? "\n" : ",\n")
+                << "    {\"name\": \"" << r.name << "\""
+                << ", \"status\": \"" << (r.moves < 0 && r.status == SolutionStatus::Ok ? "BRAK" : SolutionStatusHelper::toString(r.status)) << "\""
+                << ", \"moves\": " << r.moves
+                << ", \"baselineMoves\": " << r.baselineMoves
+                << ", \"lowerBound\": " << r.lowerBound
+                << ", \"optimal\": " << (r.isOptimal ? "true" : "false")
+                << ", \"attempts\": " << r.numAttempts
+                << std::fixed << std::setprecision(6)
+                << ", \"wallTime\": " << r.wallTime
+                << ", \"timeToBest\": " << r.timeToBest
+                << ", \"nodes\": " << r.nodes
+                << std::setprecision(0)
+                << ", \"nodesPerSecond\": " << r.nodesPerSecond
+                << std::setprecision(6)
+                << ", \"phases\": {";
+            for (int j = 0; j < r.phaseTimes.size(); ++j)
             {
-                fillDistancesFromNode(i, moveEnds, Q);
+                out << (j == 0 ? "" : ", ") << '"' << r.phaseTimes[j].first << "\": " << r.phaseTimes[j].second;
             }
+            out << "}, \"solution\": \"" << r.solution << "\"}";
         }
+        out << "\n  ]\n}\n";
+    }
 
-        void computePairwiseNodeDistances()
+    void runBenchmark(const std::vector<std::string>& filenames, std::chrono::milliseconds timeLimit, bool isTimeShared, int maxAttempts, int numThreads, const std::string& cacheDirectory, const std::string& baselineFilename, const std::string& reportFilename)
+    {
+        // stdout gets the same format as rate_min.py, so it can be saved as a new baseline
+        // the comparison with the baseline goes to stderr
+
+        const std::map<std::string, int> baseline = baselineFilename.empty() ? std::map<std::string, int>{} : readBenchmarkBaseline(baselineFilename);
+
+        std::vector<LevelBenchmark> results;
+        int total = 0;
+        int baselineTotal = 0;
+        int numRegressions = 0;
+        int numImprovements = 0;
+        for (const std::string& filename : filenames)
         {
-            // fills pairwise distances
+            std::ifstream file(filename);
+            const Level level = read<Level>(file);
+            const std::string name = levelNameFromFilename(filename);
+            const int unsolvedMoves = std::max(initialBenchmarkMaxMoves, level.width() * level.height());
 
-            Array2<bool> visited(m_level.width(), m_level.height(), false);
+            const auto it = baseline.find(name);
+            const int baselineMoves = it == baseline.end() ? -1 : it->second;
 
-            int c = 0;
-            for (const Move* movePtr : m_allMoves)
+            if (!file)
             {
-                const Move& move = *movePtr;
-                // we use end instead of start because each node has a way to get to
-                const Coords2& end = move.endPos();
-                if (!visited[end])
-                {
-                    m_nodeIdByPosition[end] = c;
-                    ++c;
-                    visited[end] = true;
-                }
+                // counted as unsolved
+                std::cerr << name << " can't be read\n";
+                results.push_back(LevelBenchmark{ name, -1, baselineMoves, SolutionStatus::Ok, "", 0, 0.0, 0.0, 0, 0.0, {}, -1, false });
             }
-
-            if (m_nodeIdByPosition[m_vehicleCoords] == invalidNodeId)
+            else
             {
-                // can happen if isVehicleSpotAHole == false
-                m_nodeIdByPosition[m_vehicleCoords] = c;
-                ++c;
+                results.emplace_back(benchmarkLevel(name, level, baselineMoves, timeLimit, isTimeShared, maxAttempts, numThreads, cacheDirectory, std::cout));
             }
+            const LevelBenchmark& result = results.back();
 
-            m_distanceFromTo = Array2<DistanceType>(c, c, infiniteDistance);
-            m_nodePositionById = std::vector<Coords2>(c);
+            const int moves = result.moves < 0 ? unsolvedMoves : result.moves;
+            total += moves;
 
-            m_level.board().forEach([this](CellType cell, int x, int y) {
-                const int id = m_nodeIdByPosition[x][y];
-                if (id < 0)
+            if (!baseline.empty())
+            {
+                baselineTotal += baselineMoves < 0 ? unsolvedMoves : baselineMoves;
+                if (baselineMoves >= 0 && moves != baselineMoves)
                 {
-                    return;
+                    std::cerr << name << ' ' << moves << " (baseline " << baselineMoves << ")\n";
+                    if (moves > baselineMoves) ++numRegressions;
+                    else ++numImprovements;
                 }
-                m_nodePositionById[id] = Coords2(x, y);
-                });
-
-            fillDistancesBetweenNodes();
-            g_logger.log("Number of nodes: ", c, '\n');
+            }
         }
 
-        bool areAllJewelsReachable() const
+        std::cout << "Total: " << total << '\n';
+        if (!baseline.empty())
         {
-            return m_jewelState.numJewels() == countReachableJewels();
+            std::cerr << "Total: " << total << " (baseline " << baselineTotal << "), "
+                << numImprovements << " improved, " << numRegressions << " regressed\n";
         }
 
-        int countReachableJewels() const
+        if (!reportFilename.empty())
         {
-            std::vector<std::uint8_t> isReachable(m_jewelState.numJewels(), false);
-            for (const Move* move : m_allMoves)
-            {
-                for (const int jewelId : move->jewels())
-                {
-                    isReachable[jewelId] = true;
-                }
-            }
-            return std::count(std::begin(isReachable), std::end(isReachable), true);
+            std::ofstream report(reportFilename);
+            writeBenchmarkReport(results, total, baselineTotal, isTimeShared, report);
         }
+    }
 
-        void addMove(Move & move)
-        {
-            const Coords2& end = move.endPos();
-
-            move.setId(static_cast<int>(m_allMoves.size()));
+    struct LevelGenerator
+    {
+        // densities are fractions of the cells inside the border walls
+        // jewels are placed only on blank cells that the vehicle passes through
+        // so there may be fewer of them than requested
+        struct Params
+        {
+            int width = 32;
+            int height = 32;
+            std::uint64_t seed = 12345;
+            float wallDensity = 0.2f;
+            float holeDensity = 0.2f;
+            float mineDensity = 0.2f;
+            float jewelDensity = 0.2f;
+        };
 
-            m_allMoves.emplace_back(&move);
-            for (int jewelId : move.jewels())
-            {
-                m_movesCollectingJewel[jewelId].emplace_back(&move);
-            }
+        // the same size limit as for the coordinates
+        static constexpr int maxSize = 1024;
 
-            m_movesByEndPosition[end].emplace_back(&move);
+        LevelGenerator(const Params& params) :
+            m_params(params),
+            m_rng(params.seed)
+        {
         }
 
-        void addMoves(Moves && movesP, const Coords2 & start, std::queue<Coords2> & ends)
+        Level generate()
         {
-            Moves& moves = m_movesByPosition[start] = std::move(movesP);
-            for (Direction dir : DirectionHelper::values())
-            {
-                Move& move = moves[dir];
-                const Coords2& start = move.startPos();
-                const Coords2& end = move.endPos();
+            const int width = std::clamp(m_params.width, 3, maxSize);
+            const int height = std::clamp(m_params.height, 3, maxSize);
 
-                if (start == end)
+            Board board(width, height);
+            board.forEach([&](CellType& cell, int x, int y) {
+                if (x == 0 || y == 0 || x == width - 1 || y == height - 1)
                 {
-                    continue;
+                    cell = CellType::Wall;
+                }
+                else
+                {
+                    cell = randomObstacle();
                 }
+                });
 
-                addMove(move);
+            const Coords2 vehicle(
+                std::uniform_int_distribution<int>(1, width - 2)(m_rng),
+                std::uniform_int_distribution<int>(1, height - 2)(m_rng));
+            board[vehicle] = CellType::Vehicle;
 
-                // add the destination point to the queue
-                // so we gather all moves from there later
-                ends.push(end);
+            std::vector<Coords2> candidates = cellsPassedThrough(board, vehicle);
+            std::shuffle(std::begin(candidates), std::end(candidates), m_rng);
+
+            const int numJewels = std::min(
+                static_cast<int>(candidates.size()),
+                std::max(1, static_cast<int>(m_params.jewelDensity * (width - 2) * (height - 2))));
+            for (int i = 0; i < numJewels; ++i)
+            {
+                board[candidates[i]] = CellType::Jewel;
             }
+
+            return Level(std::move(board), width * height);
         }
 
-        void generateAllMoves()
+    private:
+        Params m_params;
+        std::mt19937_64 m_rng;
+
+        CellType randomObstacle()
         {
-            const int width = m_level.width();
-            const int height = m_level.height();
-            Array2<bool> isVisited(width, height, false);
+            float r = std::uniform_real_distribution<float>(0.0f, 1.0f)(m_rng);
+            if ((r -= m_params.wallDensity) < 0.0f) return CellType::Wall;
+            if ((r -= m_params.holeDensity) < 0.0f) return CellType::Hole;
+            if ((r -= m_params.mineDensity) < 0.0f) return CellType::Mine;
+            return CellType::Blank;
+        }
 
-            std::queue<Coords2> coordsQueue;
-            coordsQueue.push(m_vehicleCoords);
+        // returns the end of the move, or start if the move is not possible
+        // passed cells are appended to path
+        Coords2 moveEnd(const Board& board, const Coords2& start, Direction dir, std::vector<Coords2>* path) const
+        {
+            // same rules as in Solver::generateMovesAt, without the vehicle spot being a hole
 
-            while (!coordsQueue.empty())
+            const Coords2 offset = DirectionHelper::offset(dir);
+            const std::size_t pathSize = path ? path->size() : 0;
+            Coords2 end = start;
+            for (;;)
             {
-                const Coords2 start = coordsQueue.front();
-                coordsQueue.pop();
+                const CellType cell = board[end + offset];
+                if (cell == CellType::Wall)
+                {
+                    return end;
+                }
 
-                if (isVisited[start])
+                if (cell == CellType::Mine)
                 {
-                    // prevent infinite recursion
-                    continue;
+                    if (path) path->resize(pathSize);
+                    return start;
                 }
 
-                isVisited[start] = true;
+                end += offset;
+                if (path) path->emplace_back(end);
 
-                addMoves(generateMovesAt(start), start, coordsQueue);
+                if (cell == CellType::Hole)
+                {
+                    return end;
+                }
             }
         }
 
-        Moves generateMovesAt(const Coords2 & start) const
+        std::vector<Coords2> cellsPassedThrough(const Board& board, const Coords2& vehicle) const
         {
-            Moves moves{};
+            // jewels can only be placed on blank cells passed by moves inside the largest scc
+            // reachable from the vehicle, so all of them can be collected in any order
+            // Kosaraju's algorithm, iterative because the graph can have ~10^6 nodes
 
-            for (Direction dir : DirectionHelper::values())
-            {
-                const Coords2 offset = DirectionHelper::offset(dir);
-                Coords2 end = start;
+            Array2<int> nodeIdAt(board.width(), board.height(), -1);
+            std::vector<Coords2> nodes;
+            std::vector<std::vector<int>> successors;
+            std::vector<std::vector<int>> predecessors;
 
-                // walk to the nearest stopping point
-                std::vector<JewelId> jewels;
-                if (m_level[start] == CellType::Jewel)
+            auto nodeId = [&](const Coords2& c) {
+                if (nodeIdAt[c] < 0)
                 {
-                    jewels.emplace_back(m_jewelIdByPosition[start]);
+                    nodeIdAt[c] = static_cast<int>(nodes.size());
+                    nodes.emplace_back(c);
+                    successors.emplace_back();
+                    predecessors.emplace_back();
                 }
-                for (;;)
-                {
-                    end += offset;
+                return nodeIdAt[c];
+            };
 
-                    const int x = end.x;
-                    const int y = end.y;
-                    const CellType cell = m_level[x][y];
+            nodeId(vehicle);
+            for (int v = 0; v < nodes.size(); ++v)
+            {
+                for (Direction dir : DirectionHelper::values())
+                {
+                    const Coords2 end = moveEnd(board, nodes[v], dir, nullptr);
+                    if (end != nodes[v])
+                    {
+                        const int w = nodeId(end);
+                        successors[v].emplace_back(w);
+                        predecessors[w].emplace_back(v);
+                    }
+                }
+            }
 
-                    if (cell == CellType::Jewel)
+            const int numNodes = static_cast<int>(nodes.size());
+            std::vector<int> finishOrder;
+            std::vector<std::uint8_t> isVisited(numNodes, false);
+            std::vector<std::pair<int, int>> stack;
+            stack.emplace_back(0, 0);
+            isVisited[0] = true;
+            while (!stack.empty())
+            {
+                auto& [v, next] = stack.back();
+                if (next < successors[v].size())
+                {
+                    const int w = successors[v][next++];
+                    if (!isVisited[w])
                     {
-                        jewels.emplace_back(m_jewelIdByPosition[x][y]);
+                        isVisited[w] = true;
+                        stack.emplace_back(w, 0);
                     }
+                }
+                else
+                {
+                    finishOrder.emplace_back(v);
+                    stack.pop_back();
+                }
+            }
 
-                    if (cell == CellType::Wall)
+            std::vector<int> sccIdOf(numNodes, -1);
+            std::vector<int> sccSizes;
+            std::vector<int> toVisit;
+            for (auto it = finishOrder.rbegin(); it != finishOrder.rend(); ++it)
+            {
+                if (sccIdOf[*it] >= 0)
+                {
+                    continue;
+                }
+
+                const int sccId = static_cast<int>(sccSizes.size());
+                sccSizes.emplace_back(0);
+                toVisit.emplace_back(*it);
+                sccIdOf[*it] = sccId;
+                while (!toVisit.empty())
+                {
+                    const int v = toVisit.back();
+                    toVisit.pop_back();
+                    ++sccSizes[sccId];
+                    for (const int w : predecessors[v])
                     {
-                        // we have to stop one before
-                        moves[dir] = Move(invalidMoveId, start, end - offset, std::move(jewels));
-                        break;
+                        if (sccIdOf[w] < 0)
+                        {
+                            sccIdOf[w] = sccId;
+                            toVisit.emplace_back(w);
+                        }
                     }
+                }
+            }
 
-                    if (cell == CellType::Mine)
+            const int largestSccId = static_cast<int>(std::max_element(std::begin(sccSizes), std::end(sccSizes)) - std::begin(sccSizes));
+
+            Array2<bool> isPassed(board.width(), board.height(), false);
+            std::vector<Coords2> cells;
+            std::vector<Coords2> path;
+            for (int v = 0; v < numNodes; ++v)
+            {
+                if (sccIdOf[v] != largestSccId)
+                {
+                    continue;
+                }
+
+                for (Direction dir : DirectionHelper::values())
+                {
+                    path.clear();
+                    const Coords2 end = moveEnd(board, nodes[v], dir, &path);
+                    if (end == nodes[v] || sccIdOf[nodeIdAt[end]] != largestSccId)
                     {
-                        // invalidate the whole direction
-                        moves[dir] = Move(invalidMoveId, start, start, std::move(jewels));
-                        break;
+                        continue;
                     }
 
-                    // there's always a hole under the vehicle
-                    if (cell == CellType::Hole || (cell == CellType::Vehicle && isVehicleSpotAHole))
+                    for (const Coords2& c : path)
                     {
-                        // stop right here
-                        moves[dir] = Move(invalidMoveId, start, end, std::move(jewels));
-                        break;
+                        if (!isPassed[c] && board[c] == CellType::Blank)
+                        {
+                            isPassed[c] = true;
+                            cells.emplace_back(c);
+                        }
                     }
                 }
             }
 
-            return moves;
+            return cells;
         }
     };
+
+    struct Options
+    {
+        bool isBatch = false;
+        bool isBenchmark = false;
+        bool isGenerate = false;
+        bool isProfiling = false;
+        bool isCollectingSearchStatistics = false;
+        bool isTimeShared = false;
+        int maxMoves = -1;
+        int maxAttempts = std::numeric_limits<int>::max();
+        int numThreads = static_cast<int>(std::thread::hardware_concurrency());
+        std::chrono::milliseconds timeLimit = Solver::noTimeLimit;
+        std::vector<std::string> filenames;
+        std::string baselineFilename;
+        std::string reportFilename;
+        std::string cacheDirectory;
+        std::string storeFilename;
+        LevelGenerator::Params generatorParams;
+    };
+
+    Options parseOptions(int argc, char* argv[])
+    {
+        // solver [maxMoves] [--time seconds] [--profile]
+        // --profile writes timers and counters as json to stderr
+        // --search-stats writes a per depth histogram of the backtracking search to stderr
+        // solver --batch [maxMoves] [--time seconds] [--threads n] [--list file] [files...]
+        // without files the levels are read from stdin, one after another
+        // solver --bench [--time seconds] [--shared-time] [--baseline file] [--report file] [--list file] [files...]
+        // the time for --bench is per attempt like in rate_min.py and defaults to 10 seconds,
+        // with --shared-time it is per level
+        // solver --generate width height [--seed n] [--walls p] [--holes p] [--mines p] [--jewels p]
+        // --cache directory stores preprocessed boards there and reuses them, with any mode except --generate
+        // --store file keeps the best solution of each board there and returns it when it fits, single and batch mode
+
+        Options options;
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string arg = argv[i];
+            const bool hasValue = i + 1 < argc;
+            if (arg == "--batch")
+            {
+                options.isBatch = true;
+            }
+            else if (arg == "--bench")
+            {
+                options.isBenchmark = true;
+            }
+            else if (arg == "--profile")
+            {
+                options.isProfiling = true;
+            }
+            else if (arg == "--search-stats")
+            {
+                options.isCollectingSearchStatistics = true;
+            }
+            else if (arg == "--shared-time")
+            {
+                options.isTimeShared = true;
+            }
+            else if (arg == "--attempts" && hasValue)
+            {
+                options.maxAttempts = std::strtol(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--generate" && i + 2 < argc)
+            {
+                options.isGenerate = true;
+                options.generatorParams.width = std::strtol(argv[++i], nullptr, 10);
+                options.generatorParams.height = std::strtol(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--seed" && hasValue)
+            {
+                options.generatorParams.seed = std::strtoull(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--walls" && hasValue)
+            {
+                options.generatorParams.wallDensity = std::strtof(argv[++i], nullptr);
+            }
+            else if (arg == "--holes" && hasValue)
+            {
+                options.generatorParams.holeDensity = std::strtof(argv[++i], nullptr);
+            }
+            else if (arg == "--mines" && hasValue)
+            {
+                options.generatorParams.mineDensity = std::strtof(argv[++i], nullptr);
+            }
+            else if (arg == "--jewels" && hasValue)
+            {
+                options.generatorParams.jewelDensity = std::strtof(argv[++i], nullptr);
+            }
+            else if (arg == "--baseline" && hasValue)
+            {
+                options.baselineFilename = argv[++i];
+            }
+            else if (arg == "--report" && hasValue)
+            {
+                options.reportFilename = argv[++i];
+            }
+            else if (arg == "--cache" && hasValue)
+            {
+                options.cacheDirectory = argv[++i];
+            }
+            else if (arg == "--store" && hasValue)
+            {
+                options.storeFilename = argv[++i];
+            }
+            else if (arg == "--time" && hasValue)
+            {
+                const double seconds = std::strtod(argv[++i], nullptr);
+                options.timeLimit = std::chrono::milliseconds(static_cast<std::int64_t>(seconds * 1000.0));
+            }
+            else if (arg == "--threads" && hasValue)
+            {
+                options.numThreads = std::strtol(argv[++i], nullptr, 10);
+            }
+            else if (arg == "--list" && hasValue)
+            {
+                const auto listed = readLevelList(argv[++i]);
+                options.filenames.insert(std::end(options.filenames), std::begin(listed), std::end(listed));
+            }
+            else
+            {
+                char* end;
+                const int maxMoves = std::strtol(argv[i], &end, 10);
+                if (*end == '\0')
+                {
+                    options.maxMoves = maxMoves;
+                }
+                else
+                {
+                    options.filenames.emplace_back(arg);
+                }
+            }
+        }
+
+        return options;
+    }
+
+    void runBatch(const Options& options)
+    {
+        std::optional<SolutionStore> store;
+        if (!options.storeFilename.empty())
+        {
+            store.emplace(options.storeFilename);
+        }
+
+        BatchSolver batch(options.numThreads, options.timeLimit, options.maxMoves, options.cacheDirectory, store ? &*store : nullptr);
+
+        if (options.filenames.empty())
+        {
+            batch.run([](std::optional<Level>& level) {
+                if (!hasMoreLevels(std::cin))
+                {
+                    return false;
+                }
+                // after a malformed level the rest of the input can't be trusted, hasMoreLevels ends the batch
+                Level parsed = read<Level>(std::cin);
+                if (std::cin)
+                {
+                    level.emplace(std::move(parsed));
+                }
+                return true;
+                }, std::cout);
+        }
+        else
+        {
+            auto filename = std::begin(options.filenames);
+            batch.run([&](std::optional<Level>& level) {
+                if (filename == std::end(options.filenames))
+                {
+                    return false;
+                }
+                std::ifstream file(*filename++);
+                if (file)
+                {
+                    Level parsed = read<Level>(file);
+                    if (file)
+                    {
+                        level.emplace(std::move(parsed));
+                    }
+                }
+                return true;
+                }, std::cout);
+        }
+    }
 }
 
 // Currently most of the configuration (including maximum time taken by certain
 // algorithm parts) can only be specified in the source code by changing the values
-// of constexpr variable in class Solver.
+// of constexpr variable in class BasicSolver.
 
 int main(int argc, char* argv[])
 {
+    const apto::Options options = apto::parseOptions(argc, argv);
+    if (options.isBatch)
+    {
+        apto::runBatch(options);
+        return 0;
+    }
+
+    if (options.isGenerate)
+    {
+        apto::LevelGenerator generator(options.generatorParams);
+        write(generator.generate(), std::cout);
+        return 0;
+    }
+
+    if (options.isBenchmark)
+    {
+        const auto timeLimit = options.timeLimit == apto::Solver::noTimeLimit ? std::chrono::seconds{ 10 } : options.timeLimit;
+        apto::runBenchmark(options.filenames, timeLimit, options.isTimeShared, options.maxAttempts, options.numThreads, options.cacheDirectory, options.baselineFilename, options.reportFilename);
+        return 0;
+    }
+
     apto::Bench bench;
+    bench.setProfiling(options.isProfiling);
+    bench.setCollectingSearchStatistics(options.isCollectingSearchStatistics);
 
     apto::Level level = apto::read<apto::Level>(std::cin);
-    if (argc > 1)
+    if (!std::cin)
+    {
+        write(apto::Solution::invalid(), std::cout);
+        return 0;
+    }
+
+    if (options.maxMoves >= 0)
     {
-        char* end;
-        const int maxMoves = std::strtol(argv[1], &end, 10);
-        level.setMaxMoves(maxMoves);
+        level.setMaxMoves(options.maxMoves);
     }
     if (apto::g_logger.enabled) write(level, std::cout);
 
-    apto::Solver solver(level, bench);
+    std::optional<apto::SolutionStore> store;
+    if (!options.storeFilename.empty())
+    {
+        store.emplace(options.storeFilename);
+    }
+
+    apto::Solver solver(level, bench, options.timeLimit, options.numThreads, options.cacheDirectory, store ? &*store : nullptr);
     auto solution = solver.solve();
-    // apto::g_logger.log("NPS: ", static_cast<std::uint64_t>(bench.nodesPerSecond()), '\n');
+    apto::g_logger.log("NPS: ", static_cast<std::uint64_t>(bench.nodesPerSecond()), '\n');
     apto::g_logger.log("Time: ", static_cast<float>(bench.elapsed().count()) / 1e9, "s\n");
     apto::g_logger.log(solution.size(), '\n');
     write(solution, std::cout);
-}
\ No newline at end of file
+
+    if (options.isProfiling)
+    {
+        bench.writeProfile(std::cerr);
+    }
+
+    if (options.isCollectingSearchStatistics)
+    {
+        bench.searchStatistics()->writeHistogram(std::cerr);
+    }
+}